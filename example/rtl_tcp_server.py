@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+# Stand-in for an rtl_tcp server to test rtl_tcp_io without hardware.
+# Serves a CU8 file, or a tone if no file is given,
+# paced at the sample rate requested by the client.
+# Prints the commands received from the client.
+#
+# Usage: ./rtl_tcp_server.py [file.cu8] [port]
+
+import socket, struct, sys, threading, time, math
+
+filename = sys.argv[1] if len(sys.argv) > 1 else None
+port = int(sys.argv[2]) if len(sys.argv) > 2 else 1234
+
+COMMANDS = { 1: "frequency", 2: "samplerate", 3: "gain mode", 4: "gain", 5: "ppm", 8: "agc" }
+BLOCK = 16384  # samples
+
+def tone(freq, samplerate, n):
+	# One period of the tone repeats every n samples
+	return bytes(b for i in range(n) for b in (
+		int(127.5 + 100 * math.cos(2 * math.pi * freq * i / samplerate)),
+		int(127.5 + 100 * math.sin(2 * math.pi * freq * i / samplerate))))
+
+def handle_commands(conn, state):
+	buf = b""
+	while True:
+		try:
+			data = conn.recv(64)
+		except OSError:
+			break
+		if not data:
+			break
+		buf += data
+		while len(buf) >= 5:
+			cmd, param = struct.unpack(">BI", buf[0:5])
+			buf = buf[5:]
+			print("Command:", COMMANDS.get(cmd, cmd), param)
+			if cmd == 2:
+				state["samplerate"] = param
+
+def serve(conn):
+	state = { "samplerate": 1000000 }
+	# Header: magic, tuner type (R820T), number of gain values
+	conn.sendall(b"RTL0" + struct.pack(">II", 5, 29))
+	threading.Thread(target=handle_commands, args=(conn, state), daemon=True).start()
+
+	if filename:
+		f = open(filename, "rb")
+	else:
+		block = tone(1000, 64000, 64) * (BLOCK // 64)
+	t = time.monotonic()
+	while True:
+		if filename:
+			block = f.read(2 * BLOCK)
+			if len(block) < 2:
+				break
+		conn.sendall(block)
+		t += len(block) / 2 / state["samplerate"]
+		time.sleep(max(0, t - time.monotonic()))
+
+srv = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+srv.bind(("127.0.0.1", port))
+srv.listen(1)
+print("Listening on port", port)
+while True:
+	conn, addr = srv.accept()
+	print("Client connected from", addr)
+	try:
+		serve(conn)
+	except (BrokenPipeError, ConnectionResetError):
+		pass
+	# Shutdown also wakes up the command thread.
+	# It fails if the client already closed the connection.
+	try:
+		conn.shutdown(socket.SHUT_RDWR)
+	except OSError:
+		pass
+	conn.close()
+	print("Client disconnected")
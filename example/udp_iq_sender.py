@@ -0,0 +1,54 @@
+#!/usr/bin/env python3
+# Stand-in for a network-attached digitizer to test udp_io.
+# Sends a CS16 file, or a tone if no file is given, as UDP packets,
+# either raw or as VITA-49 IF data packets with a sample count
+# timestamp, paced at the given sample rate.
+#
+# Usage: ./udp_iq_sender.py [--vita49] [--drop P] [file.cs16]
+
+import argparse, socket, struct, time, math, random
+
+p = argparse.ArgumentParser()
+p.add_argument("file", nargs="?")
+p.add_argument("--host", default="127.0.0.1")
+p.add_argument("--port", type=int, default=4991)
+p.add_argument("--samplerate", type=float, default=1e6)
+p.add_argument("--samples", type=int, default=1024, help="samples per packet")
+p.add_argument("--vita49", action="store_true")
+p.add_argument("--drop", type=float, default=0, help="probability of not sending a packet")
+args = p.parse_args()
+
+def tone(n):
+	# Little-endian CS16 as expected by udp_io with big_endian 0
+	return b"".join(struct.pack("<hh",
+		int(16000 * math.cos(2 * math.pi * i / 64)),
+		int(16000 * math.sin(2 * math.pi * i / 64))) for i in range(n))
+
+def vita49_header(count, samples, payload_len):
+	# IF data with stream ID, UTC timestamp of 0 and sample count timestamp
+	words = 5 + payload_len // 4
+	return struct.pack(">IIIQ",
+		1 << 28 | 1 << 22 | 1 << 20 | (count & 0xF) << 16 | words,
+		0x5355, 0, samples)
+
+sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+f = open(args.file, "rb") if args.file else None
+payload = tone(args.samples)
+count = 0
+samples = 0
+sent = 0
+t = time.monotonic()
+while True:
+	if f:
+		payload = f.read(4 * args.samples)
+		if len(payload) < 4:
+			break
+	if random.random() >= args.drop:
+		hdr = vita49_header(count, samples, len(payload)) if args.vita49 else b""
+		sock.sendto(hdr + payload, (args.host, args.port))
+		sent += 1
+	count += 1
+	samples += len(payload) // 4
+	t += len(payload) / 4 / args.samplerate
+	time.sleep(max(0, t - time.monotonic()))
+print("Sent", sent, "of", count, "packets")
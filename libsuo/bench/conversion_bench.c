@@ -0,0 +1,156 @@
+/* Benchmark of sample format conversions.
+ * Runs each conversion with every implementation supported
+ * by the CPU and reports the throughput as bytes read and
+ * written per second. Results are compared to the scalar
+ * implementation to catch mistakes in the vectorized ones. */
+
+#include "signal-io/conversion.h"
+#include "signal-io/clock.h"
+#include <stdio.h>
+#include <string.h>
+
+// Number of samples in a buffer. Small enough to stay in cache.
+#define N 8192
+// Minimum time to run each conversion (ns)
+#define RUN_NS 200000000LL
+
+static sample_t in_cf[N], out_cf[N], ref_cf[N];
+static cs16_t in_cs16[N], out_cs16[N], ref_cs16[N];
+static cs8_t in_cs8[N], out_cs8[N], ref_cs8[N];
+static cu8_t in_cu8[N];
+static sc12_t in_sc12[N], out_sc12[N], ref_sc12[N];
+static cf16_t in_cf16[N], out_cf16[N], ref_cf16[N];
+
+enum kernel { CS16_TO_CF, CS8_TO_CF, CU8_TO_CF, SC12_TO_CF, CF16_TO_CF,
+	CF_TO_CS16, CF_TO_CS8, CF_TO_SC12, CF_TO_CF16, N_KERNELS };
+
+static const char *const kernel_names[N_KERNELS] = {
+	"cs16_to_cf", "cs8_to_cf", "cu8_to_cf", "sc12_to_cf", "cf16_to_cf",
+	"cf_to_cs16", "cf_to_cs8", "cf_to_sc12", "cf_to_cf16"
+};
+
+
+// Run a conversion once. Return the number of bytes read and written.
+static size_t run(enum kernel kernel)
+{
+	switch (kernel) {
+	case CS16_TO_CF:
+		cs16_to_cf(in_cs16, out_cf, N);
+		return N * (sizeof(cs16_t) + sizeof(sample_t));
+	case CS8_TO_CF:
+		cs8_to_cf(in_cs8, out_cf, N);
+		return N * (sizeof(cs8_t) + sizeof(sample_t));
+	case CU8_TO_CF:
+		cu8_to_cf(in_cu8, out_cf, N);
+		return N * (sizeof(cu8_t) + sizeof(sample_t));
+	case SC12_TO_CF:
+		sc12_to_cf(in_sc12, out_cf, N);
+		return N * (sizeof(sc12_t) + sizeof(sample_t));
+	case CF16_TO_CF:
+		cf16_to_cf(in_cf16, out_cf, N);
+		return N * (sizeof(cf16_t) + sizeof(sample_t));
+	case CF_TO_CS16:
+		cf_to_cs16(in_cf, out_cs16, N);
+		return N * (sizeof(sample_t) + sizeof(cs16_t));
+	case CF_TO_CS8:
+		cf_to_cs8(in_cf, out_cs8, N);
+		return N * (sizeof(sample_t) + sizeof(cs8_t));
+	case CF_TO_SC12:
+		cf_to_sc12(in_cf, out_sc12, N);
+		return N * (sizeof(sample_t) + sizeof(sc12_t));
+	case CF_TO_CF16:
+		cf_to_cf16(in_cf, out_cf16, N);
+		return N * (sizeof(sample_t) + sizeof(cf16_t));
+	default:
+		return 0;
+	}
+}
+
+
+// Save the output of a conversion as the reference or compare to it
+static bool check(enum kernel kernel, bool save)
+{
+	void *out, *ref;
+	size_t size;
+	switch (kernel) {
+	case CS16_TO_CF:
+	case CS8_TO_CF:
+	case CU8_TO_CF:
+	case SC12_TO_CF:
+	case CF16_TO_CF:
+		out = out_cf; ref = ref_cf; size = sizeof(out_cf);
+		break;
+	case CF_TO_CS16:
+		out = out_cs16; ref = ref_cs16; size = sizeof(out_cs16);
+		break;
+	case CF_TO_SC12:
+		out = out_sc12; ref = ref_sc12; size = sizeof(out_sc12);
+		break;
+	case CF_TO_CF16:
+		out = out_cf16; ref = ref_cf16; size = sizeof(out_cf16);
+		break;
+	default:
+		out = out_cs8; ref = ref_cs8; size = sizeof(out_cs8);
+		break;
+	}
+	if (save) {
+		memcpy(ref, out, size);
+		return 1;
+	}
+	return memcmp(ref, out, size) == 0;
+}
+
+
+int main(void)
+{
+	size_t i;
+	int isa;
+	enum kernel kernel;
+
+	/* Random input signal. Floats go somewhat over full scale
+	 * to exercise saturation. */
+	srand(1);
+	for (i = 0; i < N; i++) {
+		in_cf[i] = 1.2f * ((float)rand() / RAND_MAX * 2.0f - 1.0f)
+		   + I * 1.2f * ((float)rand() / RAND_MAX * 2.0f - 1.0f);
+		in_cs16[i][0] = rand(); in_cs16[i][1] = rand();
+		in_cs8[i][0]  = rand(); in_cs8[i][1]  = rand();
+		in_cu8[i][0]  = rand(); in_cu8[i][1]  = rand();
+		for (size_t j = 0; j < sizeof(sc12_t); j++)
+			in_sc12[i][j] = rand();
+	}
+	// Random bits would include NaNs, so make half floats from the floats
+	cf_to_cf16(in_cf, in_cf16, N);
+
+	const enum conversion_isa selected = conversion_selected();
+	printf("Selected implementation: %s\n\n", conversion_isa_name(selected));
+	printf("%-12s", "");
+	for (isa = CONVERSION_SCALAR; isa <= CONVERSION_AVX512; isa++)
+		printf("%12s", conversion_isa_name(isa));
+	printf("\n");
+
+	for (kernel = 0; kernel < N_KERNELS; kernel++) {
+		printf("%-12s", kernel_names[kernel]);
+		for (isa = CONVERSION_SCALAR; isa <= CONVERSION_AVX512; isa++) {
+			if (conversion_select(isa) < 0) {
+				printf("%12s", "-");
+				continue;
+			}
+			run(kernel);
+			bool ok = check(kernel, isa == CONVERSION_SCALAR);
+
+			size_t bytes = 0;
+			long long t, t0 = monotonic_ns();
+			do {
+				for (i = 0; i < 100; i++)
+					bytes += run(kernel);
+				t = monotonic_ns() - t0;
+			} while (t < RUN_NS);
+			printf("%7.2f GB/s%s", (double)bytes / (double)t, ok ? "" : "!");
+		}
+		printf("\n");
+	}
+	conversion_select(selected);
+	printf("\n! = result differs from scalar implementation\n");
+	return 0;
+}
@@ -0,0 +1,101 @@
+/* Benchmark of compressed signal capture coding.
+ * Compresses and decompresses a synthetic signal and reports
+ * throughput and compression ratio.
+ *
+ * With file names as arguments, compresses an existing CS16
+ * capture file instead:
+ *   iq_compress_bench input.cs16 output.iqz samplerate */
+
+#include "signal-io/iq_compress.h"
+#include "signal-io/clock.h"
+#include <stdio.h>
+#include <string.h>
+
+static int compress_file(const char *in_name, const char *out_name, double samplerate)
+{
+	FILE *in = fopen(in_name, "rb"), *out = fopen(out_name, "wb");
+	if (in == NULL || out == NULL) {
+		perror("Failed to open file");
+		return 1;
+	}
+	struct iqz_writer *w = iqz_writer_open(out, IQZ_BLOCK, samplerate);
+	static cs16_t buf[IQZ_BLOCK];
+	size_t n;
+	uint64_t total = 0;
+	while ((n = fread(buf, sizeof(cs16_t), IQZ_BLOCK, in)) > 0) {
+		iqz_write(w, buf, n, 1e9 * (double)total / samplerate);
+		total += n;
+	}
+	iqz_writer_close(w);
+	fprintf(stderr, "%llu samples, compressed to %.1f %%\n",
+		(unsigned long long)total, 100.0 * (double)ftell(out) / (double)(total * sizeof(cs16_t)));
+	fclose(in);
+	fclose(out);
+	return 0;
+}
+
+
+// Noise with a given standard deviation and an oversampled tone
+static void make_signal(cs16_t *s, size_t n, float noise, float tone)
+{
+	size_t i;
+	for (i = 0; i < n; i++) {
+		// Approximately Gaussian noise from a sum of uniform variables
+		float ni = 0, nq = 0;
+		int j;
+		for (j = 0; j < 4; j++) {
+			ni += (float)rand() / RAND_MAX - 0.5f;
+			nq += (float)rand() / RAND_MAX - 0.5f;
+		}
+		float ph = 0.01f * (float)i;
+		s[i][0] = noise * 1.73f * ni + tone * cosf(ph);
+		s[i][1] = noise * 1.73f * nq + tone * sinf(ph);
+	}
+}
+
+
+int main(int argc, char *argv[])
+{
+	if (argc == 4)
+		return compress_file(argv[1], argv[2], atof(argv[3]));
+
+	const size_t n = IQZ_BLOCK;
+	static cs16_t in[IQZ_BLOCK], out[IQZ_BLOCK];
+	static uint8_t comp[2 + 4 * IQZ_BLOCK];
+	const float levels[][2] = { { 10, 0 }, { 100, 0 }, { 100, 3000 }, { 3000, 0 }, { 20000, 0 } };
+	size_t i;
+
+	printf("%12s %12s %10s %14s %14s\n", "noise", "tone", "size", "encode", "decode");
+	for (i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+		make_signal(in, n, levels[i][0], levels[i][1]);
+		size_t nbytes = iqz_encode(in, n, comp);
+		if (iqz_decode(comp, nbytes, out, n) < 0 || memcmp(in, out, sizeof(in)) != 0) {
+			printf("Decoded signal differs from the original!\n");
+			return 1;
+		}
+
+		long long t0, t_enc, t_dec;
+		int rounds = 0;
+		t0 = monotonic_ns();
+		do {
+			iqz_encode(in, n, comp);
+			rounds++;
+			t_enc = monotonic_ns() - t0;
+		} while (t_enc < 200000000LL);
+		const double enc_rate = 1e3 * rounds * (double)n / (double)t_enc;
+
+		rounds = 0;
+		t0 = monotonic_ns();
+		do {
+			iqz_decode(comp, nbytes, out, n);
+			rounds++;
+			t_dec = monotonic_ns() - t0;
+		} while (t_dec < 200000000LL);
+		const double dec_rate = 1e3 * rounds * (double)n / (double)t_dec;
+
+		printf("%12.0f %12.0f %9.1f%% %9.1f Msps %9.1f Msps\n",
+			(double)levels[i][0], (double)levels[i][1],
+			100.0 * (double)nbytes / (double)(n * sizeof(cs16_t)), enc_rate, dec_rate);
+	}
+	return 0;
+}
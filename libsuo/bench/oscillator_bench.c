@@ -0,0 +1,173 @@
+/* Benchmark of the block oscillator against liquid-dsp NCO.
+ * Runs the same mixing and signal generation tasks
+ * the modems do, using per-sample liquid-dsp calls as they
+ * were used before, the liquid-dsp block functions where
+ * available and the block oscillator. Reports throughput
+ * in samples per second and the largest error compared to
+ * a double precision reference. */
+
+#include "modem/oscillator.h"
+#include "signal-io/clock.h"
+#include <liquid/liquid.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+// Number of samples in a buffer. Small enough to stay in cache.
+#define N 8192
+// Minimum time to run each implementation (ns)
+#define RUN_NS 200000000LL
+
+// Frequencies used in the tests (radians per sample)
+#define FREQ 0.1234f
+#define DFREQ 1e-6f
+#define FREQ_FSK0 0.3f
+#define FREQ_FSK1 0.5f
+#define SYMBOL_LEN 10
+
+static sample_t in[N], out[N];
+static float freqs[N];
+
+enum impl { LIQUID_STEP, LIQUID_BLOCK, OSC_FIXED,
+	LIQUID_RAMP, OSC_RAMP,
+	LIQUID_FSK, OSC_FSK, N_IMPLS };
+
+static const char *const impl_names[N_IMPLS] = {
+	"nco_crcf_step+mix_down", "nco_crcf_mix_block_down", "oscillator_mix_down",
+	"nco_crcf_adjust_frequency", "oscillator_mix_down_ramp",
+	"nco_crcf_set_frequency", "oscillator_generate_freqs"
+};
+
+static nco_crcf l_nco;
+static struct oscillator osc;
+
+
+static void reset(enum impl impl)
+{
+	float f = (impl == LIQUID_FSK || impl == OSC_FSK) ? FREQ_FSK0 : FREQ;
+	nco_crcf_set_phase(l_nco, 0);
+	nco_crcf_set_frequency(l_nco, f);
+	oscillator_init(&osc, f);
+}
+
+
+// Process one buffer
+static void run(enum impl impl)
+{
+	size_t i;
+	switch (impl) {
+	case LIQUID_STEP:
+		for (i = 0; i < N; i++) {
+			nco_crcf_step(l_nco);
+			nco_crcf_mix_down(l_nco, in[i], &out[i]);
+		}
+		break;
+	case LIQUID_BLOCK:
+		nco_crcf_mix_block_down(l_nco, in, out, N);
+		break;
+	case OSC_FIXED:
+		oscillator_mix_down(&osc, in, out, N);
+		break;
+	case LIQUID_RAMP:
+		for (i = 0; i < N; i++) {
+			nco_crcf_adjust_frequency(l_nco, DFREQ);
+			nco_crcf_step(l_nco);
+			nco_crcf_mix_down(l_nco, in[i], &out[i]);
+		}
+		break;
+	case OSC_RAMP:
+		oscillator_mix_down_ramp(&osc, in, out, N, DFREQ);
+		break;
+	case LIQUID_FSK:
+		for (i = 0; i < N; i++) {
+			nco_crcf_set_frequency(l_nco, freqs[i]);
+			nco_crcf_step(l_nco);
+			nco_crcf_cexpf(l_nco, &out[i]);
+		}
+		break;
+	case OSC_FSK:
+		oscillator_generate_freqs(&osc, freqs, out, N);
+		break;
+	default:
+		break;
+	}
+}
+
+
+/* Largest error in the first buffer after reset.
+ * nco_crcf_mix_block_down advances the phase after each sample
+ * while the others advance it before, so its reference
+ * is one sample behind. */
+static double max_error(enum impl impl)
+{
+	double ph = 0, f = FREQ, err = 0;
+	size_t i;
+	for (i = 0; i < N; i++) {
+		switch (impl) {
+		case LIQUID_BLOCK:
+			break;
+		case LIQUID_RAMP:
+		case OSC_RAMP:
+			f += (double)DFREQ;
+			ph += f;
+			break;
+		case LIQUID_FSK:
+		case OSC_FSK:
+			ph += (double)freqs[i];
+			break;
+		default:
+			ph += f;
+			break;
+		}
+		double complex ref = CMPLX(cos(ph), sin(ph));
+		if (impl != LIQUID_FSK && impl != OSC_FSK)
+			ref = (double complex)in[i] * conj(ref);
+		if (impl == LIQUID_BLOCK)
+			ph += f;
+		double e = cabs((double complex)out[i] - ref);
+		if (e > err)
+			err = e;
+	}
+	return err;
+}
+
+
+int main(void)
+{
+	size_t i;
+	enum impl impl;
+
+	// Random input signal with unit magnitude and random FSK symbols
+	srand(1);
+	for (i = 0; i < N; i++) {
+		in[i] = cexpf(I * ((float)rand() / RAND_MAX * 6.28f));
+		if (i % SYMBOL_LEN == 0)
+			freqs[i] = rand() & 1 ? FREQ_FSK1 : FREQ_FSK0;
+		else
+			freqs[i] = freqs[i - 1];
+	}
+
+	l_nco = nco_crcf_create(LIQUID_NCO);
+
+	printf("%-28s%14s%12s\n", "", "throughput", "max error");
+	for (impl = 0; impl < N_IMPLS; impl++) {
+		reset(impl);
+		run(impl);
+		double err = max_error(impl);
+
+		size_t samples = 0;
+		long long t, t0 = monotonic_ns();
+		do {
+			for (i = 0; i < 100; i++) {
+				run(impl);
+				samples += N;
+			}
+			t = monotonic_ns() - t0;
+		} while (t < RUN_NS);
+		printf("%-28s%8.1f MS/s%12.2e\n", impl_names[impl],
+			1e3 * (double)samples / (double)t, err);
+	}
+
+	nco_crcf_destroy(l_nco);
+	return 0;
+}
@@ -1,5 +1,7 @@
 #include "modem/simple_receiver.h"
 #include "modem/burst_dpsk_receiver.h"
+#include "modem/discriminator_receiver.h"
+#include "modem/channelizer_receiver.h"
 #include "modem/simple_transmitter.h"
 #include "modem/psk_transmitter.h"
 #include "coding/basic_decoder.h"
@@ -11,6 +13,8 @@
 const struct receiver_code *suo_receivers[] = {
 	&simple_receiver_code,
 	&burst_dpsk_receiver_code,
+	&discriminator_receiver_code,
+	&channelizer_receiver_code,
 	NULL
 };
 
@@ -2,6 +2,11 @@
 #include "frame-io/zmq_interface.h"
 #include "signal-io/file_io.h"
 #include "signal-io/soapysdr_io.h"
+#include "signal-io/loopback_io.h"
+#include "signal-io/traffic_io.h"
+#include "signal-io/shm_io.h"
+#include "signal-io/rtl_tcp_io.h"
+#include "signal-io/udp_io.h"
 #if ENABLE_ALSA
 #include "signal-io/alsa_io.h"
 #endif
@@ -23,6 +28,15 @@ const struct tx_input_code *suo_tx_inputs[] = {
 const struct signal_io_code *suo_signal_ios[] = {
 	&file_io_code,
 	&soapysdr_io_code,
+	&loopback_io_code,
+	&traffic_io_code,
+#ifndef _WIN32
+	&shm_io_code,
+	&rtl_tcp_io_code,
+#endif
+#ifdef __linux__
+	&udp_io_code,
+#endif
 #if ENABLE_ALSA
 	&alsa_io_code,
 #endif
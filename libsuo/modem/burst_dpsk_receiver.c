@@ -227,7 +227,13 @@ static int set_callbacks(void *arg, const struct rx_output_code *output, void *o
 
 static int destroy(void *arg)
 {
-	(void)arg;
+	struct burst_dpsk_receiver *self = arg;
+	if (self == NULL)
+		return 0;
+	suo_ddc_destroy(self->ddc);
+	firfilt_crcf_destroy(self->l_mf);
+	windowcf_destroy(self->l_win);
+	free(self);
 	return 0;
 }
 
@@ -260,4 +266,4 @@ CONFIG_I(framelen)
 CONFIG_END()
 
 
-const struct receiver_code burst_dpsk_receiver_code = { "burst_dpsk_receiver", init, destroy, init_conf, set_conf, set_callbacks, execute };
+const struct receiver_code burst_dpsk_receiver_code = { "burst_dpsk_receiver", init, destroy, init_conf, set_conf, set_callbacks, execute, NULL };
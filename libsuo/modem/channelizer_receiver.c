@@ -0,0 +1,378 @@
+/* Polyphase filter bank channelizer feeding burst DPSK receivers */
+
+#include "channelizer_receiver.h"
+#include "suo_macros.h"
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <liquid/liquid.h>
+
+#define FRAMELEN_MAX 0x900
+// Semi-length of the filter bank prototype filter
+#define PFB_SEMILEN 6
+// Number of output samples per channel processed at a time
+#define CH_BLOCK 256
+
+struct channelizer_receiver;
+
+struct channel {
+	struct channelizer_receiver *parent;
+	void *rx;
+	unsigned index;
+	// Index of the channel in the filter bank output
+	unsigned bin;
+	float freq;
+};
+
+struct channelizer_receiver {
+	/* Configuration */
+	struct channelizer_receiver_conf c;
+	unsigned nbins; // Number of channels in the filter bank
+	float sample_ns;
+	timestamp_t delay_ns;
+
+	/* Callbacks */
+	const struct rx_output_code *output;
+	void *output_arg;
+
+	/* liquid-dsp objects */
+	firpfbch2_crcf l_pfb;
+
+	/* Channels */
+	struct channel *ch;
+	/* Output of the filter bank for each channel,
+	 * CH_BLOCK samples per channel */
+	sample_t *chbuf;
+	unsigned chbuf_n;
+	timestamp_t chbuf_time;
+
+	/* Input waiting for a full block of nbins/2 samples */
+	sample_t *inbuf;
+	unsigned inbuf_n;
+	sample_t *pfb_out;
+
+	/* Worker threads */
+	pthread_t *threads;
+	unsigned nthreads;
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond, done_cond;
+	unsigned generation, pending;
+	bool quit;
+
+	/* Frames from the channels are passed to the output
+	 * one at a time, with metadata of the channel added */
+	pthread_mutex_t output_lock;
+	struct frame frame;
+	/* Allocate space for flexible array member */
+	bit_t frame_buffer[FRAMELEN_MAX];
+};
+
+
+static int channel_frame(void *arg, const struct frame *frame)
+{
+	struct channel *ch = arg;
+	struct channelizer_receiver *self = ch->parent;
+	if (frame->m.len > FRAMELEN_MAX)
+		return -1;
+
+	pthread_mutex_lock(&self->output_lock);
+	self->frame.m = frame->m;
+	memcpy(self->frame.data, frame->data, frame->m.len);
+	self->frame.m.id = ch->index;
+	self->frame.m.cfo = ch->freq;
+	self->frame.m.flags |= METADATA_ID | METADATA_CFO;
+	int ret = self->output->frame(self->output_arg, &self->frame);
+	pthread_mutex_unlock(&self->output_lock);
+	return ret;
+}
+
+
+static int channel_tick(void *arg, timestamp_t timenow)
+{
+	// The channelizer ticks the output once for all channels
+	(void)arg; (void)timenow;
+	return 0;
+}
+
+
+static const struct rx_output_code channel_output_code = { "channelizer_channel", NULL, NULL, NULL, NULL, NULL, channel_frame, channel_tick };
+
+
+/* Run every step'th channel receiver starting from first
+ * for the buffered filter bank output */
+static void run_channels(struct channelizer_receiver *self, unsigned first, unsigned step)
+{
+	unsigned k;
+	for (k = first; k < self->c.channels; k += step) {
+		burst_dpsk_receiver_code.execute(self->ch[k].rx,
+			self->chbuf + (size_t)k * CH_BLOCK, self->chbuf_n, self->chbuf_time);
+	}
+}
+
+
+struct worker {
+	struct channelizer_receiver *self;
+	unsigned index;
+};
+
+
+static void *worker_main(void *arg)
+{
+	struct worker *w = arg;
+	struct channelizer_receiver *self = w->self;
+	unsigned generation = 0;
+
+	for (;;) {
+		pthread_mutex_lock(&self->lock);
+		while (self->generation == generation && !self->quit)
+			pthread_cond_wait(&self->work_cond, &self->lock);
+		generation = self->generation;
+		bool quit = self->quit;
+		pthread_mutex_unlock(&self->lock);
+		if (quit)
+			break;
+
+		run_channels(self, w->index, self->nthreads);
+
+		pthread_mutex_lock(&self->lock);
+		if (--self->pending == 0)
+			pthread_cond_signal(&self->done_cond);
+		pthread_mutex_unlock(&self->lock);
+	}
+	free(w);
+	return NULL;
+}
+
+
+/* Pass the buffered filter bank output to the channel receivers
+ * and wait for them to finish */
+static void flush_channels(struct channelizer_receiver *self)
+{
+	if (self->chbuf_n == 0)
+		return;
+	if (self->nthreads == 0) {
+		run_channels(self, 0, 1);
+	} else {
+		pthread_mutex_lock(&self->lock);
+		self->pending = self->nthreads;
+		self->generation++;
+		pthread_cond_broadcast(&self->work_cond);
+		while (self->pending > 0)
+			pthread_cond_wait(&self->done_cond, &self->lock);
+		pthread_mutex_unlock(&self->lock);
+	}
+	self->chbuf_n = 0;
+}
+
+
+static int execute(void *arg, const sample_t *samples, size_t nsamp, timestamp_t timestamp)
+{
+	struct channelizer_receiver *self = arg;
+	self->output->tick(self->output_arg, timestamp);
+
+	const unsigned half = self->nbins / 2, channels = self->c.channels;
+	size_t i;
+	for (i = 0; i < nsamp; ) {
+		/* Collect nbins/2 input samples for the filter bank.
+		 * Use the input buffer directly if there's nothing
+		 * left over from the previous call. */
+		sample_t *block;
+		if (self->inbuf_n == 0 && nsamp - i >= half) {
+			block = (sample_t *)samples + i;
+			i += half;
+		} else {
+			unsigned n = half - self->inbuf_n;
+			if (n > nsamp - i)
+				n = nsamp - i;
+			memcpy(self->inbuf + self->inbuf_n, samples + i, n * sizeof(sample_t));
+			self->inbuf_n += n;
+			i += n;
+			if (self->inbuf_n < half)
+				break;
+			block = self->inbuf;
+			self->inbuf_n = 0;
+		}
+
+		/* Time of the first sample of the block,
+		 * corrected by the delay of the filter bank */
+		if (self->chbuf_n == 0) {
+			self->chbuf_time = timestamp - self->delay_ns
+				+ (timestamp_t)(self->sample_ns * (float)i)
+				- (timestamp_t)(self->sample_ns * (float)half);
+		}
+
+		firpfbch2_crcf_execute(self->l_pfb, block, self->pfb_out);
+		unsigned k;
+		for (k = 0; k < channels; k++)
+			self->chbuf[(size_t)k * CH_BLOCK + self->chbuf_n] = self->pfb_out[self->ch[k].bin];
+		if (++self->chbuf_n >= CH_BLOCK)
+			flush_channels(self);
+	}
+	flush_channels(self);
+	return 0;
+}
+
+
+static int destroy(void *arg)
+{
+	struct channelizer_receiver *self = arg;
+	unsigned i;
+
+	pthread_mutex_lock(&self->lock);
+	self->quit = 1;
+	pthread_cond_broadcast(&self->work_cond);
+	pthread_mutex_unlock(&self->lock);
+	for (i = 0; i < self->nthreads; i++)
+		pthread_join(self->threads[i], NULL);
+	pthread_mutex_destroy(&self->lock);
+	pthread_cond_destroy(&self->work_cond);
+	pthread_cond_destroy(&self->done_cond);
+	pthread_mutex_destroy(&self->output_lock);
+
+	if (self->ch != NULL) {
+		for (i = 0; i < self->c.channels; i++) {
+			if (self->ch[i].rx != NULL)
+				burst_dpsk_receiver_code.destroy(self->ch[i].rx);
+		}
+	}
+	if (self->l_pfb != NULL)
+		firpfbch2_crcf_destroy(self->l_pfb);
+	free(self->threads);
+	free(self->ch);
+	free(self->chbuf);
+	free(self->inbuf);
+	free(self->pfb_out);
+	free(self);
+	return 0;
+}
+
+
+static void *init(const void *conf_v)
+{
+	struct channelizer_receiver *self = calloc(1, sizeof(*self));
+	if (self == NULL)
+		return NULL;
+	self->c = *(const struct channelizer_receiver_conf *)conf_v;
+	const struct channelizer_receiver_conf *c = &self->c;
+	pthread_mutex_init(&self->lock, NULL);
+	pthread_cond_init(&self->work_cond, NULL);
+	pthread_cond_init(&self->done_cond, NULL);
+	pthread_mutex_init(&self->output_lock, NULL);
+
+	/* Filter bank with channels at the given spacing
+	 * over the whole input bandwidth */
+	self->nbins = lroundf(c->samplerate / c->spacing);
+	if (self->nbins < 2 || self->nbins % 2 != 0
+	|| fabsf(self->nbins * c->spacing - c->samplerate) > 1e-3f * c->spacing) {
+		fprintf(stderr, "Channelizer: sample rate must be an even multiple of channel spacing\n");
+		goto fail;
+	}
+	const unsigned nbins = self->nbins;
+	self->sample_ns = 1.0e9f / c->samplerate;
+	self->delay_ns = (timestamp_t)(self->sample_ns * (float)(nbins * PFB_SEMILEN));
+	self->l_pfb = firpfbch2_crcf_create_kaiser(LIQUID_ANALYZER, nbins, PFB_SEMILEN, 60.0f);
+	self->inbuf = malloc(nbins / 2 * sizeof(sample_t));
+	self->pfb_out = malloc(nbins * sizeof(sample_t));
+	self->chbuf = malloc((size_t)c->channels * CH_BLOCK * sizeof(sample_t));
+	self->ch = calloc(c->channels, sizeof(struct channel));
+	if (self->l_pfb == NULL || self->inbuf == NULL || self->pfb_out == NULL
+	|| (self->chbuf == NULL && c->channels > 0) || (self->ch == NULL && c->channels > 0))
+		goto fail;
+
+	/* Each channel is taken from the nearest filter bank output.
+	 * The channel receiver mixes away the remaining offset. */
+	unsigned i;
+	for (i = 0; i < c->channels; i++) {
+		struct channel *ch = &self->ch[i];
+		ch->parent = self;
+		ch->index = i;
+		ch->freq = c->centerfreq + c->spacing * i;
+		long b = lroundf(ch->freq / c->spacing);
+		if (b >= (long)nbins / 2 || b < -(long)nbins / 2) {
+			fprintf(stderr, "Channelizer: channel %u (%f Hz) is outside of the input band\n",
+				i, (double)ch->freq);
+			goto fail;
+		}
+		ch->bin = (b + nbins) % nbins;
+
+		struct burst_dpsk_receiver_conf rxc = c->rx;
+		rxc.samplerate = 2.0f * c->spacing;
+		rxc.centerfreq = ch->freq - c->spacing * b;
+		ch->rx = burst_dpsk_receiver_code.init(&rxc);
+		if (ch->rx == NULL)
+			goto fail;
+		burst_dpsk_receiver_code.set_callbacks(ch->rx, &channel_output_code, ch);
+	}
+
+	self->threads = calloc(c->threads, sizeof(pthread_t));
+	if (self->threads == NULL && c->threads > 0)
+		goto fail;
+	for (i = 0; i < c->threads; i++) {
+		struct worker *w = malloc(sizeof(*w));
+		if (w == NULL)
+			goto fail;
+		w->self = self;
+		w->index = i;
+		if (pthread_create(&self->threads[i], NULL, worker_main, w) != 0) {
+			fprintf(stderr, "Channelizer: failed to create worker thread\n");
+			free(w);
+			goto fail;
+		}
+		self->nthreads++;
+	}
+	fprintf(stderr, "Channelizer: %u channels from a %u channel filter bank in %u threads\n",
+		c->channels, nbins, self->nthreads);
+	return self;
+
+fail:
+	destroy(self);
+	return NULL;
+}
+
+
+static int set_callbacks(void *arg, const struct rx_output_code *output, void *output_arg)
+{
+	struct channelizer_receiver *self = arg;
+	self->output = output;
+	self->output_arg = output_arg;
+	return 0;
+}
+
+
+const struct channelizer_receiver_conf channelizer_receiver_defaults = {
+	.samplerate = 1e6,
+	.centerfreq = 100000,
+	.spacing = 25000,
+	.channels = 8,
+	.threads = 4
+};
+
+
+/* The channel receiver configuration starts from its own defaults,
+ * so init_conf and set_conf are not generated by CONFIG_BEGIN */
+static void *init_conf(void)
+{
+	struct channelizer_receiver_conf *conf;
+	conf = malloc(sizeof(*conf));
+	if (conf != NULL) {
+		*conf = channelizer_receiver_defaults;
+		conf->rx = burst_dpsk_receiver_defaults;
+	}
+	return conf;
+}
+
+
+static int set_conf(void *conf, const char *parameter, const char *value)
+{
+	struct channelizer_receiver_conf *c = conf;
+	CONFIG_F(samplerate)
+	CONFIG_F(centerfreq)
+	CONFIG_F(spacing)
+	CONFIG_I(channels)
+	CONFIG_I(threads)
+	// Anything else configures the channel receivers
+	return burst_dpsk_receiver_code.set_conf(&c->rx, parameter, value);
+}
+
+
+const struct receiver_code channelizer_receiver_code = { "channelizer_receiver", init, destroy, init_conf, set_conf, set_callbacks, execute, NULL };
@@ -0,0 +1,42 @@
+#ifndef LIBSUO_CHANNELIZER_RECEIVER_H
+#define LIBSUO_CHANNELIZER_RECEIVER_H
+#include "suo.h"
+#include "burst_dpsk_receiver.h"
+
+/* Receiver for many channels on a uniform grid, such as TETRA.
+ *
+ * The input is split into channels by a polyphase filter bank,
+ * which costs one FFT per half the number of channels
+ * in the bank. Each received channel is fed to its own
+ * burst_dpsk_receiver at twice the channel spacing.
+ * The channel receivers are run in worker threads.
+ *
+ * Filter bank channels are centered at multiples of the spacing,
+ * so the input should be tuned such that the received channels
+ * are close to them. The channel receivers correct
+ * the remaining offset.
+ *
+ * Received frames have the index of the channel as id
+ * and the frequency of the channel as CFO. */
+
+struct channelizer_receiver_conf {
+	float samplerate;
+	// Frequency of the first channel
+	float centerfreq;
+	/* Channel spacing.
+	 * Sample rate must be an even multiple of it. */
+	float spacing;
+	// Number of consecutive channels to receive
+	unsigned channels;
+	// Number of worker threads. 0 runs the receivers in the caller.
+	unsigned threads;
+	/* Configuration for channel receivers.
+	 * Parameters not used by the channelizer are set here. */
+	struct burst_dpsk_receiver_conf rx;
+};
+
+extern const struct channelizer_receiver_conf channelizer_receiver_defaults;
+
+extern const struct receiver_code channelizer_receiver_code;
+
+#endif
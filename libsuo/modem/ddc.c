@@ -1,21 +1,55 @@
 #include "suo.h"
 #include "ddc.h"
+#include "oscillator.h"
 #include <liquid/liquid.h>
 #include <assert.h>
+#include <string.h>
 
 //#define MSRESAMP
 
+/* Number of samples mixed and resampled at a time */
+#define DDC_BLOCKSIZE 256
+/* Maximum number of half-band decimation stages */
+#define DDC_HB_MAX 12
+/* Semi-length of the half-band filters */
+#define DDC_HB_SEMILEN 5
+/* Number of phases in the polyphase interpolator */
+#define DUC_PHASES 256
+/* Semi-length of the interpolation filter in input samples */
+#define DUC_SEMILEN 8
+
 struct suo_ddc {
-	nco_crcf nco;
+	struct oscillator osc;
 	msresamp_crcf resamp;
 	resamp_crcf resamp1;
+	/* Cascade of half-band decimators before the arbitrary resampler.
+	 * hb_prev holds the first sample of a pair
+	 * that has not been decimated yet. */
+	unsigned hb_n;
+	resamp2_crcf hb[DDC_HB_MAX];
+	sample_t hb_prev[DDC_HB_MAX];
+	bool hb_have[DDC_HB_MAX];
+	/* Polyphase interpolator for up-conversion.
+	 * The filters in the bank are stored time-reversed,
+	 * so that they line up with the history buffer. */
+	float *duc_bank;
+	unsigned duc_taps;
+	/* Each sample is written twice to the history buffer
+	 * so that the latest duc_taps samples are always contiguous. */
+	sample_t *duc_hist;
+	unsigned duc_hist_i;
+	/* Time of the next output sample after the latest input sample
+	 * and the time between output samples, in input samples */
+	double duc_mu, duc_step;
+	/* Number of zero samples at the end of the history buffer,
+	 * up to duc_taps. When the whole history is zero,
+	 * the output is zero and nothing needs to be computed. */
+	unsigned duc_zeros;
 	unsigned flags;
 	float resamprate;
 	timestamp_t delay_ns;
 };
 
-static const float pi2f = 6.283185307179586f;
-
 /* Initialize a digital down or up converter for a given
  * input sample rate, output sample rate and center frequency.
  *
@@ -48,31 +82,130 @@ struct suo_ddc *suo_ddc_init(float fs_in, float fs_out, float cf, unsigned flags
 	 * resampler, maybe because we have better control over
 	 * the filter length and other parameters. */
 
-	float bw = (rate < 1) ? (0.333f * rate) : 0.333f;
-	int semilen = roundf(3.0f / bw);
-	self->resamp1 = resamp_crcf_create(rate, semilen, bw, 60.0f, 16);
-	self->delay_ns = 1.0e9f * semilen / fs_in;
+	/* The filter length grows with the decimation ratio and
+	 * for large ratios, most of the time would be spent pushing
+	 * samples through a long filter at the input rate.
+	 * Decimate by 2 using half-band filters until the remaining
+	 * ratio is between 1/4 and 1/2, so that the arbitrary
+	 * resampler stays short. The signal of interest is then
+	 * a small part of the band of each half-band stage,
+	 * so short filters give enough alias rejection. */
+	float fs_mid = fs_in, hb_delay = 0;
+	if (flags & DDC_UP) {
+		/* Prototype filter for the polyphase interpolator
+		 * with the same bandwidth as the arbitrary resampler. */
+		float bw = (rate < 1) ? (0.333f * rate) : 0.333f;
+		unsigned semilen = (rate < 1) ? (unsigned)ceilf(DUC_SEMILEN / rate) : DUC_SEMILEN;
+		unsigned taps = 2 * semilen, len = taps * DUC_PHASES;
+		float *h = malloc(len * sizeof(float));
+		self->duc_bank = malloc(len * sizeof(float));
+		self->duc_hist = calloc(2 * taps, sizeof(sample_t));
+		if (h == NULL || self->duc_bank == NULL || self->duc_hist == NULL) {
+			free(h);
+			goto fail;
+		}
+		liquid_firdes_kaiser(len, bw / DUC_PHASES, 60.0f, 0.0f, h);
+		// Normalize to unity gain for each phase
+		float sum = 0;
+		unsigned i, p;
+		for (i = 0; i < len; i++)
+			sum += h[i];
+		for (p = 0; p < DUC_PHASES; p++)
+			for (i = 0; i < taps; i++)
+				self->duc_bank[p * taps + i] =
+					h[(taps - 1 - i) * DUC_PHASES + p] * DUC_PHASES / sum;
+		free(h);
+		self->duc_taps = taps;
+		self->duc_step = 1.0 / (double)rate;
+		self->duc_zeros = taps;
+		self->delay_ns = 1.0e9f * semilen / fs_in;
+	} else {
+		while (rate <= 0.25f && self->hb_n < DDC_HB_MAX) {
+			self->hb[self->hb_n] = resamp2_crcf_create(DDC_HB_SEMILEN, 0.0f, 60.0f);
+			// Delay of the stage in input samples of the whole DDC
+			hb_delay += (float)(2 * DDC_HB_SEMILEN << self->hb_n);
+			self->hb_n++;
+			rate *= 2.0f;
+			fs_mid *= 0.5f;
+		}
+
+		float bw = (rate < 1) ? (0.333f * rate) : 0.333f;
+		int semilen = roundf(3.0f / bw);
+		self->resamp1 = resamp_crcf_create(rate, semilen, bw, 60.0f, 16);
+		self->delay_ns = 1.0e9f * (hb_delay / fs_in + semilen / fs_mid);
+	}
 #endif
 
-	self->nco = nco_crcf_create(LIQUID_NCO);
-	nco_crcf_set_frequency(self->nco,
-		pi2f * cf /
-		((flags & DDC_UP) ? fs_out : fs_in));
+	oscillator_init(&self->osc, (float)(2.0 * M_PI * (double)cf /
+		(double)((flags & DDC_UP) ? fs_out : fs_in)));
 
 	return self;
+
+#ifndef MSRESAMP
+fail:
+	suo_ddc_destroy(self);
+	return NULL;
+#endif
+}
+
+
+void suo_ddc_destroy(struct suo_ddc *self)
+{
+	if (self == NULL)
+		return;
+#ifdef MSRESAMP
+	msresamp_crcf_destroy(self->resamp);
+#else
+	unsigned i;
+	for (i = 0; i < self->hb_n; i++)
+		resamp2_crcf_destroy(self->hb[i]);
+	if (self->resamp1 != NULL)
+		resamp_crcf_destroy(self->resamp1);
+#endif
+	free(self->duc_bank);
+	free(self->duc_hist);
+	free(self);
 }
 
 
+#ifndef MSRESAMP
+/* Decimate a block by 2 in each half-band stage.
+ * Works in place. Return the number of samples left. */
+static size_t ddc_halfband(struct suo_ddc *self, sample_t *buf, size_t n)
+{
+	unsigned s;
+	for (s = 0; s < self->hb_n; s++) {
+		sample_t prev = self->hb_prev[s];
+		bool have = self->hb_have[s];
+		size_t i, outn = 0;
+		for (i = 0; i < n; i++) {
+			if (have) {
+				sample_t pair[2] = { prev, buf[i] };
+				resamp2_crcf_decim_execute(self->hb[s], pair, &buf[outn++]);
+			} else {
+				prev = buf[i];
+			}
+			have = !have;
+		}
+		self->hb_prev[s] = prev;
+		self->hb_have[s] = have;
+		n = outn;
+	}
+	return n;
+}
+#endif
+
+
 /* Calculate the required size of output buffer
  * for a given number of input samples */
 size_t suo_ddc_out_size(struct suo_ddc *ddc, size_t inlen)
 {
-	return (int)ceilf(ddc->resamprate * inlen);
+	/* Samples left over from the previous call in the
+	 * half-band stages may result in one extra output sample */
+	return (int)ceilf(ddc->resamprate * inlen) + (ddc->hb_n ? 1 : 0);
 }
 
 
-#define DDC_BLOCKSIZE 64
-
 /* Do digital down-conversion for given input samples.
  * Return the number of output samples.
  * Update the timestamp to correspond to start of the output buffer. */
@@ -80,41 +213,25 @@ size_t suo_ddc_execute(struct suo_ddc *self, const sample_t *in, size_t inlen, s
 {
 	size_t i, outlen = 0;
 	size_t max_outlen = suo_ddc_out_size(self, inlen); // for assertion
-#ifdef MSRESAMP
-	/* This code could probably be optimized a lot!
-	 * The functions provided by liquid-dsp don't really appear
-	 * that efficient, since the NCO works one sample at a time.
-	 * Now it's a bit faster since msresamp is given samples
-	 * in bigger blocks. */
 	for (i = 0; i < inlen;) {
 		sample_t mixed[DDC_BLOCKSIZE];
-		size_t j, len2 = DDC_BLOCKSIZE;
+		size_t len2 = DDC_BLOCKSIZE;
 		if (i + len2 > inlen)
 			len2 = inlen - i;
 
-		for (j = 0; j < len2; j++) {
-			nco_crcf_step(self->nco);
-			nco_crcf_mix_down(self->nco, *in++, &mixed[j]);
-		}
+		oscillator_mix_down(&self->osc, in + i, mixed, len2);
 
 		unsigned outn = 0;
+#ifdef MSRESAMP
 		msresamp_crcf_execute(self->resamp, mixed, len2, out + outlen, &outn);
-		outlen += outn;
-		assert(outlen <= max_outlen);
-		i += len2;
-	}
 #else
-	for (i = 0; i < inlen; i++) {
-		sample_t mixed;
-		nco_crcf_step(self->nco);
-		nco_crcf_mix_down(self->nco, *in++, &mixed);
-
-		unsigned outn = 0;
-		resamp_crcf_execute(self->resamp1, mixed, out + outlen, &outn);
+		size_t len3 = ddc_halfband(self, mixed, len2);
+		resamp_crcf_execute_block(self->resamp1, mixed, len3, out + outlen, &outn);
+#endif
 		outlen += outn;
 		assert(outlen <= max_outlen);
+		i += len2;
 	}
-#endif
 	assert(i == inlen);
 
 	/* The timestamp is not exactly accurate now, since it does not
@@ -134,6 +251,7 @@ size_t suo_duc_in_size(struct suo_ddc *ddc, size_t outlen, timestamp_t *timestam
 	 * take into account the timing phase of the resampler. */
 	*timestamp += ddc->delay_ns;
 
+#ifdef MSRESAMP
 	size_t s = (float)outlen / ddc->resamprate;
 	/* msresamp sometimes produces a bit too much, so let's try
 	 * giving one samples less input. */
@@ -141,9 +259,90 @@ size_t suo_duc_in_size(struct suo_ddc *ddc, size_t outlen, timestamp_t *timestam
 		return s - 1;
 	else
 		return 0;
+#else
+	/* The interpolator produces an output sample for each
+	 * time mu + k * step before the last input sample,
+	 * so this is the largest input that does not produce
+	 * more than outlen samples. */
+	return (size_t)floor(ddc->duc_mu + (double)outlen * ddc->duc_step);
+#endif
 }
 
 
+#ifndef MSRESAMP
+/* Check whether a block of samples is all zero */
+static bool all_zero(const sample_t *in, size_t n)
+{
+	size_t i;
+	unsigned nonzero = 0;
+	for (i = 0; i < n; i++)
+		nonzero |= (crealf(in[i]) != 0) | (cimagf(in[i]) != 0);
+	return !nonzero;
+}
+
+
+/* Interpolate a block of input samples.
+ * Write the number of output samples to *outn.
+ * Update *b and *e to contain the output samples
+ * depending on non-zero input, as in tx_return_t. */
+static void duc_interp(struct suo_ddc *self, const sample_t *in, size_t n, sample_t *out, unsigned *outn, unsigned *b, unsigned *e)
+{
+	const unsigned taps = self->duc_taps;
+	const double step = self->duc_step;
+	double mu = self->duc_mu;
+	unsigned o = *outn;
+
+	if (self->duc_zeros >= taps && all_zero(in, n)) {
+		/* History stays zero, so the output is all zero.
+		 * Only count the output samples. */
+		size_t c = mu < (double)n ? (size_t)ceil(((double)n - mu) / step) : 0;
+		memset(out + o, 0, c * sizeof(sample_t));
+		self->duc_mu = mu + (double)c * step - (double)n;
+		*outn = o + c;
+		return;
+	}
+
+	sample_t *hist = self->duc_hist;
+	unsigned hist_i = self->duc_hist_i, zeros = self->duc_zeros;
+	size_t i;
+	for (i = 0; i < n; i++) {
+		const sample_t x = in[i];
+		hist[hist_i] = hist[hist_i + taps] = x;
+		if (++hist_i >= taps)
+			hist_i = 0;
+		if (x != 0)
+			zeros = 0;
+		else if (zeros < taps)
+			zeros++;
+
+		// Latest taps input samples, oldest first
+		const sample_t *w = hist + hist_i;
+		for (; mu < 1.0; mu += step) {
+			if (zeros >= taps) {
+				out[o++] = 0;
+				continue;
+			}
+			const float *h = self->duc_bank + (unsigned)(mu * DUC_PHASES) * taps;
+			sample_t y = 0;
+			unsigned k;
+			for (k = 0; k < taps; k++)
+				y += w[k] * h[k];
+			if (*e == 0)
+				*b = o;
+			out[o++] = y;
+			*e = o;
+		}
+		mu -= 1.0;
+	}
+
+	self->duc_mu = mu;
+	self->duc_hist_i = hist_i;
+	self->duc_zeros = zeros;
+	*outn = o;
+}
+#endif
+
+
 /* Do digital up-conversion for given input samples.
  * Return the number of output samples.
  *
@@ -154,22 +353,13 @@ size_t suo_duc_in_size(struct suo_ddc *ddc, size_t outlen, timestamp_t *timestam
  * will just ask for a bit more samples the next time. */
 tx_return_t suo_duc_execute(struct suo_ddc *self, const sample_t *in, size_t inlen, sample_t *out)
 {
-	unsigned outn = 0;
+	unsigned i, outn = 0, b = 0, e = 0;
 #ifdef MSRESAMP
 	msresamp_crcf_execute(self->resamp, (sample_t*)in, inlen, out, &outn);
-#else
-	size_t j;
-	for (j = 0; j < inlen; j++) {
-		unsigned outn1;
-		resamp_crcf_execute(self->resamp1, *in++, &out[outn], &outn1);
-		outn += outn1;
-	}
-#endif
 
 	// Threshold power for burst begin and end
 	const float th = 1e-6f;
 
-	unsigned i, b = 0, e = 0;
 	for (i = 0; i < outn; i++) {
 		sample_t s = out[i];
 		float p = crealf(s)*crealf(s) + cimagf(s)*cimagf(s);
@@ -178,9 +368,23 @@ tx_return_t suo_duc_execute(struct suo_ddc *self, const sample_t *in, size_t inl
 				b = i;
 			e = i + 1;
 		}
-		nco_crcf_step(self->nco);
-		nco_crcf_mix_up(self->nco, s, &out[i]);
 	}
+#else
+	/* Burst boundaries are found from the input: the output is
+	 * exactly zero when the filter contains only zero input.
+	 * Blocks of zero input after the end of a burst are not
+	 * run through the filter at all. */
+	for (i = 0; i < inlen; i += DDC_BLOCKSIZE) {
+		size_t n = inlen - i < DDC_BLOCKSIZE ? inlen - i : DDC_BLOCKSIZE;
+		duc_interp(self, in + i, n, out, &outn, &b, &e);
+	}
+#endif
+
+	/* Only the burst needs to be mixed, but the oscillator
+	 * is advanced over the whole buffer to keep it continuous. */
+	oscillator_advance(&self->osc, b);
+	oscillator_mix_up(&self->osc, out + b, out + b, e - b);
+	oscillator_advance(&self->osc, outn - e);
 
 	return (tx_return_t){
 		.len = outn,
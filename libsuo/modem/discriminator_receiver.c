@@ -0,0 +1,281 @@
+#include "discriminator_receiver.h"
+#include "suo_macros.h"
+#include <string.h>
+#include <liquid/liquid.h>
+
+
+#define FRAMELEN_MAX 0x900
+// Number of samples filtered at a time
+#define CHUNK 256
+// Maximum length of the lowpass filter
+#define LPF_MAX 65
+
+static const float pi2f = 6.283185307179586f;
+
+struct discriminator_receiver {
+	/* Configuration */
+	struct discriminator_receiver_conf c;
+	uint64_t syncmask;
+	float step, dc_speed, sample_ns;
+	float center_rad;
+
+	/* Deframer state */
+	uint64_t latest_bits;
+	unsigned framepos;
+	bool receiving_frame;
+
+	/* Demodulator state */
+	float dc, est_power;
+	// Timing phase in symbols. A symbol is taken when it reaches 1.
+	float phase;
+	// Previous filtered sample
+	float prev;
+	// Previous I/Q sample for the discriminator
+	sample_t prev_iq;
+	// Input has been I/Q, so the DC offset tells the frequency offset
+	bool iq;
+
+	/* liquid-dsp objects */
+	firfilt_rrrf l_lpf;
+
+	/* Callbacks */
+	const struct rx_output_code *output;
+	void *output_arg;
+
+	/* Buffers */
+	struct frame frame;
+	/* Allocate space for flexible array member */
+	bit_t frame_buffer[FRAMELEN_MAX];
+};
+
+
+static softbit_t float_to_softbit(float v)
+{
+	long o = 128.0f + 128.0f * v;
+	if (o <= 0)
+		return 0;
+	if (o >= 0xFF)
+		return 0xFF;
+	return o;
+}
+
+
+static void *init(const void *conf_v)
+{
+	struct discriminator_receiver *self = calloc(1, sizeof(*self));
+	if (self == NULL)
+		return NULL;
+	const struct discriminator_receiver_conf c = self->c = *(const struct discriminator_receiver_conf *)conf_v;
+	if (c.framelen > FRAMELEN_MAX)
+		goto fail;
+
+	self->syncmask = (1ULL << c.synclen) - 1;
+	self->framepos = c.framelen;
+	self->step = c.symbolrate / c.samplerate;
+	// DC offset follows the signal with a time constant of 8 symbols
+	self->dc_speed = self->step / 8.0f;
+	self->sample_ns = 1.0e9f / c.samplerate;
+	self->center_rad = pi2f * c.centerfreq / c.samplerate;
+
+	/* Lowpass filter a bit wider than the main lobe
+	 * of the NRZ spectrum, about two symbols long */
+	float h[LPF_MAX];
+	unsigned h_len = 2 * (unsigned)ceilf(1.0f / self->step) + 1;
+	if (h_len > LPF_MAX)
+		h_len = LPF_MAX;
+	float fc = 0.75f * self->step;
+	if (fc > 0.45f)
+		fc = 0.45f;
+	liquid_firdes_kaiser(h_len, fc, 40.0f, 0.0f, h);
+	// Normalize to unity gain at DC
+	float sum = 0;
+	for (unsigned i = 0; i < h_len; i++)
+		sum += h[i];
+	for (unsigned i = 0; i < h_len; i++)
+		h[i] /= sum;
+	self->l_lpf = firfilt_rrrf_create(h, h_len);
+	return self;
+
+fail:
+	free(self);
+	return NULL;
+}
+
+
+static int destroy(void *arg)
+{
+	struct discriminator_receiver *self = arg;
+	firfilt_rrrf_destroy(self->l_lpf);
+	free(self);
+	return 0;
+}
+
+
+/* Process a symbol.
+ * s is the sampled signal normalized to an RMS value of 1. */
+static void deframer_execute(struct discriminator_receiver *self, float s, timestamp_t time)
+{
+	unsigned framepos = self->framepos;
+	const unsigned framelen = self->c.framelen;
+	bool receiving_frame = self->receiving_frame;
+	const unsigned bit = s >= 0;
+
+	if (framepos < framelen) {
+		self->frame.data[framepos] = float_to_softbit(0.7f * s);
+		framepos++;
+		if (framepos == framelen) {
+			self->frame.m.len = framelen;
+			self->output->frame(self->output_arg, &self->frame);
+			receiving_frame = 0;
+		}
+	} else {
+		receiving_frame = 0;
+	}
+
+	/* Look for syncword */
+	uint64_t latest_bits = (self->latest_bits << 1) | bit;
+	self->latest_bits = latest_bits;
+	/* Don't look for new syncword inside a frame */
+	if (!receiving_frame) {
+		unsigned syncerrs = __builtin_popcountll((latest_bits & self->syncmask) ^ self->c.syncword);
+		if (syncerrs <= self->c.syncerrs) {
+			/* Syncword found, start saving bits when next bit arrives */
+			framepos = 0;
+			receiving_frame = 1;
+
+			self->frame.m.flags = METADATA_TIME | METADATA_POWER | METADATA_BER;
+			self->frame.m.time = time;
+			self->frame.m.power = 10.0f * log10f(self->est_power);
+			self->frame.m.ber = (float)syncerrs / self->c.synclen;
+			if (self->iq) {
+				self->frame.m.flags |= METADATA_CFO;
+				self->frame.m.cfo = self->c.centerfreq + self->dc * self->c.samplerate / pi2f;
+			}
+		}
+	}
+
+	self->receiving_frame = receiving_frame;
+	self->framepos = framepos;
+}
+
+
+static int execute_real(void *arg, const float *samples, size_t nsamp, timestamp_t timestamp)
+{
+	struct discriminator_receiver *self = arg;
+	self->output->tick(self->output_arg, timestamp);
+
+	const float step = self->step;
+	const float sign = self->c.invert ? -1.0f : 1.0f;
+	float dc = self->dc, est_power = self->est_power;
+	float phase = self->phase, prev = self->prev;
+	float buf[CHUNK];
+
+	for (size_t done = 0; done < nsamp; ) {
+		const unsigned n = nsamp - done < CHUNK ? nsamp - done : CHUNK;
+		firfilt_rrrf_execute_block(self->l_lpf, (float *)samples + done, n, buf);
+
+		for (unsigned i = 0; i < n; i++) {
+			/* DC offset comes from frequency offset of the signal.
+			 * Keep it fixed during a frame. */
+			if (!self->receiving_frame)
+				dc += (buf[i] - dc) * self->dc_speed;
+			const float y = sign * (buf[i] - dc);
+			est_power += (y * y - est_power) * 0.01f;
+
+			/* Timing recovery
+			 * ---------------
+			 * Zero crossings should happen halfway between symbols.
+			 * Find the phase at a crossing by interpolating between
+			 * samples and pull it towards 0.5. */
+			phase += step;
+			if ((y < 0) != (prev < 0)) {
+				const float x = prev / (prev - y);
+				float e = phase - (1.0f - x) * step - 0.5f;
+				e -= floorf(e + 0.5f);
+				phase -= e * (self->receiving_frame ? 0.02f : 0.1f);
+			}
+
+			/* Slicer
+			 * ------
+			 * The symbol was phase/step samples ago,
+			 * so interpolate between the last two samples. */
+			if (phase >= 1.0f) {
+				phase -= 1.0f;
+				const float f = phase / step;
+				const float s = y - f * (y - prev);
+				self->dc = dc;
+				self->est_power = est_power;
+				deframer_execute(self, s / sqrtf(est_power),
+					timestamp + (timestamp_t)(self->sample_ns * (float)(done + i)));
+			}
+			prev = y;
+		}
+		done += n;
+	}
+
+	self->dc = dc;
+	self->est_power = est_power;
+	self->phase = phase;
+	self->prev = prev;
+	return 0;
+}
+
+
+/* I/Q input goes through a quadrature discriminator */
+static int execute(void *arg, const sample_t *samples, size_t nsamp, timestamp_t timestamp)
+{
+	struct discriminator_receiver *self = arg;
+	sample_t prev = self->prev_iq;
+	float buf[CHUNK];
+
+	self->iq = 1;
+	for (size_t done = 0; done < nsamp; ) {
+		const unsigned n = nsamp - done < CHUNK ? nsamp - done : CHUNK;
+		for (unsigned i = 0; i < n; i++) {
+			const sample_t s = samples[done + i];
+			buf[i] = cargf(s * conjf(prev)) - self->center_rad;
+			prev = s;
+		}
+		execute_real(self, buf, n,
+			timestamp + (timestamp_t)(self->sample_ns * (float)done));
+		done += n;
+	}
+	self->prev_iq = prev;
+	return 0;
+}
+
+
+static int set_callbacks(void *arg, const struct rx_output_code *output, void *output_arg)
+{
+	struct discriminator_receiver *self = arg;
+	self->output = output;
+	self->output_arg = output_arg;
+	return 0;
+}
+
+
+const struct discriminator_receiver_conf discriminator_receiver_defaults = {
+	.samplerate = 48000,
+	.symbolrate = 9600,
+	.centerfreq = 0,
+	.syncword = 0x36994625,
+	.synclen = 32,
+	.framelen = 800,
+	.syncerrs = 3,
+	.invert = 0
+};
+
+
+CONFIG_BEGIN(discriminator_receiver)
+CONFIG_F(samplerate)
+CONFIG_F(symbolrate)
+CONFIG_F(centerfreq)
+CONFIG_I(syncword)
+CONFIG_I(synclen)
+CONFIG_I(framelen)
+CONFIG_I(syncerrs)
+CONFIG_I(invert)
+CONFIG_END()
+
+
+const struct receiver_code discriminator_receiver_code = { "discriminator_receiver", init, destroy, init_conf, set_conf, set_callbacks, execute, execute_real };
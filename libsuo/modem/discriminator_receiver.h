@@ -0,0 +1,30 @@
+#ifndef LIBSUO_DISCRIMINATOR_RECEIVER_H
+#define LIBSUO_DISCRIMINATOR_RECEIVER_H
+#include "suo.h"
+
+/* Receiver for 2-FSK signals demodulated by an FM discriminator,
+ * such as the data port output of a conventional radio.
+ *
+ * Works on real-valued input directly: a lowpass FIR,
+ * DC offset removal, zero-crossing timing recovery and a slicer.
+ * I/Q input is first converted to real with a quadrature
+ * discriminator, which is only useful when the sample rate is
+ * a few times the symbol rate, as there is no channel filter. */
+
+struct discriminator_receiver_conf {
+	float samplerate, symbolrate;
+	// Center frequency of I/Q input. Not used with real input.
+	float centerfreq;
+	uint64_t syncword;
+	unsigned synclen, framelen;
+	// Number of bit errors allowed in the syncword
+	unsigned syncerrs;
+	// Invert the polarity of the signal
+	unsigned char invert:1;
+};
+
+extern const struct discriminator_receiver_conf discriminator_receiver_defaults;
+
+extern const struct receiver_code discriminator_receiver_code;
+
+#endif
@@ -1,4 +1,5 @@
 #include "fsk_demod.h"
+#include "modem/oscillator.h"
 #include <string.h>
 #include <assert.h>
 //#include <stdio.h>
@@ -17,9 +18,10 @@ struct fskdemod_state {
 	unsigned running, symphase, nbitsdone;
 	//float freqoffset;
 
+	struct oscillator osc;
+
 	/* liquid-dsp objects */
 	dotprod_cccf correlators[MAX_CORRELATORS];
-	nco_crcf l_nco;
 	windowcf l_win;
 
 	/* callbacks */
@@ -85,7 +87,7 @@ void *fskdemod_init(const void *conf) {
 	st2->corr_num = c->corr_num;
 	st2->corr_taps = c->corr_taps;
 
-	st2->l_nco = nco_crcf_create(LIQUID_NCO);
+	oscillator_init(&st2->osc, 0);
 	st2->l_win = windowcf_create(st2->corr_len);
 	unsigned i;
 	for(i=0; i<st2->corr_num; i++)
@@ -106,8 +108,7 @@ int fskdemod_reset(void *state, float freqoffset) {
 	st->running = 1;
 	st->symphase = 0;
 	//st->freqoffset = freqoffset;
-	nco_crcf_set_phase(st->l_nco, 0);
-	nco_crcf_set_frequency(st->l_nco, -freqoffset);
+	oscillator_init(&st->osc, -freqoffset);
 	st->out_reset(st->out_arg);
 	return 0;
 }
@@ -118,11 +119,11 @@ int fskdemod_execute(void *state, sample_t *signal, size_t nsamples) {
 	size_t samp_i;
 	if(!st->running) return -1;
 	unsigned corr_num = st->corr_num;
+	sample_t mixed[nsamples];
+	oscillator_mix_up(&st->osc, signal, mixed, nsamples);
 	for(samp_i=0; samp_i<nsamples; samp_i++) {
-		sample_t oscout=0, o;
-		nco_crcf_step(st->l_nco);
-		nco_crcf_cexpf(st->l_nco, &oscout);
-		windowcf_push(st->l_win, o = signal[samp_i] * oscout);
+		sample_t o;
+		windowcf_push(st->l_win, o = mixed[samp_i]);
 		//write(3+st->id, &o, sizeof(sample_t)); // debug
 		if(++st->symphase >= st->sps) {
 			st->symphase = 0;
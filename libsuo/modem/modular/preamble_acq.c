@@ -1,4 +1,5 @@
 #include "preamble_acq.h"
+#include "modem/oscillator.h"
 #include <string.h>
 #include <assert.h>
 //#include <stdio.h>
@@ -24,8 +25,9 @@ typedef struct {
 	float pd_prev_peakc, pd_prev_peak_bin, pd_prev_snr;
 	sample_t pd_prev_sb;
 
+	struct oscillator ddc_osc;
+
 	// liquid-dsp objects (prefixed with l_)
-	nco_crcf l_ddc_nco;
 	msresamp_crcf l_inresamp;
 	windowcf l_pd_win;
 	fftplan l_pd_fft;
@@ -65,8 +67,7 @@ void *preamble_acq_init(const struct preamble_acq_conf *conf) {
 	st->inresamp_ratio = st->dm_fs / conf->input_sample_rate;
 	st->l_inresamp     = msresamp_crcf_create(st->inresamp_ratio, 60);
 
-	st->l_ddc_nco = nco_crcf_create(LIQUID_NCO);
-	nco_crcf_set_frequency(st->l_ddc_nco, -pi2f*conf->center_freq/conf->input_sample_rate);
+	oscillator_init(&st->ddc_osc, -pi2f*conf->center_freq/conf->input_sample_rate);
 
 	st->pd_win_len     = st->dm_sps * conf->pd_window_symbols;
 	st->pd_fft_len     = next_power_of_2(2 * st->pd_win_len);
@@ -123,15 +124,10 @@ void preamble_acq_execute(void *state, sample_t *insamp, unsigned n_insamp) {
 	sample_t dmsamp[DMSAMP_MAX];
 	unsigned max_insamp = (DMSAMP_MAX-1) / st->inresamp_ratio;
 	while(n_insamp > 0) {
-		unsigned ndms = 0, i;
+		unsigned ndms = 0;
 		unsigned n_insamp2 = n_insamp < max_insamp ? n_insamp : max_insamp;
 		sample_t freqshifted[n_insamp2];
-		for(i=0; i<n_insamp2; i++) {
-			sample_t oscout=0;
-			nco_crcf_step(st->l_ddc_nco);
-			nco_crcf_cexpf(st->l_ddc_nco, &oscout);
-			freqshifted[i] = insamp[i] * oscout;
-		}
+		oscillator_mix_up(&st->ddc_osc, insamp, freqshifted, n_insamp2);
 		msresamp_crcf_execute(st->l_inresamp, freqshifted, n_insamp2, dmsamp, &ndms);
 		preamble_acq_1_execute(state, dmsamp, ndms);
 		insamp += n_insamp2;
@@ -0,0 +1,228 @@
+#include "oscillator.h"
+#include <math.h>
+
+enum mix { MIX_DOWN, MIX_UP, MIX_NONE };
+
+
+void oscillator_init(struct oscillator *osc, float freq)
+{
+	osc->phasor = 1;
+	osc->freq = freq;
+	osc->table_valid = 0;
+}
+
+
+void oscillator_set_frequency(struct oscillator *osc, float freq)
+{
+	if (freq != osc->freq) {
+		osc->freq = freq;
+		osc->table_valid = 0;
+	}
+}
+
+
+float oscillator_get_frequency(const struct oscillator *osc)
+{
+	return osc->freq;
+}
+
+
+void oscillator_set_phase(struct oscillator *osc, float phase)
+{
+	osc->phasor = CMPLXF(cosf(phase), sinf(phase));
+}
+
+
+/* Compute the table for the current frequency.
+ * Done in double precision so that the only error
+ * accumulating over time is that of the phasor. */
+static void update_table(struct oscillator *osc)
+{
+	if (osc->table_valid)
+		return;
+	unsigned i;
+	for (i = 0; i < OSCILLATOR_BLOCK; i++) {
+		const double ph = (double)osc->freq * (i + 1);
+		osc->rotation[i] = CMPLXF(cos(ph), sin(ph));
+	}
+	osc->table_valid = 1;
+}
+
+
+/* Set the phasor to a new value, renormalizing its magnitude
+ * to 1 using one Newton-Raphson step so that rounding errors
+ * do not accumulate */
+static void set_phasor(struct oscillator *osc, sample_t p)
+{
+	float mag2 = crealf(p) * crealf(p) + cimagf(p) * cimagf(p);
+	osc->phasor = p * (1.5f - 0.5f * mag2);
+}
+
+
+/* Reduce a phase to [-pi, pi].
+ * Phases within a block are computed in double precision
+ * so that rounding errors do not accumulate from block to block. */
+static inline float wrap_phase(double p)
+{
+	return p - 2.0 * M_PI * rint(p * (0.5 / M_PI));
+}
+
+
+/* exp(j * x) for each x in [-pi, pi] in a block,
+ * as separate cos and sin arrays.
+ * Half of the angle goes through Taylor series that are
+ * accurate to about 1e-7 up to pi/2.
+ * Squaring the result then gives the full angle. */
+static void expj_block(const float *x, float *c, float *s, size_t n)
+{
+	size_t i;
+	for (i = 0; i < n; i++) {
+		float y = 0.5f * x[i];
+		float y2 = y * y;
+		float sy = y * (1.0f + y2 * (-1.0f/6 + y2 * (1.0f/120 + y2 * (-1.0f/5040
+			+ y2 * (1.0f/362880 + y2 * (-1.0f/39916800))))));
+		float cy = 1.0f + y2 * (-1.0f/2 + y2 * (1.0f/24 + y2 * (-1.0f/720
+			+ y2 * (1.0f/40320 + y2 * (-1.0f/3628800 + y2 * (1.0f/479001600))))));
+		c[i] = cy * cy - sy * sy;
+		s[i] = 2.0f * cy * sy;
+	}
+}
+
+
+/* Mix a block of at most OSCILLATOR_BLOCK samples
+ * at a fixed frequency */
+static void fixed_block(struct oscillator *osc, const sample_t *in, sample_t *out, size_t n, enum mix mix)
+{
+	const sample_t *rotation = osc->rotation;
+	const sample_t p = osc->phasor;
+	size_t i;
+	switch (mix) {
+	case MIX_DOWN:
+		for (i = 0; i < n; i++)
+			out[i] = in[i] * conjf(p * rotation[i]);
+		break;
+	case MIX_UP:
+		for (i = 0; i < n; i++)
+			out[i] = in[i] * (p * rotation[i]);
+		break;
+	default:
+		if (out != NULL) {
+			for (i = 0; i < n; i++)
+				out[i] = p * rotation[i];
+		}
+		break;
+	}
+	set_phasor(osc, p * rotation[n - 1]);
+}
+
+
+static void fixed(struct oscillator *osc, const sample_t *in, sample_t *out, size_t n, enum mix mix)
+{
+	update_table(osc);
+	size_t i;
+	for (i = 0; i < n; i += OSCILLATOR_BLOCK) {
+		size_t n1 = n - i < OSCILLATOR_BLOCK ? n - i : OSCILLATOR_BLOCK;
+		fixed_block(osc,
+			in != NULL ? in + i : NULL,
+			out != NULL ? out + i : NULL,
+			n1, mix);
+	}
+}
+
+
+void oscillator_mix_down(struct oscillator *osc, const sample_t *in, sample_t *out, size_t n)
+{
+	fixed(osc, in, out, n, MIX_DOWN);
+}
+
+
+void oscillator_mix_up(struct oscillator *osc, const sample_t *in, sample_t *out, size_t n)
+{
+	fixed(osc, in, out, n, MIX_UP);
+}
+
+
+void oscillator_generate(struct oscillator *osc, sample_t *out, size_t n)
+{
+	fixed(osc, NULL, out, n, MIX_NONE);
+}
+
+
+void oscillator_advance(struct oscillator *osc, size_t n)
+{
+	fixed(osc, NULL, NULL, n, MIX_NONE);
+}
+
+
+/* Apply the phase of each sample, relative to the phasor,
+ * to a block of at most OSCILLATOR_BLOCK samples */
+static void phase_block(struct oscillator *osc, const float *ph, const sample_t *in, sample_t *out, size_t n, enum mix mix)
+{
+	float c[OSCILLATOR_BLOCK], s[OSCILLATOR_BLOCK];
+	const float pr = crealf(osc->phasor), pi = cimagf(osc->phasor);
+	size_t i;
+	expj_block(ph, c, s, n);
+	for (i = 0; i < n; i++) {
+		const float c1 = pr * c[i] - pi * s[i];
+		const float s1 = pr * s[i] + pi * c[i];
+		c[i] = c1;
+		s[i] = s1;
+	}
+	switch (mix) {
+	case MIX_DOWN:
+		for (i = 0; i < n; i++)
+			out[i] = in[i] * CMPLXF(c[i], -s[i]);
+		break;
+	case MIX_UP:
+		for (i = 0; i < n; i++)
+			out[i] = in[i] * CMPLXF(c[i], s[i]);
+		break;
+	default:
+		for (i = 0; i < n; i++)
+			out[i] = CMPLXF(c[i], s[i]);
+		break;
+	}
+	set_phasor(osc, CMPLXF(c[n - 1], s[n - 1]));
+}
+
+
+void oscillator_mix_down_ramp(struct oscillator *osc, const sample_t *in, sample_t *out, size_t n, float dfreq)
+{
+	if (dfreq == 0) {
+		oscillator_mix_down(osc, in, out, n);
+		return;
+	}
+	float ph[OSCILLATOR_BLOCK];
+	size_t i, j;
+	for (i = 0; i < n; i += OSCILLATOR_BLOCK) {
+		size_t n1 = n - i < OSCILLATOR_BLOCK ? n - i : OSCILLATOR_BLOCK;
+		/* Frequency at sample k (counting from 1) is f + k * dfreq,
+		 * so phase is the sum of those */
+		const float f = osc->freq;
+		for (j = 0; j < n1; j++) {
+			const double k = j + 1;
+			ph[j] = wrap_phase(k * (double)f + 0.5 * k * (k + 1.0) * (double)dfreq);
+		}
+		phase_block(osc, ph, in + i, out + i, n1, MIX_DOWN);
+		osc->freq = f + (float)n1 * dfreq;
+	}
+	osc->table_valid = 0;
+}
+
+
+void oscillator_generate_freqs(struct oscillator *osc, const float *freqs, sample_t *out, size_t n)
+{
+	float ph[OSCILLATOR_BLOCK];
+	size_t i, j;
+	for (i = 0; i < n; i += OSCILLATOR_BLOCK) {
+		size_t n1 = n - i < OSCILLATOR_BLOCK ? n - i : OSCILLATOR_BLOCK;
+		double acc = 0;
+		for (j = 0; j < n1; j++) {
+			acc += (double)freqs[i + j];
+			ph[j] = wrap_phase(acc);
+		}
+		phase_block(osc, ph, NULL, out + i, n1, MIX_NONE);
+	}
+	if (n > 0)
+		oscillator_set_frequency(osc, freqs[n - 1]);
+}
@@ -0,0 +1,57 @@
+#ifndef LIBSUO_OSCILLATOR_H
+#define LIBSUO_OSCILLATOR_H
+#include "suo.h"
+
+/* Numerically controlled oscillator and mixer
+ * working on blocks of samples.
+ *
+ * Frequencies are in radians per sample. The phase is advanced
+ * before each sample, like with nco_crcf_step in liquid-dsp,
+ * so the first sample after initialization has a phase
+ * equal to the frequency.
+ *
+ * The oscillator is a unit phasor updated once per block.
+ * At a fixed frequency, samples within a block are generated
+ * by multiplying it with a table of rotations. When the frequency
+ * changes within a block, the phase of each sample is computed
+ * first and converted to a phasor by a polynomial approximation.
+ * Either way, there is no dependency between consecutive
+ * samples in a block, so the loops vectorize. */
+
+// Maximum number of samples computed from one phasor
+#define OSCILLATOR_BLOCK 64
+
+struct oscillator {
+	// Phase after the latest sample
+	sample_t phasor;
+	float freq;
+	// rotation[i] = exp(j * freq * (i+1)), valid if table_valid
+	bool table_valid;
+	sample_t rotation[OSCILLATOR_BLOCK];
+};
+
+void oscillator_init(struct oscillator *osc, float freq);
+void oscillator_set_frequency(struct oscillator *osc, float freq);
+float oscillator_get_frequency(const struct oscillator *osc);
+void oscillator_set_phase(struct oscillator *osc, float phase);
+
+/* Fixed frequency.
+ * Mixing down multiplies the signal by the complex conjugate
+ * of the oscillator, mixing up by the oscillator itself.
+ * in and out may be the same buffer. */
+void oscillator_mix_down(struct oscillator *osc, const sample_t *in, sample_t *out, size_t n);
+void oscillator_mix_up(struct oscillator *osc, const sample_t *in, sample_t *out, size_t n);
+void oscillator_generate(struct oscillator *osc, sample_t *out, size_t n);
+// Advance the phase by n samples without producing output
+void oscillator_advance(struct oscillator *osc, size_t n);
+
+/* Frequency ramp, e.g. for AFC.
+ * Frequency is changed by dfreq before each sample,
+ * like nco_crcf_adjust_frequency followed by nco_crcf_step. */
+void oscillator_mix_down_ramp(struct oscillator *osc, const sample_t *in, sample_t *out, size_t n, float dfreq);
+
+/* Frequency of each sample given in a list, e.g. for FSK modulation.
+ * The oscillator is left at the last frequency in the list. */
+void oscillator_generate_freqs(struct oscillator *osc, const float *freqs, sample_t *out, size_t n);
+
+#endif
@@ -1,5 +1,6 @@
 #include "simple_receiver.h"
 #include "suo_macros.h"
+#include "oscillator.h"
 #include <string.h>
 #include <assert.h>
 #include <stdio.h> // for debug prints only
@@ -37,8 +38,9 @@ struct simple_receiver {
 	/* General metadata */
 	float est_power;
 
+	struct oscillator osc;
+
 	/* liquid-dsp objects */
-	nco_crcf l_nco;
 	resamp_crcf l_resamp;
 	firfilt_cccf l_fir0, l_fir1;
 	firfilt_rrrf l_eqfir;
@@ -104,13 +106,12 @@ static void *simple_receiver_init(const void *conf_v)
 	self->freq_min = self->nco_1Hz * (c.centerfreq - 0.5f*c.symbolrate);
 	self->freq_max = self->nco_1Hz * (c.centerfreq + 0.5f*c.symbolrate);
 	self->freq_center = self->nco_1Hz * c.centerfreq;
-	self->l_nco = nco_crcf_create(LIQUID_NCO);
 	/* afc_speed is maximum adjustment of frequency per input sample.
 	 * Convert Hz/sec into it. */
 	float afc_hzsec = 0.01f * c.symbolrate * c.symbolrate;
 	self->afc_speed = self->nco_1Hz * afc_hzsec / c.samplerate;
 
-	nco_crcf_set_frequency(self->l_nco, self->freq_center);
+	oscillator_init(&self->osc, self->freq_center);
 
 	/* Matched filters for 0 and 1 */
 	self->l_fir0 = firfilt_cccf_create((float complex*)fixed_mf0, FIXED_MF_LEN);
@@ -124,8 +125,14 @@ static void *simple_receiver_init(const void *conf_v)
 
 static int simple_receiver_destroy(void *arg)
 {
-	/* TODO (low priority since memory gets freed in the end anyway) */
-	(void)arg;
+	struct simple_receiver *self = arg;
+	if (self == NULL)
+		return 0;
+	resamp_crcf_destroy(self->l_resamp);
+	firfilt_cccf_destroy(self->l_fir0);
+	firfilt_cccf_destroy(self->l_fir1);
+	firfilt_rrrf_destroy(self->l_eqfir);
+	free(self);
 	return 0;
 }
 
@@ -163,7 +170,7 @@ static void simple_deframer_execute(struct simple_receiver *self, unsigned bit,
 			receiving_frame = 1;
 
 			/* Fill in some metadata at start of the frame */
-			self->frame.m.cfo = (nco_crcf_get_frequency(self->l_nco)
+			self->frame.m.cfo = (oscillator_get_frequency(&self->osc)
 				- self->freq_center ) / self->nco_1Hz;
 			self->frame.m.power = 10.0f * log10f(self->est_power);
 			self->frame.m.ber = (float)syncerrs; // not real BER :D
@@ -188,19 +195,25 @@ static int simple_receiver_execute(void *arg, const sample_t *samples, size_t ns
 
 	/* Allocate small buffers from stack */
 	sample_t samples2[self->resampint];
+	sample_t mixed[OSCILLATOR_BLOCK];
 
 	timestamp_t sample_ns = roundf(1.0e9f / self->c.samplerate);
 
 	size_t si;
 	for(si = 0; si < nsamp; si++) {
 		unsigned nsamp2 = 0, si2;
-		sample_t s = samples[si];
 
-		/* Downconvert and resample one input sample at a time */
-		nco_crcf_adjust_frequency(self->l_nco, self->freq_adj);
-		nco_crcf_step(self->l_nco);
-		nco_crcf_mix_down(self->l_nco, s, &s);
-		resamp_crcf_execute(self->l_resamp, s, samples2, &nsamp2);
+		/* Downconvert a block at a time. AFC changes the frequency
+		 * by freq_adj every sample, so it takes effect from the
+		 * next block. */
+		const unsigned mi = si % OSCILLATOR_BLOCK;
+		if(mi == 0) {
+			size_t n = nsamp - si < OSCILLATOR_BLOCK ? nsamp - si : OSCILLATOR_BLOCK;
+			oscillator_mix_down_ramp(&self->osc, samples + si, mixed, n, self->freq_adj);
+		}
+
+		/* Resample one input sample at a time */
+		resamp_crcf_execute(self->l_resamp, mixed[mi], samples2, &nsamp2);
 		assert(nsamp2 <= self->resampint);
 
 		/* Process output from the resampler one sample at a time */
@@ -238,7 +251,7 @@ static int simple_receiver_execute(void *arg, const sample_t *samples, size_t ns
 			if(!self->receiving_frame) {
 				float adjustment = demod * self->afc_speed;
 
-				float freq_now = nco_crcf_get_frequency(self->l_nco);
+				float freq_now = oscillator_get_frequency(&self->osc);
 				if(freq_now < self->freq_min && adjustment < 0)
 					adjustment = 0;
 				if(freq_now > self->freq_max && adjustment >= 0)
@@ -287,7 +300,7 @@ static int simple_receiver_execute(void *arg, const sample_t *samples, size_t ns
 			/* Debugging outputs */
 			int write(int, const void*, size_t);
 			write(3, &demod, sizeof(float));
-			float asdf = nco_crcf_get_frequency(self->l_nco);
+			float asdf = oscillator_get_frequency(&self->osc);
 			write(3, &asdf, sizeof(float));
 			write(3, &comb, sizeof(float));
 			write(3, &synchronized, sizeof(float));
@@ -346,4 +359,4 @@ CONFIG_I(framelen)
 CONFIG_END()
 
 
-const struct receiver_code simple_receiver_code = { "simple_receiver", simple_receiver_init, simple_receiver_destroy, init_conf, set_conf, simple_receiver_set_callbacks, simple_receiver_execute };
+const struct receiver_code simple_receiver_code = { "simple_receiver", simple_receiver_init, simple_receiver_destroy, init_conf, set_conf, simple_receiver_set_callbacks, simple_receiver_execute, NULL };
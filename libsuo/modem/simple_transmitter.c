@@ -1,9 +1,9 @@
 #include "simple_transmitter.h"
 #include "suo_macros.h"
+#include "oscillator.h"
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
-#include <liquid/liquid.h>
 
 #define FRAMELEN_MAX 0x900
 static const float pi2f = 6.283185307179586f;
@@ -20,8 +20,7 @@ struct simple_transmitter {
 	unsigned framelen, framepos;
 	uint32_t symphase;
 
-	/* liquid-dsp objects */
-	nco_crcf l_nco;
+	struct oscillator osc;
 
 	/* Callbacks */
 	struct tx_input_code input;
@@ -50,7 +49,7 @@ static void *init(const void *conf_v)
 	self->freq0 = cf - deviation;
 	self->freq1 = cf + deviation;
 
-	self->l_nco = nco_crcf_create(LIQUID_NCO);
+	oscillator_init(&self->osc, self->freq0);
 
 	return self;
 }
@@ -103,25 +102,27 @@ static tx_return_t execute(void *arg, sample_t *samples, size_t maxsamples, time
 		transmitting = 2;
 
 	if (transmitting == 2) {
-		size_t si;
-		for(si = 0; si < maxsamples; si++) {
-			float f_in = freq0;
-			if(framepos < framelen) {
-				if(framebuf[framepos]) f_in = freq1;
-			} else {
-				transmitting = 0;
-				break;
-			}
-
-			nco_crcf_set_frequency(self->l_nco, f_in);
-			nco_crcf_step(self->l_nco);
-			nco_crcf_cexpf(self->l_nco, &samples[si]);
-
-			uint32_t symphase1 = symphase;
-			symphase = symphase1 + symrate;
-			if(symphase < symphase1) { // wrapped around?
-				framepos++;
+		size_t si = 0;
+		while (transmitting && si < maxsamples) {
+			/* Make a list of frequencies for a block of samples
+			 * and generate the signal from it */
+			float freqs[OSCILLATOR_BLOCK];
+			size_t n;
+			for(n = 0; n < OSCILLATOR_BLOCK && si + n < maxsamples; n++) {
+				if(framepos >= framelen) {
+					transmitting = 0;
+					break;
+				}
+				freqs[n] = framebuf[framepos] ? freq1 : freq0;
+
+				uint32_t symphase1 = symphase;
+				symphase = symphase1 + symrate;
+				if(symphase < symphase1) { // wrapped around?
+					framepos++;
+				}
 			}
+			oscillator_generate_freqs(&self->osc, freqs, samples + si, n);
+			si += n;
 		}
 		nsamples = si;
 	}
@@ -15,6 +15,10 @@
 #include <alsa/control.h>
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
 
 typedef int16_t cs16_t[2];
 
@@ -25,6 +29,32 @@ struct alsa_io {
 	void *transmitter_arg;
 
 	snd_pcm_t *rx_pcm, *tx_pcm;
+	// Size of the playback buffer (samples)
+	snd_pcm_uframes_t tx_bufsize;
+
+	// RX and TX samples since starting the stream
+	uint64_t rx_samps, tx_samps;
+	/* Total samples before the stream was started.
+	 * This is to keep timestamp progressing if stream is restarted. */
+	uint64_t base_samps;
+	/* Stream position and monotonic time when the stream was last
+	 * known to be running. Used to count samples lost in an xrun. */
+	uint64_t sync_samps;
+	struct timespec sync_time;
+	// Time the last error was detected, if not recovered yet
+	struct timespec fail_time;
+	bool failed;
+
+	// Xrun statistics
+	uint64_t rx_xruns, tx_xruns, restarts, lost_samps;
+	double recovery_max;
+
+	// Size of a sample frame in the sound card format (bytes)
+	size_t frame_size;
+	// Buffers for RX and TX signal
+	size_t buf_max;
+	cs16_t *buf_int;
+	sample_t *buf_flt;
 
 	struct alsa_io_conf conf;
 };
@@ -35,7 +65,7 @@ struct alsa_io {
 	fprintf(stderr, "\nALSA error in %s: %s\n", #a, snd_strerror(retcheck)); \
 	goto err; } } while(0)
 
-snd_pcm_t *open_alsa(const struct alsa_io_conf *conf, snd_pcm_stream_t dir)
+snd_pcm_t *open_alsa(const struct alsa_io_conf *conf, snd_pcm_stream_t dir, snd_pcm_uframes_t *bufsize_out)
 {
 	snd_pcm_t *pcm = NULL;
 	snd_pcm_hw_params_t *hwp;
@@ -44,20 +74,52 @@ snd_pcm_t *open_alsa(const struct alsa_io_conf *conf, snd_pcm_stream_t dir)
 		dir, 0));
 	ALSACHECK(snd_pcm_hw_params_malloc(&hwp));
 	ALSACHECK(snd_pcm_hw_params_any(pcm, hwp));
-	ALSACHECK(snd_pcm_hw_params_set_access(pcm, hwp, SND_PCM_ACCESS_RW_INTERLEAVED));
+	ALSACHECK(snd_pcm_hw_params_set_access(pcm, hwp,
+		conf->mmap ? SND_PCM_ACCESS_MMAP_INTERLEAVED : SND_PCM_ACCESS_RW_INTERLEAVED));
 	ALSACHECK(snd_pcm_hw_params_set_format(pcm, hwp, SND_PCM_FORMAT_S16_LE));
 	unsigned fs = conf->samplerate;
 	ALSACHECK(snd_pcm_hw_params_set_rate(pcm, hwp, fs, 0));
-	ALSACHECK(snd_pcm_hw_params_set_channels(pcm, hwp, 2));
+	ALSACHECK(snd_pcm_hw_params_set_channels(pcm, hwp, conf->mono ? 1 : 2));
 	unsigned frags = conf->buffer;
-	ALSACHECK(snd_pcm_hw_params_set_periods_near(pcm, hwp, &frags, 0));
-	// Make the total buffer size a couple of times tx_latency
-	snd_pcm_uframes_t bufsize = conf->tx_latency * 2;
+	snd_pcm_uframes_t bufsize;
+	if (conf->mmap) {
+		// One period for each block, buffer just big enough for TX
+		snd_pcm_uframes_t period = conf->buffer;
+		ALSACHECK(snd_pcm_hw_params_set_period_size_near(pcm, hwp, &period, 0));
+		frags = period;
+		bufsize = conf->tx_latency + conf->buffer;
+	} else {
+		ALSACHECK(snd_pcm_hw_params_set_periods_near(pcm, hwp, &frags, 0));
+		// Make the total buffer size a couple of times tx_latency
+		bufsize = conf->tx_latency * 2;
+	}
 	ALSACHECK(snd_pcm_hw_params_set_buffer_size_near(pcm, hwp, &bufsize));
 
 	ALSACHECK(snd_pcm_hw_params(pcm, hwp));
+	snd_pcm_hw_params_free(hwp);
+
+	/* In mmap mode, the TX buffer is filled up to tx_latency
+	 * before the stream is started, so it has to fit */
+	if (conf->mmap && dir == SND_PCM_STREAM_PLAYBACK && bufsize < conf->tx_latency) {
+		fprintf(stderr, "ALSA: buffer of %u frames does not fit tx_latency of %u frames\n",
+			(unsigned)bufsize, (unsigned)conf->tx_latency);
+		goto err;
+	}
+
+	if (conf->mmap) {
+		/* Wake up poll for each block. Streams are started
+		 * explicitly once the TX buffer has been filled. */
+		snd_pcm_sw_params_t *swp;
+		ALSACHECK(snd_pcm_sw_params_malloc(&swp));
+		ALSACHECK(snd_pcm_sw_params_current(pcm, swp));
+		ALSACHECK(snd_pcm_sw_params_set_avail_min(pcm, swp, conf->buffer));
+		ALSACHECK(snd_pcm_sw_params_set_start_threshold(pcm, swp, bufsize * 2));
+		ALSACHECK(snd_pcm_sw_params(pcm, swp));
+		snd_pcm_sw_params_free(swp);
+	}
 
-	fprintf(stderr, "fs=%d, frags=%u, bufsize=%u\n", fs, frags, (unsigned)bufsize);
+	fprintf(stderr, "fs=%d, %s=%u, bufsize=%u\n", fs, conf->mmap ? "period" : "frags", frags, (unsigned)bufsize);
+	*bufsize_out = bufsize;
 	return pcm;
 err:
 	return NULL;
@@ -80,14 +142,15 @@ static void *init(const void *confv)
 	self->conf = *(const struct alsa_io_conf *)confv;
 
 	if (self->conf.rx_on) {
+		snd_pcm_uframes_t bufsize;
 		fprintf(stderr, "ALSA: Opening capture\n");
-		self->rx_pcm = open_alsa(&self->conf, SND_PCM_STREAM_CAPTURE);
+		self->rx_pcm = open_alsa(&self->conf, SND_PCM_STREAM_CAPTURE, &bufsize);
 		if(self->rx_pcm == NULL)
 			goto err;
 	}
 	if (self->conf.tx_on) {
 		fprintf(stderr, "ALSA: Opening playback\n");
-		self->tx_pcm = open_alsa(&self->conf, SND_PCM_STREAM_PLAYBACK);
+		self->tx_pcm = open_alsa(&self->conf, SND_PCM_STREAM_PLAYBACK, &self->tx_bufsize);
 		if(self->tx_pcm == NULL)
 			goto err;
 	}
@@ -102,103 +165,403 @@ err:
 }
 
 
+static double elapsed(const struct timespec *from, const struct timespec *to)
+{
+	return (double)(to->tv_sec - from->tv_sec) + 1e-9 * (double)(to->tv_nsec - from->tv_nsec);
+}
+
+
+// Record that the stream was at a given position at this moment
+static void mark_sync(struct alsa_io *self, uint64_t samps)
+{
+	self->sync_samps = samps;
+	clock_gettime(CLOCK_MONOTONIC, &self->sync_time);
+}
+
+
+/* Stop and prepare the streams. The linked capture stream is
+ * prepared together with playback. */
+static int prepare_streams(struct alsa_io *self)
+{
+	snd_pcm_t *rx_pcm = self->rx_pcm, *tx_pcm = self->tx_pcm;
+	//fprintf(stderr, "ALSA: (Re)starting streams\n");
+	// http://www.saunalahti.fi/~s7l/blog/2005/08/21/Full%20Duplex%20ALSA
+	if (rx_pcm != NULL)
+		ALSACHECK(snd_pcm_drop(rx_pcm));
+	if (tx_pcm != NULL) {
+		ALSACHECK(snd_pcm_drop(tx_pcm));
+		ALSACHECK(snd_pcm_prepare(tx_pcm));
+	} else {
+		ALSACHECK(snd_pcm_prepare(rx_pcm));
+	}
+	return 0;
+err:
+	return -1;
+}
+
+
+/* Handle an error from reading or writing a stream.
+ *
+ * After an xrun, snd_pcm_recover only prepares the failed stream,
+ * which is much faster than dropping and restarting everything.
+ * A linked stream stops and gets prepared together with it, and both
+ * are started again together, so they stay aligned. If the other
+ * stream is not ready after that, fall back to a full restart.
+ *
+ * Return -1 if the streams could not be prepared. */
+static int recover(struct alsa_io *self, snd_pcm_t *pcm, int err)
+{
+	const bool rx = pcm == self->rx_pcm;
+	snd_pcm_t *other = rx ? self->tx_pcm : self->rx_pcm;
+
+	clock_gettime(CLOCK_MONOTONIC, &self->fail_time);
+	self->failed = 1;
+	fprintf(stderr, "ALSA %s: %s\n", rx ? "read" : "write", snd_strerror(err));
+	if (err == -EPIPE) {
+		if (rx)
+			self->rx_xruns++;
+		else
+			self->tx_xruns++;
+	}
+	if (snd_pcm_recover(pcm, err, 1) < 0
+	|| (other != NULL && snd_pcm_state(other) != SND_PCM_STATE_PREPARED)) {
+		self->restarts++;
+		return prepare_streams(self);
+	}
+	return 0;
+}
+
+
+// Address of a sample in an interleaved mmap area
+static void *mmap_samples(const snd_pcm_channel_area_t *areas, snd_pcm_uframes_t offset)
+{
+	return (char *)areas[0].addr + areas[0].first / 8 + offset * areas[0].step / 8;
+}
+
+
+/* Convert a block of received signal and pass it to the receiver.
+ * Mono signal goes to execute_real of the receiver if it has one. */
+static void rx_execute(struct alsa_io *self, const void *in, size_t n)
+{
+	const timestamp_t time = samples_to_ns(self->base_samps + self->rx_samps, self->conf.samplerate);
+	float *real = (float *)self->buf_flt;
+	if (!self->conf.mono) {
+		cs16_to_cf(in, self->buf_flt, n);
+		self->receiver->execute(self->receiver_arg, self->buf_flt, n, time);
+		return;
+	}
+	s16_to_f_scale(in, real, n, 1.0f / 0x8000);
+	if (self->receiver->execute_real != NULL) {
+		self->receiver->execute_real(self->receiver_arg, real, n, time);
+	} else {
+		f_to_cf(real, self->buf_flt, n);
+		self->receiver->execute(self->receiver_arg, self->buf_flt, n, time);
+	}
+}
+
+
+// Convert transmitted signal to the sound card format
+static void tx_convert(struct alsa_io *self, void *out, size_t n)
+{
+	if (!self->conf.mono) {
+		cf_to_cs16(self->buf_flt, out, n);
+		return;
+	}
+	// Mono output is the real part
+	int16_t *o = out;
+	for (size_t i = 0; i < n; i++) {
+		float v = crealf(self->buf_flt[i]) * 0x8000;
+		if (v > 0x7FFF)
+			v = 0x7FFF;
+		if (v < -0x8000)
+			v = -0x8000;
+		o[i] = (int16_t)v;
+	}
+}
+
+
+/* Generate n samples of TX signal, or silence, and write them.
+ * Return 0 or an ALSA error code. */
+static int write_tx(struct alsa_io *self, uint64_t n, bool silence)
+{
+	while (n > 0) {
+		size_t len = n < self->buf_max ? n : self->buf_max, ntx = 0;
+		void *out = self->buf_int;
+		const snd_pcm_channel_area_t *areas;
+		snd_pcm_uframes_t offset = 0;
+		snd_pcm_sframes_t ret;
+
+		if (self->conf.mmap) {
+			snd_pcm_uframes_t frames = len;
+			if ((ret = snd_pcm_mmap_begin(self->tx_pcm, &areas, &offset, &frames)) < 0)
+				return ret;
+			// No space in the buffer would never make progress
+			if (frames == 0)
+				return -ENOBUFS;
+			len = frames;
+			out = mmap_samples(areas, offset);
+		}
+		if (!silence) {
+			tx_return_t r = self->transmitter->execute(self->transmitter_arg,
+				self->buf_flt, len,
+				samples_to_ns(self->base_samps + self->tx_samps, self->conf.samplerate));
+			ntx = (size_t)r.len < len ? (size_t)r.len : len;
+			tx_convert(self, out, ntx);
+		}
+		// Fill the rest with silence to keep timestamps in sync
+		memset((char *)out + self->frame_size * ntx, 0, self->frame_size * (len - ntx));
+
+		if (self->conf.mmap)
+			ret = snd_pcm_mmap_commit(self->tx_pcm, offset, len);
+		else
+			ret = snd_pcm_writei(self->tx_pcm, out, len);
+		if (ret < 0)
+			return ret;
+		if ((size_t)ret != len)
+			fprintf(stderr, "ALSA: short write (%ld/%zu)\n", ret, len);
+		self->tx_samps += ret;
+		n -= ret;
+	}
+	return 0;
+}
+
+
+/* Start the prepared streams.
+ *
+ * After a failure, the timeline is advanced by the time the streams
+ * were not running, so timestamps keep following the sample clock.
+ * TX signal generated before the failure for the time after restart
+ * is not asked for again; silence is played for that part instead. */
+static int start_run(struct alsa_io *self)
+{
+	const uint32_t fs = self->conf.samplerate;
+	snd_pcm_t *rx_pcm = self->rx_pcm, *tx_pcm = self->tx_pcm;
+	// Position of the stream when it stopped, as far as it was processed
+	const uint64_t done = rx_pcm != NULL ? self->rx_samps : self->sync_samps;
+	uint64_t pos = done;
+	struct timespec now;
+	int ret;
+
+	if (self->failed) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		const uint64_t est = self->sync_samps + (uint64_t)(elapsed(&self->sync_time, &now) * fs);
+		if (est > pos)
+			pos = est;
+		self->lost_samps += pos - done;
+	}
+	const uint64_t tx_end = self->tx_samps;
+	self->base_samps += pos;
+	self->rx_samps = 0;
+	self->tx_samps = 0;
+
+	if (tx_pcm != NULL) {
+		const uint64_t latency = self->conf.tx_latency;
+		uint64_t skip = tx_end > pos ? tx_end - pos : 0;
+		if (skip > latency)
+			skip = latency;
+		if ((ret = write_tx(self, skip, 1)) < 0
+		|| (ret = write_tx(self, latency - skip, 0)) < 0) {
+			fprintf(stderr, "ALSA first write: %s\n", snd_strerror(ret));
+			return -1;
+		}
+		// Starts the linked capture stream too
+		if (self->conf.mmap)
+			ALSACHECK(snd_pcm_start(tx_pcm));
+	} else {
+		ALSACHECK(snd_pcm_start(rx_pcm));
+	}
+	mark_sync(self, 0);
+
+	if (self->failed) {
+		const double t = elapsed(&self->fail_time, &self->sync_time);
+		if (t > self->recovery_max)
+			self->recovery_max = t;
+		self->failed = 0;
+		fprintf(stderr, "ALSA: recovered in %.1f ms, %llu samples lost. "
+			"Total %llu RX xruns, %llu TX xruns, %llu full restarts, "
+			"%llu samples lost, longest recovery %.1f ms\n",
+			1e3 * t, (unsigned long long)(pos - done),
+			(unsigned long long)self->rx_xruns, (unsigned long long)self->tx_xruns,
+			(unsigned long long)self->restarts, (unsigned long long)self->lost_samps,
+			1e3 * self->recovery_max);
+	}
+	return 0;
+err:
+	return -1;
+}
+
+
+static int execute_mmap(struct alsa_io *self)
+{
+	struct alsa_io_conf *conf = &self->conf;
+	snd_pcm_t *rx_pcm = self->rx_pcm, *tx_pcm = self->tx_pcm;
+	/* Wait for capture if it is enabled. With linked streams,
+	 * playback follows capture, so it does not need to be polled. */
+	snd_pcm_t *poll_pcm = rx_pcm != NULL ? rx_pcm : tx_pcm;
+	char streaming = 0;
+	const snd_pcm_uframes_t blksize = conf->buffer;
+	const snd_pcm_uframes_t tx_latency = conf->tx_latency;
+
+	const int nfds = snd_pcm_poll_descriptors_count(poll_pcm);
+	struct pollfd *fds = calloc(nfds > 0 ? nfds : 1, sizeof(*fds));
+	if (fds == NULL)
+		goto err;
+	ALSACHECK(snd_pcm_poll_descriptors(poll_pcm, fds, nfds));
+
+	for (;;) {
+		snd_pcm_t *fail_pcm;
+		snd_pcm_sframes_t ret;
+		if (!streaming) {
+			if (start_run(self) < 0)
+				goto err;
+			streaming = 1;
+		}
+
+		if (poll(fds, nfds, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("ALSA poll");
+			goto err;
+		}
+		unsigned short revents = 0;
+		ALSACHECK(snd_pcm_poll_descriptors_revents(poll_pcm, fds, nfds, &revents));
+		if (revents & POLLERR) {
+			fail_pcm = poll_pcm;
+			ret = snd_pcm_avail_update(poll_pcm);
+			if (ret >= 0)
+				ret = -EIO;
+			goto fail;
+		}
+
+		if (rx_pcm != NULL) {
+			fail_pcm = rx_pcm;
+			snd_pcm_sframes_t avail = snd_pcm_avail_update(rx_pcm);
+			if ((ret = avail) < 0)
+				goto fail;
+			// Process whole blocks only
+			while ((snd_pcm_uframes_t)avail >= blksize) {
+				const snd_pcm_channel_area_t *areas;
+				snd_pcm_uframes_t offset, n = blksize;
+				if ((ret = snd_pcm_mmap_begin(rx_pcm, &areas, &offset, &n)) < 0)
+					goto fail;
+				rx_execute(self, mmap_samples(areas, offset), n);
+				ret = snd_pcm_mmap_commit(rx_pcm, offset, n);
+				if (ret != (snd_pcm_sframes_t)n) {
+					if (ret >= 0)
+						ret = -EPIPE;
+					goto fail;
+				}
+				self->rx_samps += n;
+				avail -= n;
+			}
+			mark_sync(self, self->rx_samps);
+		}
+
+		if (tx_pcm != NULL) {
+			fail_pcm = tx_pcm;
+			snd_pcm_sframes_t avail = snd_pcm_avail_update(tx_pcm);
+			if ((ret = avail) < 0)
+				goto fail;
+			/* Sample being played now. Without RX, it is found
+			 * from the amount of signal left in the buffer. */
+			uint64_t now = self->rx_samps;
+			if (rx_pcm == NULL) {
+				now = self->tx_samps - (self->tx_bufsize - avail);
+				mark_sync(self, now);
+			}
+			uint64_t tx_n = now + tx_latency > self->tx_samps ? now + tx_latency - self->tx_samps : 0;
+			if (tx_n > (uint64_t)avail)
+				tx_n = avail;
+			if ((ret = write_tx(self, tx_n, 0)) < 0)
+				goto fail;
+		}
+		continue;
+fail:
+		if (recover(self, fail_pcm, ret) < 0)
+			goto err;
+		streaming = 0;
+	}
+err:
+	free(fds);
+	return -1;
+}
+
+
 static int execute(void *arg)
 {
 	struct alsa_io *self = arg;
 	struct alsa_io_conf *conf = &self->conf;
 	snd_pcm_t *rx_pcm = self->rx_pcm, *tx_pcm = self->tx_pcm;
 	char streaming = 0;
+	int ret = -1;
 
 	snd_pcm_uframes_t blksize = self->conf.buffer;
 	snd_pcm_uframes_t tx_latency = self->conf.tx_latency;
 
 	// Reserve buffer somewhat bigger than blksize
-	size_t buf_max = blksize * 2;
-	cs16_t *silence = calloc(tx_latency, sizeof(cs16_t));
-	cs16_t *buf_int = malloc(sizeof(cs16_t) * buf_max);
-	sample_t *buf_flt = malloc(sizeof(sample_t) * buf_max);
-
-	// RX and TX samples since starting the stream
-	uint64_t rx_samps = 0, tx_samps = 0;
-	/* Total samples before the stream was started.
-	 * This is to keep timestamp progressing if stream is restarted. */
-	uint64_t base_samps = 0;
+	self->buf_max = blksize * 2;
+	self->frame_size = conf->mono ? sizeof(int16_t) : sizeof(cs16_t);
+	self->buf_int = malloc(sizeof(cs16_t) * self->buf_max);
+	self->buf_flt = malloc(sizeof(sample_t) * self->buf_max);
+	if (self->buf_int == NULL || self->buf_flt == NULL)
+		goto err;
+	if (prepare_streams(self) < 0)
+		goto err;
+
+	if (conf->mmap) {
+		ret = execute_mmap(self);
+		goto err;
+	}
 
 	for (;;) {
-		snd_pcm_sframes_t ret;
+		snd_pcm_sframes_t r;
 		if (!streaming) {
-			base_samps += rx_samps;
-			rx_samps = 0;
-			tx_samps = 0;
-			//fprintf(stderr, "ALSA: (Re)starting streams\n");
-			// http://www.saunalahti.fi/~s7l/blog/2005/08/21/Full%20Duplex%20ALSA
-			ALSACHECK(snd_pcm_drop(rx_pcm));
-			ALSACHECK(snd_pcm_drop(tx_pcm));
-			ALSACHECK(snd_pcm_prepare(tx_pcm));
-			ret = snd_pcm_writei(tx_pcm, silence, tx_latency);
-			fprintf(stderr, "ALSA first write: %ld/%ld\n", ret, tx_latency);
-			if (ret > 0) {
-				tx_samps = ret;
-				streaming = 1;
-			}
-			// TODO: handle rx-only (or non-linked) case
+			if (start_run(self) < 0)
+				goto err;
+			streaming = 1;
 		}
 
 		if (conf->rx_on) {
-			ret = snd_pcm_readi(rx_pcm, buf_int, blksize);
-			if (ret < 0) {
-				fprintf(stderr, "ALSA read:  %s\n", snd_strerror(ret));
+			r = snd_pcm_readi(rx_pcm, self->buf_int, blksize);
+			if (r < 0) {
+				if (recover(self, rx_pcm, r) < 0)
+					goto err;
 				streaming = 0;
 				continue;
 			}
-			size_t n = ret;
-			assert(n <= buf_max);
-			cs16_to_cf(buf_int, buf_flt, n);
-			self->receiver->execute(self->receiver_arg,
-				buf_flt, n,
-				samples_to_ns(base_samps + rx_samps, conf->samplerate));
-			rx_samps += n;
+			size_t n = r;
+			assert(n <= self->buf_max);
+			rx_execute(self, self->buf_int, n);
+			self->rx_samps += n;
 		} else {
 			// RX disabled. Increment rx_samps anyway to make TX work
-			rx_samps += blksize;
+			self->rx_samps += blksize;
 		}
+		mark_sync(self, self->rx_samps);
 
 		if (conf->tx_on) {
-			tx_return_t ntx = { 0, 0, 0 };
-			uint64_t tx_until = rx_samps + tx_latency;
+			uint64_t tx_until = self->rx_samps + tx_latency;
 			// How many samples needed now
-			uint64_t tx_n = tx_until - tx_samps;
+			uint64_t tx_n = tx_until > self->tx_samps ? tx_until - self->tx_samps : 0;
 			//printf("tx_n = %lu ", (long unsigned)tx_n);
-			if (tx_n > buf_max)
-				tx_n = buf_max;
-
-			ntx = self->transmitter->execute(self->transmitter_arg,
-				buf_flt, tx_n,
-				samples_to_ns(base_samps + tx_samps, conf->samplerate));
-
-			size_t n = ntx.len;
-			assert(n <= buf_max);
-			cf_to_cs16(buf_flt, buf_int, n);
-			ret = snd_pcm_writei(tx_pcm, buf_int, n);
-			if (ret < 0) {
-				fprintf(stderr, "ALSA write: %s\n", snd_strerror(ret));
+			if (tx_n > self->buf_max)
+				tx_n = self->buf_max;
+			r = write_tx(self, tx_n, 0);
+			if (r < 0) {
+				if (recover(self, tx_pcm, r) < 0)
+					goto err;
 				streaming = 0;
 				continue;
-			} else if (ret != ntx.len) {
-				fprintf(stderr, "ALSA: short write (%ld/%d)\n", ret, ntx.len);
 			}
-			tx_samps += ret;
 		}
 	}
 err:
-	free(silence);
-	free(buf_int);
-	free(buf_flt);
-	return -1;
+	free(self->buf_int);
+	free(self->buf_flt);
+	return ret;
 }
 
 
-
 static int destroy(void *arg)
 {
 	// TODO
@@ -222,6 +585,8 @@ const struct alsa_io_conf alsa_io_defaults = {
 	.samplerate = 48000,
 	.buffer = 96,
 	.tx_latency = 96*4,
+	.mmap = 0,
+	.mono = 0,
 	.rx_name = "hw:0,0",
 	.tx_name = "hw:0,0"
 };
@@ -232,9 +597,11 @@ CONFIG_I(tx_on)
 CONFIG_I(samplerate)
 CONFIG_I(buffer)
 CONFIG_I(tx_latency)
+CONFIG_I(mmap)
+CONFIG_I(mono)
 CONFIG_C(rx_name)
 CONFIG_C(tx_name)
 CONFIG_END()
 
-const struct signal_io_code alsa_io_code = { "alsa_io", init, destroy, init_conf, set_conf, set_callbacks, execute };
+const struct signal_io_code alsa_io_code = { "alsa_io", init, destroy, init_conf, set_conf, set_callbacks, execute, NULL };
 #endif
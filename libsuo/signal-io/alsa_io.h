@@ -2,11 +2,27 @@
 #define LIBSUO_ALSA_IO_H
 #include "suo.h"
 
+/* In mmap mode, samples are converted directly from and to the
+ * sound card buffer instead of being copied by snd_pcm_readi and
+ * snd_pcm_writei. The loop waits with poll for one RX block,
+ * or for one TX block if RX is disabled. The sound card buffer is
+ * sized to tx_latency plus one block instead of 2*tx_latency,
+ * so tx_latency can be made as short as the card allows,
+ * down to a couple of blocks. */
+
+/* In mono mode, the signal is real-valued, such as the discriminator
+ * output and modulator input of an FM radio. Received signal is given
+ * to execute_real of the receiver, or as I/Q with zero imaginary part
+ * to receivers without it. The real part of the transmitted signal
+ * is played. */
+
 struct alsa_io_conf {
 	// Configuration flags
 	unsigned char
 	rx_on:1,     // Enable reception
-	tx_on:1;     // Enable transmission
+	tx_on:1,     // Enable transmission
+	mmap:1,      // Use mmap access driven by poll
+	mono:1;      // Use one real-valued channel instead of I/Q, see below
 	// Audio sample rate for both RX and TX
 	uint32_t samplerate;
 	// Number of samples in each RX block processed
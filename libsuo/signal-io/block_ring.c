@@ -0,0 +1,190 @@
+#include "block_ring.h"
+#include <stdatomic.h>
+#include <semaphore.h>
+#include <errno.h>
+#include <time.h>
+
+struct block_ring {
+	size_t nblocks;
+	struct ring_block *blocks;
+	char *mem;
+
+	/* Total number of blocks written and read.
+	 * Block index is the count modulo nblocks. */
+	atomic_size_t head, tail;
+	atomic_bool closed;
+
+	/* Set by a side that is about to sleep on its semaphore,
+	 * so that the other side knows to wake it up. */
+	atomic_int reader_waiting, writer_waiting;
+	sem_t reader_sem, writer_sem;
+
+	/* Statistics, only updated by the producer */
+	size_t high_water;
+	uint64_t overflows;
+};
+
+
+struct block_ring *block_ring_init(size_t nblocks, size_t blockbytes)
+{
+	struct block_ring *self;
+	size_t i;
+	self = calloc(1, sizeof(*self));
+	if (self == NULL)
+		return NULL;
+
+	// Round the block size up to keep blocks on separate cache lines
+	blockbytes = (blockbytes + 63) & ~(size_t)63;
+
+	self->nblocks = nblocks;
+	self->blocks = calloc(nblocks, sizeof(struct ring_block));
+	self->mem = malloc(nblocks * blockbytes);
+	if (self->blocks == NULL || self->mem == NULL)
+		goto fail;
+	for (i = 0; i < nblocks; i++)
+		self->blocks[i].data = self->mem + i * blockbytes;
+
+	atomic_init(&self->head, 0);
+	atomic_init(&self->tail, 0);
+	atomic_init(&self->closed, 0);
+	atomic_init(&self->reader_waiting, 0);
+	atomic_init(&self->writer_waiting, 0);
+	sem_init(&self->reader_sem, 0, 0);
+	sem_init(&self->writer_sem, 0, 0);
+	return self;
+
+fail:
+	free(self->blocks);
+	free(self->mem);
+	free(self);
+	return NULL;
+}
+
+
+void block_ring_destroy(struct block_ring *self)
+{
+	if (self == NULL)
+		return;
+	sem_destroy(&self->reader_sem);
+	sem_destroy(&self->writer_sem);
+	free(self->blocks);
+	free(self->mem);
+	free(self);
+}
+
+
+/* Sleep on a semaphore for a given time.
+ * Return 0 if woken up, -1 on timeout. */
+static int sem_wait_us(sem_t *sem, long timeout_us)
+{
+	if (timeout_us < 0)
+		return (sem_wait(sem) == 0 || errno == EINTR) ? 0 : -1;
+
+	struct timespec t;
+	clock_gettime(CLOCK_REALTIME, &t);
+	t.tv_sec  += timeout_us / 1000000;
+	t.tv_nsec += (timeout_us % 1000000) * 1000;
+	if (t.tv_nsec >= 1000000000) {
+		t.tv_sec++;
+		t.tv_nsec -= 1000000000;
+	}
+	if (sem_timedwait(sem, &t) == 0 || errno == EINTR)
+		return 0;
+	return -1;
+}
+
+
+static void wake(atomic_int *waiting, sem_t *sem)
+{
+	if (atomic_exchange(waiting, 0))
+		sem_post(sem);
+}
+
+
+struct ring_block *block_ring_write_get(struct block_ring *self, long timeout_us)
+{
+	const size_t head = atomic_load_explicit(&self->head, memory_order_relaxed);
+	for (;;) {
+		if (head - atomic_load_explicit(&self->tail, memory_order_acquire) < self->nblocks)
+			return &self->blocks[head % self->nblocks];
+		if (timeout_us == 0 || atomic_load(&self->closed))
+			break;
+
+		atomic_store(&self->writer_waiting, 1);
+		// Check again in case the consumer freed a block before seeing the flag
+		if (head - atomic_load(&self->tail) < self->nblocks)
+			continue;
+		if (sem_wait_us(&self->writer_sem, timeout_us) < 0) {
+			atomic_store(&self->writer_waiting, 0);
+			timeout_us = 0; // Check one more time and give up
+		}
+	}
+	self->overflows++;
+	return NULL;
+}
+
+
+void block_ring_write_put(struct block_ring *self)
+{
+	const size_t head = atomic_load_explicit(&self->head, memory_order_relaxed) + 1;
+	atomic_store(&self->head, head);
+
+	size_t fill = head - atomic_load_explicit(&self->tail, memory_order_relaxed);
+	if (fill > self->high_water)
+		self->high_water = fill;
+
+	wake(&self->reader_waiting, &self->reader_sem);
+}
+
+
+struct ring_block *block_ring_read_get(struct block_ring *self, long timeout_us)
+{
+	const size_t tail = atomic_load_explicit(&self->tail, memory_order_relaxed);
+	for (;;) {
+		if (atomic_load_explicit(&self->head, memory_order_acquire) != tail)
+			return &self->blocks[tail % self->nblocks];
+		if (timeout_us == 0 || atomic_load(&self->closed))
+			break;
+
+		atomic_store(&self->reader_waiting, 1);
+		// Check again in case the producer put a block before seeing the flag
+		if (atomic_load(&self->head) != tail || atomic_load(&self->closed))
+			continue;
+		if (sem_wait_us(&self->reader_sem, timeout_us) < 0) {
+			atomic_store(&self->reader_waiting, 0);
+			timeout_us = 0;
+		}
+	}
+	return NULL;
+}
+
+
+void block_ring_read_put(struct block_ring *self)
+{
+	const size_t tail = atomic_load_explicit(&self->tail, memory_order_relaxed) + 1;
+	atomic_store(&self->tail, tail);
+	wake(&self->writer_waiting, &self->writer_sem);
+}
+
+
+void block_ring_close(struct block_ring *self)
+{
+	atomic_store(&self->closed, 1);
+	wake(&self->reader_waiting, &self->reader_sem);
+	wake(&self->writer_waiting, &self->writer_sem);
+}
+
+
+bool block_ring_closed(struct block_ring *self)
+{
+	return atomic_load(&self->closed);
+}
+
+
+void block_ring_get_stats(struct block_ring *self, struct block_ring_stats *st)
+{
+	st->size = self->nblocks;
+	st->fill = atomic_load(&self->head) - atomic_load(&self->tail);
+	st->high_water = self->high_water;
+	st->overflows = self->overflows;
+}
@@ -0,0 +1,69 @@
+#ifndef LIBSUO_BLOCK_RING_H
+#define LIBSUO_BLOCK_RING_H
+#include "suo.h"
+
+/* Lock-free single-producer single-consumer ring of sample blocks.
+ *
+ * All memory is allocated when the ring is initialized, so the
+ * producer and consumer never allocate anything while streaming.
+ * Blocks are used in place: the producer gets a pointer to a free
+ * block, fills it and then puts it, and the consumer does the same
+ * on the other end.
+ *
+ * Getting a block can optionally wait for one to become available.
+ * Waiting is only used on the slow path when the ring is empty or full;
+ * as long as there's something to do, neither side makes any
+ * system calls. */
+
+struct block_ring;
+
+struct ring_block {
+	// Timestamp of the first sample in the block
+	timestamp_t time;
+	// Flags, can be used to pass I/O-specific information
+	int flags;
+	// Number of valid elements in data
+	size_t len;
+	// Block data. Has space for the number of bytes given in init.
+	void *data;
+};
+
+struct block_ring_stats {
+	// Number of blocks in the ring
+	size_t size;
+	// Number of blocks currently filled
+	size_t fill;
+	// Highest number of blocks that has been filled
+	size_t high_water;
+	// Number of times the producer found the ring full
+	uint64_t overflows;
+};
+
+struct block_ring *block_ring_init(size_t nblocks, size_t blockbytes);
+void block_ring_destroy(struct block_ring *);
+
+/* Get a free block to fill.
+ * Wait up to timeout_us microseconds for one if the ring is full,
+ * negative timeout waits forever.
+ * Return NULL if there is no free block. */
+struct ring_block *block_ring_write_get(struct block_ring *, long timeout_us);
+// Pass the block from the previous write_get to the consumer
+void block_ring_write_put(struct block_ring *);
+
+/* Get the oldest filled block.
+ * Wait up to timeout_us microseconds for one if the ring is empty,
+ * negative timeout waits forever.
+ * Return NULL if there is no filled block. */
+struct ring_block *block_ring_read_get(struct block_ring *, long timeout_us);
+// Release the block from the previous read_get back to the producer
+void block_ring_read_put(struct block_ring *);
+
+/* Mark that no more blocks will be written.
+ * Wakes up a waiting consumer, which then gets the remaining blocks
+ * and after that NULL without waiting. */
+void block_ring_close(struct block_ring *);
+bool block_ring_closed(struct block_ring *);
+
+void block_ring_get_stats(struct block_ring *, struct block_ring_stats *);
+
+#endif
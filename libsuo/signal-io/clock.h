@@ -0,0 +1,22 @@
+#ifndef LIBSUO_CLOCK_H
+#define LIBSUO_CLOCK_H
+#include <time.h>
+
+/* System clocks in nanoseconds */
+
+static inline long long monotonic_ns(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (long long)t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+
+static inline long long realtime_ns(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_REALTIME, &t);
+	return (long long)t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+#endif
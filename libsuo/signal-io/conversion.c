@@ -0,0 +1,687 @@
+#include "conversion.h"
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CONVERSION_X86 1
+#include <immintrin.h>
+#endif
+
+/* Conversion kernels work on flat arrays of I and Q components.
+ * Each vectorized kernel handles as many components as fit in
+ * whole vectors and leaves the rest to the scalar kernel. */
+
+static void s16_to_f(const int16_t *restrict a, float *restrict b, size_t n, float scale)
+{
+	size_t i;
+	for (i = 0; i < n; i++)
+		b[i] = (float)a[i] * scale;
+}
+
+
+static void s8_to_f(const int8_t *restrict a, float *restrict b, size_t n, float scale)
+{
+	size_t i;
+	for (i = 0; i < n; i++)
+		b[i] = (float)a[i] * scale;
+}
+
+
+static void u8_to_f(const uint8_t *restrict a, float *restrict b, size_t n, float dc, float scale)
+{
+	size_t i;
+	for (i = 0; i < n; i++)
+		b[i] = ((float)a[i] + dc) * scale;
+}
+
+
+static void f_to_s16(const float *restrict a, int16_t *restrict b, size_t n, float scale)
+{
+	size_t i;
+	for (i = 0; i < n; i++) {
+		float v = a[i] * scale;
+		v = v >  32767.0f ?  32767.0f : v;
+		v = v < -32768.0f ? -32768.0f : v;
+		b[i] = (int16_t)v;
+	}
+}
+
+
+static void f_to_s8(const float *restrict a, int8_t *restrict b, size_t n, float scale)
+{
+	size_t i;
+	for (i = 0; i < n; i++) {
+		float v = a[i] * scale;
+		v = v >  127.0f ?  127.0f : v;
+		v = v < -128.0f ? -128.0f : v;
+		b[i] = (int8_t)v;
+	}
+}
+
+
+/* Packed 12-bit kernels work on n complex samples instead,
+ * since a component does not take a whole number of bytes */
+static void s12_to_f(const uint8_t *restrict a, float *restrict b, size_t n, float scale)
+{
+	size_t i;
+	for (i = 0; i < n; i++) {
+		const uint32_t w = a[3*i] | a[3*i+1] << 8 | (uint32_t)a[3*i+2] << 16;
+		// Sign extend by shifting to the top of a 32-bit word and back
+		b[2*i]   = (float)((int32_t)(w << 20) >> 20) * scale;
+		b[2*i+1] = (float)((int32_t)(w << 8) >> 20) * scale;
+	}
+}
+
+
+static void f_to_s12(const float *restrict a, uint8_t *restrict b, size_t n, float scale)
+{
+	size_t i, j;
+	for (i = 0; i < n; i++) {
+		uint32_t w = 0;
+		for (j = 0; j < 2; j++) {
+			float v = a[2*i+j] * scale;
+			v = v >  2047.0f ?  2047.0f : v;
+			v = v < -2048.0f ? -2048.0f : v;
+			w |= ((uint32_t)(int32_t)v & 0xFFF) << (12*j);
+		}
+		b[3*i]   = w;
+		b[3*i+1] = w >> 8;
+		b[3*i+2] = w >> 16;
+	}
+}
+
+
+static float half_to_float(uint16_t h)
+{
+	const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	const uint32_t e = (h >> 10) & 0x1F, m = h & 0x3FF;
+	uint32_t f;
+	if (e == 0) {
+		// Zero or subnormal
+		float v = (float)m * (1.0f / 16777216.0f);
+		return sign ? -v : v;
+	} else if (e == 0x1F) {
+		// Infinity or NaN
+		f = sign | 0x7F800000 | m << 13;
+	} else {
+		f = sign | (e + 112) << 23 | m << 13;
+	}
+	float v;
+	memcpy(&v, &f, sizeof(v));
+	return v;
+}
+
+
+// Round to nearest even, like the F16C instructions do
+static uint16_t float_to_half(float v)
+{
+	uint32_t f;
+	memcpy(&f, &v, sizeof(f));
+	const uint16_t sign = (f >> 16) & 0x8000;
+	const uint32_t a = f & 0x7FFFFFFF;
+	if (a >= 0x47800000) // Too large, infinity or NaN
+		return sign | (a > 0x7F800000 ? 0x7E00 : 0x7C00);
+	if (a < 0x38800000) // Subnormal in half precision
+		return sign | (uint16_t)lrintf(fabsf(v) * 16777216.0f);
+	// Rebias the exponent. Rounding may carry into the exponent,
+	// which correctly gives the next power of two or infinity.
+	uint32_t h = (a - 0x38000000) >> 13;
+	const uint32_t rem = a & 0x1FFF;
+	if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+		h++;
+	return sign | h;
+}
+
+
+static void h_to_f(const uint16_t *restrict a, float *restrict b, size_t n)
+{
+	size_t i;
+	for (i = 0; i < n; i++)
+		b[i] = half_to_float(a[i]);
+}
+
+
+static void f_to_h(const float *restrict a, uint16_t *restrict b, size_t n)
+{
+	size_t i;
+	for (i = 0; i < n; i++)
+		b[i] = float_to_half(a[i]);
+}
+
+
+#ifdef CONVERSION_X86
+
+/* ---------------
+ * SSE2 kernels
+ * --------------- */
+
+__attribute__((target("sse2")))
+static void s16_to_f_sse2(const int16_t *a, float *b, size_t n, float scale)
+{
+	const __m128 s = _mm_set1_ps(scale);
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+		// Sign extend by placing the value in the upper half and shifting
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+		_mm_storeu_ps(b + i,     _mm_mul_ps(_mm_cvtepi32_ps(lo), s));
+		_mm_storeu_ps(b + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), s));
+	}
+	s16_to_f(a + i, b + i, n - i, scale);
+}
+
+
+__attribute__((target("sse2")))
+static void s8_to_f_sse2(const int8_t *a, float *b, size_t n, float scale)
+{
+	const __m128 s = _mm_set1_ps(scale);
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i x0 = _mm_srai_epi16(_mm_unpacklo_epi8(x, x), 8);
+		__m128i x1 = _mm_srai_epi16(_mm_unpackhi_epi8(x, x), 8);
+		__m128i y0 = _mm_srai_epi32(_mm_unpacklo_epi16(x0, x0), 16);
+		__m128i y1 = _mm_srai_epi32(_mm_unpackhi_epi16(x0, x0), 16);
+		__m128i y2 = _mm_srai_epi32(_mm_unpacklo_epi16(x1, x1), 16);
+		__m128i y3 = _mm_srai_epi32(_mm_unpackhi_epi16(x1, x1), 16);
+		_mm_storeu_ps(b + i,      _mm_mul_ps(_mm_cvtepi32_ps(y0), s));
+		_mm_storeu_ps(b + i + 4,  _mm_mul_ps(_mm_cvtepi32_ps(y1), s));
+		_mm_storeu_ps(b + i + 8,  _mm_mul_ps(_mm_cvtepi32_ps(y2), s));
+		_mm_storeu_ps(b + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(y3), s));
+	}
+	s8_to_f(a + i, b + i, n - i, scale);
+}
+
+
+__attribute__((target("sse2")))
+static void u8_to_f_sse2(const uint8_t *a, float *b, size_t n, float dc, float scale)
+{
+	const __m128 d = _mm_set1_ps(dc), s = _mm_set1_ps(scale);
+	const __m128i zero = _mm_setzero_si128();
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i x0 = _mm_unpacklo_epi8(x, zero);
+		__m128i x1 = _mm_unpackhi_epi8(x, zero);
+		__m128i y0 = _mm_unpacklo_epi16(x0, zero);
+		__m128i y1 = _mm_unpackhi_epi16(x0, zero);
+		__m128i y2 = _mm_unpacklo_epi16(x1, zero);
+		__m128i y3 = _mm_unpackhi_epi16(x1, zero);
+		_mm_storeu_ps(b + i,      _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(y0), d), s));
+		_mm_storeu_ps(b + i + 4,  _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(y1), d), s));
+		_mm_storeu_ps(b + i + 8,  _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(y2), d), s));
+		_mm_storeu_ps(b + i + 12, _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(y3), d), s));
+	}
+	u8_to_f(a + i, b + i, n - i, dc, scale);
+}
+
+
+/* Values are clamped before converting to integers, since
+ * cvttps returns INT_MIN for anything out of the int32 range.
+ * Packing then saturates the rest of the way. */
+__attribute__((target("sse2")))
+static void f_to_s16_sse2(const float *a, int16_t *b, size_t n, float scale)
+{
+	const __m128 s = _mm_set1_ps(scale);
+	const __m128 vmax = _mm_set1_ps(32767.0f), vmin = _mm_set1_ps(-32768.0f);
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128 x0 = _mm_mul_ps(_mm_loadu_ps(a + i), s);
+		__m128 x1 = _mm_mul_ps(_mm_loadu_ps(a + i + 4), s);
+		x0 = _mm_max_ps(_mm_min_ps(x0, vmax), vmin);
+		x1 = _mm_max_ps(_mm_min_ps(x1, vmax), vmin);
+		__m128i y = _mm_packs_epi32(_mm_cvttps_epi32(x0), _mm_cvttps_epi32(x1));
+		_mm_storeu_si128((__m128i *)(b + i), y);
+	}
+	f_to_s16(a + i, b + i, n - i, scale);
+}
+
+
+__attribute__((target("sse2")))
+static void f_to_s8_sse2(const float *a, int8_t *b, size_t n, float scale)
+{
+	const __m128 s = _mm_set1_ps(scale);
+	const __m128 vmax = _mm_set1_ps(127.0f), vmin = _mm_set1_ps(-128.0f);
+	size_t i, j;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i y[4];
+		for (j = 0; j < 4; j++) {
+			__m128 x = _mm_mul_ps(_mm_loadu_ps(a + i + 4*j), s);
+			y[j] = _mm_cvttps_epi32(_mm_max_ps(_mm_min_ps(x, vmax), vmin));
+		}
+		__m128i z = _mm_packs_epi16(_mm_packs_epi32(y[0], y[1]), _mm_packs_epi32(y[2], y[3]));
+		_mm_storeu_si128((__m128i *)(b + i), z);
+	}
+	f_to_s8(a + i, b + i, n - i, scale);
+}
+
+
+/* ---------------
+ * AVX2 kernels
+ * --------------- */
+
+__attribute__((target("avx2")))
+static void s16_to_f_avx2(const int16_t *a, float *b, size_t n, float scale)
+{
+	const __m256 s = _mm256_set1_ps(scale);
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(a + i)));
+		__m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(a + i + 8)));
+		_mm256_storeu_ps(b + i,     _mm256_mul_ps(_mm256_cvtepi32_ps(lo), s));
+		_mm256_storeu_ps(b + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), s));
+	}
+	s16_to_f(a + i, b + i, n - i, scale);
+}
+
+
+__attribute__((target("avx2")))
+static void s8_to_f_avx2(const int8_t *a, float *b, size_t n, float scale)
+{
+	const __m256 s = _mm256_set1_ps(scale);
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m256i lo = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)(a + i)));
+		__m256i hi = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)(a + i + 8)));
+		_mm256_storeu_ps(b + i,     _mm256_mul_ps(_mm256_cvtepi32_ps(lo), s));
+		_mm256_storeu_ps(b + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), s));
+	}
+	s8_to_f(a + i, b + i, n - i, scale);
+}
+
+
+__attribute__((target("avx2")))
+static void u8_to_f_avx2(const uint8_t *a, float *b, size_t n, float dc, float scale)
+{
+	const __m256 d = _mm256_set1_ps(dc), s = _mm256_set1_ps(scale);
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m256i lo = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(a + i)));
+		__m256i hi = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(a + i + 8)));
+		_mm256_storeu_ps(b + i,     _mm256_mul_ps(_mm256_add_ps(_mm256_cvtepi32_ps(lo), d), s));
+		_mm256_storeu_ps(b + i + 8, _mm256_mul_ps(_mm256_add_ps(_mm256_cvtepi32_ps(hi), d), s));
+	}
+	u8_to_f(a + i, b + i, n - i, dc, scale);
+}
+
+
+__attribute__((target("avx2")))
+static void f_to_s16_avx2(const float *a, int16_t *b, size_t n, float scale)
+{
+	const __m256 s = _mm256_set1_ps(scale);
+	const __m256 vmax = _mm256_set1_ps(32767.0f), vmin = _mm256_set1_ps(-32768.0f);
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m256 x0 = _mm256_mul_ps(_mm256_loadu_ps(a + i), s);
+		__m256 x1 = _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), s);
+		x0 = _mm256_max_ps(_mm256_min_ps(x0, vmax), vmin);
+		x1 = _mm256_max_ps(_mm256_min_ps(x1, vmax), vmin);
+		__m256i y = _mm256_packs_epi32(_mm256_cvttps_epi32(x0), _mm256_cvttps_epi32(x1));
+		// Packing works within 128-bit lanes, so put the halves in order
+		y = _mm256_permute4x64_epi64(y, 0xD8);
+		_mm256_storeu_si256((__m256i *)(b + i), y);
+	}
+	f_to_s16(a + i, b + i, n - i, scale);
+}
+
+
+__attribute__((target("avx2")))
+static void f_to_s8_avx2(const float *a, int8_t *b, size_t n, float scale)
+{
+	const __m256 s = _mm256_set1_ps(scale);
+	const __m256 vmax = _mm256_set1_ps(127.0f), vmin = _mm256_set1_ps(-128.0f);
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	size_t i, j;
+	for (i = 0; i + 32 <= n; i += 32) {
+		__m256i y[4];
+		for (j = 0; j < 4; j++) {
+			__m256 x = _mm256_mul_ps(_mm256_loadu_ps(a + i + 8*j), s);
+			y[j] = _mm256_cvttps_epi32(_mm256_max_ps(_mm256_min_ps(x, vmax), vmin));
+		}
+		__m256i z = _mm256_packs_epi16(_mm256_packs_epi32(y[0], y[1]), _mm256_packs_epi32(y[2], y[3]));
+		z = _mm256_permutevar8x32_epi32(z, order);
+		_mm256_storeu_si256((__m256i *)(b + i), z);
+	}
+	f_to_s8(a + i, b + i, n - i, scale);
+}
+
+
+/* Each 128-bit lane unpacks 4 samples from 12 bytes. The shuffle
+ * gathers the 16-bit word containing each component: I is in its
+ * low 12 bits and Q in its high 12 bits. The second load reads
+ * 4 bytes past the 24 used, so the loop stops early enough. */
+__attribute__((target("avx2")))
+static void s12_to_f_avx2(const uint8_t *a, float *b, size_t n, float scale)
+{
+	const __m256 s = _mm256_set1_ps(scale);
+	const __m256i shuf = _mm256_setr_epi8(
+		0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11,
+		0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+	size_t i;
+	for (i = 0; 3*i + 28 <= 3*n; i += 8) {
+		__m256i x = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(a + 3*i))),
+			_mm_loadu_si128((const __m128i *)(a + 3*i + 12)), 1);
+		x = _mm256_shuffle_epi8(x, shuf);
+		// Move I to the top of its word, then shift both down with sign extension
+		x = _mm256_srai_epi16(_mm256_blend_epi16(x, _mm256_slli_epi16(x, 4), 0x55), 4);
+		__m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(x));
+		__m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(x, 1));
+		_mm256_storeu_ps(b + 2*i,     _mm256_mul_ps(_mm256_cvtepi32_ps(lo), s));
+		_mm256_storeu_ps(b + 2*i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), s));
+	}
+	s12_to_f(a + 3*i, b + 2*i, n - i, scale);
+}
+
+
+__attribute__((target("avx2,f16c")))
+static void h_to_f_avx2(const uint16_t *a, float *b, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(b + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(a + i))));
+	h_to_f(a + i, b + i, n - i);
+}
+
+
+__attribute__((target("avx2,f16c")))
+static void f_to_h_avx2(const float *a, uint16_t *b, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i y = _mm256_cvtps_ph(_mm256_loadu_ps(a + i), _MM_FROUND_TO_NEAREST_INT);
+		_mm_storeu_si128((__m128i *)(b + i), y);
+	}
+	f_to_h(a + i, b + i, n - i);
+}
+
+
+/* ---------------
+ * AVX-512 kernels
+ * --------------- */
+
+__attribute__((target("avx512f")))
+static void s16_to_f_avx512(const int16_t *a, float *b, size_t n, float scale)
+{
+	const __m512 s = _mm512_set1_ps(scale);
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m512i x = _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i *)(a + i)));
+		_mm512_storeu_ps(b + i, _mm512_mul_ps(_mm512_cvtepi32_ps(x), s));
+	}
+	s16_to_f(a + i, b + i, n - i, scale);
+}
+
+
+__attribute__((target("avx512f")))
+static void s8_to_f_avx512(const int8_t *a, float *b, size_t n, float scale)
+{
+	const __m512 s = _mm512_set1_ps(scale);
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m512i x = _mm512_cvtepi8_epi32(_mm_loadu_si128((const __m128i *)(a + i)));
+		_mm512_storeu_ps(b + i, _mm512_mul_ps(_mm512_cvtepi32_ps(x), s));
+	}
+	s8_to_f(a + i, b + i, n - i, scale);
+}
+
+
+__attribute__((target("avx512f")))
+static void u8_to_f_avx512(const uint8_t *a, float *b, size_t n, float dc, float scale)
+{
+	const __m512 d = _mm512_set1_ps(dc), s = _mm512_set1_ps(scale);
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m512i x = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(a + i)));
+		_mm512_storeu_ps(b + i, _mm512_mul_ps(_mm512_add_ps(_mm512_cvtepi32_ps(x), d), s));
+	}
+	u8_to_f(a + i, b + i, n - i, dc, scale);
+}
+
+
+/* AVX-512 has saturating narrowing conversions,
+ * so the clamping only needs to keep values in the int32 range */
+__attribute__((target("avx512f")))
+static void f_to_s16_avx512(const float *a, int16_t *b, size_t n, float scale)
+{
+	const __m512 s = _mm512_set1_ps(scale);
+	const __m512 vmax = _mm512_set1_ps(32767.0f), vmin = _mm512_set1_ps(-32768.0f);
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m512 x = _mm512_mul_ps(_mm512_loadu_ps(a + i), s);
+		x = _mm512_max_ps(_mm512_min_ps(x, vmax), vmin);
+		_mm256_storeu_si256((__m256i *)(b + i), _mm512_cvtsepi32_epi16(_mm512_cvttps_epi32(x)));
+	}
+	f_to_s16(a + i, b + i, n - i, scale);
+}
+
+
+__attribute__((target("avx512f")))
+static void f_to_s8_avx512(const float *a, int8_t *b, size_t n, float scale)
+{
+	const __m512 s = _mm512_set1_ps(scale);
+	const __m512 vmax = _mm512_set1_ps(127.0f), vmin = _mm512_set1_ps(-128.0f);
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m512 x = _mm512_mul_ps(_mm512_loadu_ps(a + i), s);
+		x = _mm512_max_ps(_mm512_min_ps(x, vmax), vmin);
+		_mm_storeu_si128((__m128i *)(b + i), _mm512_cvtsepi32_epi8(_mm512_cvttps_epi32(x)));
+	}
+	f_to_s8(a + i, b + i, n - i, scale);
+}
+
+__attribute__((target("avx512f")))
+static void h_to_f_avx512(const uint16_t *a, float *b, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16)
+		_mm512_storeu_ps(b + i, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)(a + i))));
+	h_to_f(a + i, b + i, n - i);
+}
+
+
+__attribute__((target("avx512f")))
+static void f_to_h_avx512(const float *a, uint16_t *b, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m256i y = _mm512_cvtps_ph(_mm512_loadu_ps(a + i), _MM_FROUND_TO_NEAREST_INT);
+		_mm256_storeu_si256((__m256i *)(b + i), y);
+	}
+	f_to_h(a + i, b + i, n - i);
+}
+
+#endif
+
+
+/* ----------------------------
+ * Selection of implementation
+ * ---------------------------- */
+
+struct conversion_kernels {
+	void (*s16_to_f)(const int16_t *, float *, size_t, float);
+	void (*s8_to_f) (const int8_t *,  float *, size_t, float);
+	void (*u8_to_f) (const uint8_t *, float *, size_t, float, float);
+	void (*f_to_s16)(const float *, int16_t *, size_t, float);
+	void (*f_to_s8) (const float *, int8_t *,  size_t, float);
+	void (*s12_to_f)(const uint8_t *, float *, size_t, float);
+	void (*f_to_s12)(const float *, uint8_t *, size_t, float);
+	void (*h_to_f)  (const uint16_t *, float *, size_t);
+	void (*f_to_h)  (const float *, uint16_t *, size_t);
+};
+
+/* There are no SSE2 kernels for the packed 12-bit and half-float
+ * formats, since SSE2 lacks byte shuffles and half-float conversions.
+ * Packing 12-bit samples is done by the scalar kernel everywhere:
+ * it is only used for transmitted signals, which are slow. */
+
+static const struct conversion_kernels kernels[] = {
+	[CONVERSION_SCALAR] = { s16_to_f, s8_to_f, u8_to_f, f_to_s16, f_to_s8,
+	                        s12_to_f, f_to_s12, h_to_f, f_to_h },
+#ifdef CONVERSION_X86
+	[CONVERSION_SSE2]   = { s16_to_f_sse2, s8_to_f_sse2, u8_to_f_sse2, f_to_s16_sse2, f_to_s8_sse2,
+	                        s12_to_f, f_to_s12, h_to_f, f_to_h },
+	[CONVERSION_AVX2]   = { s16_to_f_avx2, s8_to_f_avx2, u8_to_f_avx2, f_to_s16_avx2, f_to_s8_avx2,
+	                        s12_to_f_avx2, f_to_s12, h_to_f_avx2, f_to_h_avx2 },
+	[CONVERSION_AVX512] = { s16_to_f_avx512, s8_to_f_avx512, u8_to_f_avx512, f_to_s16_avx512, f_to_s8_avx512,
+	                        s12_to_f_avx2, f_to_s12, h_to_f_avx512, f_to_h_avx512 },
+#endif
+};
+
+static const char *const isa_names[] = {
+	[CONVERSION_SCALAR] = "scalar",
+	[CONVERSION_SSE2]   = "SSE2",
+	[CONVERSION_AVX2]   = "AVX2",
+	[CONVERSION_AVX512] = "AVX-512",
+};
+
+static const struct conversion_kernels *k = &kernels[CONVERSION_SCALAR];
+static enum conversion_isa selected_isa = CONVERSION_SCALAR;
+
+
+bool conversion_supported(enum conversion_isa isa)
+{
+	switch (isa) {
+	case CONVERSION_SCALAR:
+		return 1;
+#ifdef CONVERSION_X86
+	case CONVERSION_SSE2:
+		return __builtin_cpu_supports("sse2");
+	case CONVERSION_AVX2:
+		// Every CPU with AVX2 has F16C too, but check to be sure
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c");
+	case CONVERSION_AVX512:
+		return __builtin_cpu_supports("avx512f");
+#endif
+	default:
+		return 0;
+	}
+}
+
+
+int conversion_select(enum conversion_isa isa)
+{
+	if (!conversion_supported(isa))
+		return -1;
+	k = &kernels[isa];
+	selected_isa = isa;
+	return 0;
+}
+
+
+enum conversion_isa conversion_selected(void)
+{
+	return selected_isa;
+}
+
+
+const char *conversion_isa_name(enum conversion_isa isa)
+{
+	if ((unsigned)isa >= sizeof(isa_names) / sizeof(isa_names[0]))
+		return "unknown";
+	return isa_names[isa];
+}
+
+
+/* Select the best supported implementation at program startup,
+ * before any threads using the conversions have been created.
+ * SUO_CONVERSION environment variable can be used to force
+ * a specific one, e.g. for testing. */
+__attribute__((constructor))
+static void conversion_init(void)
+{
+	int isa;
+#ifdef CONVERSION_X86
+	__builtin_cpu_init();
+#endif
+	const char *force = getenv("SUO_CONVERSION");
+	for (isa = CONVERSION_AVX512; isa >= CONVERSION_SCALAR; isa--) {
+		if (force != NULL && strcmp(force, isa_names[isa]) != 0)
+			continue;
+		if (conversion_select(isa) == 0)
+			return;
+	}
+	if (force != NULL)
+		fprintf(stderr, "Warning: conversion implementation %s not supported\n", force);
+}
+
+
+size_t cs16_to_cf_scale(const cs16_t *in, sample_t *out, size_t n, float scale)
+{
+	k->s16_to_f((const int16_t *)in, (float *)out, 2*n, scale);
+	return n;
+}
+
+
+size_t cs8_to_cf_scale(const cs8_t *in, sample_t *out, size_t n, float scale)
+{
+	k->s8_to_f((const int8_t *)in, (float *)out, 2*n, scale);
+	return n;
+}
+
+
+size_t cu8_to_cf(const cu8_t *in, sample_t *out, size_t n)
+{
+	k->u8_to_f((const uint8_t *)in, (float *)out, 2*n, -127.4f, 1.0f / 127.6f);
+	return n;
+}
+
+
+size_t cf_to_cs16_scale(const sample_t *in, cs16_t *out, size_t n, float scale)
+{
+	k->f_to_s16((const float *)in, (int16_t *)out, 2*n, scale);
+	return n;
+}
+
+
+size_t cf_to_cs8_scale(const sample_t *in, cs8_t *out, size_t n, float scale)
+{
+	k->f_to_s8((const float *)in, (int8_t *)out, 2*n, scale);
+	return n;
+}
+
+
+size_t sc12_to_cf_scale(const sc12_t *in, sample_t *out, size_t n, float scale)
+{
+	k->s12_to_f((const uint8_t *)in, (float *)out, n, scale);
+	return n;
+}
+
+
+size_t cf16_to_cf(const cf16_t *in, sample_t *out, size_t n)
+{
+	k->h_to_f((const uint16_t *)in, (float *)out, 2*n);
+	return n;
+}
+
+
+size_t cf_to_sc12_scale(const sample_t *in, sc12_t *out, size_t n, float scale)
+{
+	k->f_to_s12((const float *)in, (uint8_t *)out, n, scale);
+	return n;
+}
+
+
+size_t cf_to_cf16(const sample_t *in, cf16_t *out, size_t n)
+{
+	k->f_to_h((const float *)in, (uint16_t *)out, 2*n);
+	return n;
+}
+
+
+size_t s16_to_f_scale(const int16_t *in, float *out, size_t n, float scale)
+{
+	k->s16_to_f(in, out, n, scale);
+	return n;
+}
+
+
+size_t f_to_cf(const float *in, sample_t *out, size_t n)
+{
+	// Backwards, so that in can point to the beginning of out
+	for (size_t i = n; i-- > 0; )
+		out[i] = in[i];
+	return n;
+}
@@ -2,41 +2,84 @@
 #define LIBSUO_CONVERSION_H
 #include "suo.h"
 
-static inline size_t cs16_to_cf(cs16_t *in, sample_t *out, size_t n)
+/* Conversions between sample formats.
+ *
+ * There are vectorized implementations for several instruction sets.
+ * The best one supported by the CPU is selected at program startup.
+ * Conversions to fixed-point saturate instead of wrapping around
+ * when the signal goes over full scale.
+ *
+ * Packed 12-bit samples (sc12_t) take 3 bytes each: the bytes form
+ * a little-endian 24-bit word with I in bits 0-11 and Q in bits
+ * 12-23, both two's complement. This is the packed 12-bit format
+ * of bladeRF and the sc12 format of UHD. Half-float samples (cf16_t)
+ * are IEEE 754 binary16 numbers. */
+
+size_t cs16_to_cf_scale(const cs16_t *in, sample_t *out, size_t n, float scale);
+size_t cs8_to_cf_scale(const cs8_t *in, sample_t *out, size_t n, float scale);
+size_t cu8_to_cf(const cu8_t *in, sample_t *out, size_t n);
+size_t cf_to_cs16_scale(const sample_t *in, cs16_t *out, size_t n, float scale);
+size_t cf_to_cs8_scale(const sample_t *in, cs8_t *out, size_t n, float scale);
+size_t sc12_to_cf_scale(const sc12_t *in, sample_t *out, size_t n, float scale);
+size_t cf_to_sc12_scale(const sample_t *in, sc12_t *out, size_t n, float scale);
+size_t cf16_to_cf(const cf16_t *in, sample_t *out, size_t n);
+size_t cf_to_cf16(const sample_t *in, cf16_t *out, size_t n);
+// Real-valued (mono) samples
+size_t s16_to_f_scale(const int16_t *in, float *out, size_t n, float scale);
+/* Real to I/Q with a zero imaginary part.
+ * in can point to the same buffer as out. */
+size_t f_to_cf(const float *in, sample_t *out, size_t n);
+
+
+static inline size_t cs16_to_cf(const cs16_t *in, sample_t *out, size_t n)
+{
+	return cs16_to_cf_scale(in, out, n, 1.0f / 0x8000);
+}
+
+
+static inline size_t cs8_to_cf(const cs8_t *in, sample_t *out, size_t n)
+{
+	return cs8_to_cf_scale(in, out, n, 1.0f / 0x80);
+}
+
+
+static inline size_t sc12_to_cf(const sc12_t *in, sample_t *out, size_t n)
 {
-	size_t i;
-	const float scale = 1.0f / 0x8000;
-	for (i = 0; i < n; i++)
-		out[i] =
-		((float)in[i][0] * scale) +
-		((float)in[i][1] * scale) * I;
-	return n;
+	return sc12_to_cf_scale(in, out, n, 1.0f / 0x800);
 }
 
 
-static inline size_t cu8_to_cf(cu8_t *in, sample_t *out, size_t n)
+static inline size_t cf_to_cs16(const sample_t *in, cs16_t *out, size_t n)
 {
-	size_t i;
-	const float dc = -127.4f;
-	const float scale = 1.0f / 127.6f;
-	for (i = 0; i < n; i++)
-		out[i] =
-		(((float)in[i][0] + dc) * scale) +
-		(((float)in[i][1] + dc) * scale) * I;
-	return n;
+	return cf_to_cs16_scale(in, out, n, 0x8000);
 }
 
 
-static inline size_t cf_to_cs16(sample_t *in, cs16_t *out, size_t n)
+static inline size_t cf_to_cs8(const sample_t *in, cs8_t *out, size_t n)
 {
-	size_t i;
-	const float scale = 0x8000;
-	// TODO: clip
-	for (i = 0; i < n; i++) {
-		out[i][0] = crealf(in[i]) * scale;
-		out[i][1] = cimagf(in[i]) * scale;
-	}
-	return n;
+	return cf_to_cs8_scale(in, out, n, 0x80);
 }
 
+
+static inline size_t cf_to_sc12(const sample_t *in, sc12_t *out, size_t n)
+{
+	return cf_to_sc12_scale(in, out, n, 0x800);
+}
+
+
+/* Instruction sets with an implementation of the conversions */
+enum conversion_isa {
+	CONVERSION_SCALAR,
+	CONVERSION_SSE2,
+	CONVERSION_AVX2,
+	CONVERSION_AVX512
+};
+
+bool conversion_supported(enum conversion_isa);
+/* Use a given implementation.
+ * Return -1 if the CPU does not support it. */
+int conversion_select(enum conversion_isa);
+enum conversion_isa conversion_selected(void);
+const char *conversion_isa_name(enum conversion_isa);
+
 #endif
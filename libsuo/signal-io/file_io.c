@@ -1,11 +1,24 @@
 #include "file_io.h"
 #include "suo_macros.h"
 #include "conversion.h"
+#include "block_ring.h"
+#include "iq_compress.h"
+#include "clock.h"
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
-enum inputformat { FORMAT_CU8, FORMAT_CS16, FORMAT_CF32 };
+
+enum inputformat { FORMAT_CU8, FORMAT_CS16, FORMAT_CF32, FORMAT_IQZ,
+	FORMAT_CS8, FORMAT_SC12, FORMAT_CF16, FORMAT_S16, FORMAT_F32 };
 
 struct file_io {
 	const struct receiver_code *receiver;
@@ -14,9 +27,68 @@ struct file_io {
 	void *transmitter_arg;
 	FILE *in, *out;
 	struct file_io_conf conf;
+
+	/* Buffer for input read in the input format,
+	 * and buffer for signal converted to sample_t.
+	 * buflen is their length, which is the configured buffer length
+	 * or the block length of compressed input if that is longer. */
+	void *inbuf;
+	sample_t *buf;
+	size_t buflen;
+
+	/* Compressed input and output, and a buffer for
+	 * output converted to a fixed-point or half-float format.
+	 * The buffer is sized for CS16, the largest of those. */
+	struct iqz_reader *iqz_in;
+	struct iqz_writer *iqz_out;
+	void *outbuf;
+
+	/* Memory-mapped input file and the position of
+	 * the next block to read from it (bytes) */
+	const char *map;
+	size_t map_size, map_pos;
+
+	/* I/O threads and the rings between them and the DSP thread.
+	 * in_held is set while the receiver is using a block
+	 * from the input ring. */
+	struct block_ring *in_ring, *out_ring;
+	pthread_t in_thread, out_thread;
+	bool in_started, out_started, in_held;
+	// Time the DSP thread has spent waiting for the I/O threads (ns)
+	long long in_stall, out_stall;
+
+	/* Real-time pacing: monotonic clock time when pacing started,
+	 * number of samples released since then, release time of the
+	 * latest block and statistics of how late processing of blocks
+	 * finished compared to their release times (ns) */
+	long long pace_start, pace_release, next_report;
+	uint64_t pace_samples;
+	long long lag_max, lag_sum;
+	unsigned long lag_n;
+
+	// Used to create receiver instances in batch mode
+	const void *receiver_conf;
+	const struct rx_output_code *rx_output;
+	void *rx_output_arg;
 };
 
 
+static size_t format_size(enum inputformat format)
+{
+	switch (format) {
+	case FORMAT_CU8:  return sizeof(cu8_t);
+	case FORMAT_CS8:  return sizeof(cs8_t);
+	case FORMAT_SC12: return sizeof(sc12_t);
+	case FORMAT_CF16: return sizeof(cf16_t);
+	case FORMAT_S16:  return sizeof(int16_t);
+	case FORMAT_F32:  return sizeof(float);
+	case FORMAT_CS16:
+	case FORMAT_IQZ:  return sizeof(cs16_t);
+	default:          return sizeof(sample_t);
+	}
+}
+
+
 static void *init(const void *conf)
 {
 	struct file_io *self;
@@ -25,6 +97,20 @@ static void *init(const void *conf)
 		return self;
 	self->conf = *(struct file_io_conf*)conf;
 
+	switch (self->conf.output_format) {
+	case FORMAT_CS16:
+	case FORMAT_CF32:
+	case FORMAT_IQZ:
+	case FORMAT_CS8:
+	case FORMAT_SC12:
+	case FORMAT_CF16:
+		break;
+	default:
+		fprintf(stderr, "Unsupported output format %u\n", self->conf.output_format);
+		free(self);
+		return NULL;
+	}
+
 	if (self->conf.input != NULL)
 		self->in = fopen(self->conf.input, "rb");
 	else
@@ -44,6 +130,10 @@ static void *init(const void *conf)
 static int destroy(void *arg)
 {
 	struct file_io *self = arg;
+	free(self->inbuf);
+	free(self->buf);
+	free(self->outbuf);
+	iqz_reader_close(self->iqz_in);
 	if (self->in)
 		fclose(self->in);
 	if (self->out)
@@ -62,49 +152,793 @@ static int set_callbacks(void *arg, const struct receiver_code *receiver, void *
 	return 0;
 }
 
-// TODO configuration for BUFLEN
-#define BUFLEN 4096
+
+static int set_receiver_conf(void *arg, const void *receiver_conf, const struct rx_output_code *rx_output, void *rx_output_arg)
+{
+	struct file_io *self = arg;
+	self->receiver_conf = receiver_conf;
+	self->rx_output = rx_output;
+	self->rx_output_arg = rx_output_arg;
+	return 0;
+}
+
+/* Map the whole input file into memory.
+ * Return -1 if it is not possible, e.g. if input is not a file. */
+static int map_input(struct file_io *self)
+{
+#ifndef _WIN32
+	struct stat st;
+	if (self->conf.input == NULL || fstat(fileno(self->in), &st) < 0 || !S_ISREG(st.st_mode)) {
+		fprintf(stderr, "Warning: input is not a regular file, not using mmap\n");
+		return -1;
+	}
+	if (st.st_size == 0)
+		return -1;
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(self->in), 0);
+	if (map == MAP_FAILED) {
+		perror("Warning: mmap failed");
+		return -1;
+	}
+	/* Tell the kernel the file will be read through once,
+	 * so it can read ahead aggressively */
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+	madvise(map, st.st_size, MADV_HUGEPAGE);
+#endif
+	self->map = map;
+	self->map_size = st.st_size;
+	self->map_pos = 0;
+	return 0;
+#else
+	(void)self;
+	fprintf(stderr, "Warning: mmap is not supported on this platform\n");
+	return -1;
+#endif
+}
+
+
+static void unmap_input(struct file_io *self)
+{
+#ifndef _WIN32
+	if (self->map != NULL)
+		munmap((void*)self->map, self->map_size);
+#endif
+	self->map = NULL;
+}
+
+
+/* Convert a block of input to sample_t into buf if it's not already.
+ * Real-valued input is converted to float instead.
+ * Return a pointer to the converted samples. */
+static const sample_t *convert_input(enum inputformat format, const void *in, sample_t *buf, size_t n)
+{
+	switch (format) {
+	case FORMAT_CU8:
+		cu8_to_cf(in, buf, n);
+		return buf;
+	case FORMAT_CS16:
+	case FORMAT_IQZ:
+		cs16_to_cf(in, buf, n);
+		return buf;
+	case FORMAT_CS8:
+		cs8_to_cf(in, buf, n);
+		return buf;
+	case FORMAT_SC12:
+		sc12_to_cf(in, buf, n);
+		return buf;
+	case FORMAT_CF16:
+		cf16_to_cf(in, buf, n);
+		return buf;
+	case FORMAT_S16:
+		s16_to_f_scale(in, (float *)buf, n, 1.0f / 0x8000);
+		return buf;
+	default:
+		return in;
+	}
+}
+
+
+/* Pass a block of converted input to a receiver.
+ * Real-valued input goes to execute_real if the receiver has one,
+ * otherwise it is converted to I/Q in buf. */
+static void run_receiver(const struct file_io *self, void *receiver_arg, const sample_t *samples, sample_t *buf, size_t n, timestamp_t time)
+{
+	const enum inputformat format = self->conf.format;
+	if (format != FORMAT_S16 && format != FORMAT_F32) {
+		self->receiver->execute(receiver_arg, samples, n, time);
+	} else if (self->receiver->execute_real != NULL) {
+		self->receiver->execute_real(receiver_arg, (const float *)samples, n, time);
+	} else {
+		f_to_cf((const float *)samples, buf, n);
+		self->receiver->execute(receiver_arg, buf, n, time);
+	}
+}
+
+
+/* Wait until a block of n samples would have been completely
+ * received if the signal was coming from a radio in real time */
+static void pace_wait(struct file_io *self, size_t n)
+{
+	self->pace_samples += n;
+	const long long release = self->pace_start
+		+ (long long)(1e9 * (double)self->pace_samples / self->conf.samplerate);
+	struct timespec t = { release / 1000000000LL, release % 1000000000LL };
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) == EINTR);
+	self->pace_release = release;
+}
+
+
+static void print_lag(struct file_io *self)
+{
+	if (self->lag_n == 0)
+		return;
+	fprintf(stderr, "Processing lag behind real time: average %.3f ms, max %.3f ms\n",
+		1e-6 * (double)self->lag_sum / (double)self->lag_n, 1e-6 * (double)self->lag_max);
+	self->lag_max = self->lag_sum = 0;
+	self->lag_n = 0;
+}
+
+
+/* Record how long after its release processing of a block finished.
+ * This is the latency the signal processing would add
+ * when receiving from a radio. */
+static void pace_done(struct file_io *self)
+{
+	const long long now = monotonic_ns();
+	const long long lag = now - self->pace_release;
+	if (lag > self->lag_max)
+		self->lag_max = lag;
+	self->lag_sum += lag;
+	self->lag_n++;
+	if (self->conf.report_interval > 0 && now >= self->next_report) {
+		print_lag(self);
+		self->next_report = now + (long long)(1e9 * self->conf.report_interval);
+	}
+}
+
+
+/* Get a block from a ring, keeping track of the time spent
+ * waiting if the I/O thread has not kept up */
+static struct ring_block *ring_get(struct block_ring *ring, bool write, long long *stall)
+{
+	struct ring_block *b;
+	b = write ? block_ring_write_get(ring, 0) : block_ring_read_get(ring, 0);
+	if (b != NULL || block_ring_closed(ring))
+		return b;
+	long long t = monotonic_ns();
+	b = write ? block_ring_write_get(ring, -1) : block_ring_read_get(ring, -1);
+	*stall += monotonic_ns() - t;
+	return b;
+}
+
+
+/* Write a block of TX signal in the output format */
+static void write_output(struct file_io *self, const sample_t *buf, size_t n, timestamp_t time)
+{
+	switch (self->conf.output_format) {
+	case FORMAT_CS16:
+		cf_to_cs16(buf, self->outbuf, n);
+		fwrite(self->outbuf, sizeof(cs16_t), n, self->out);
+		break;
+	case FORMAT_IQZ:
+		cf_to_cs16(buf, self->outbuf, n);
+		iqz_write(self->iqz_out, self->outbuf, n, time);
+		break;
+	case FORMAT_CS8:
+		cf_to_cs8(buf, self->outbuf, n);
+		fwrite(self->outbuf, sizeof(cs8_t), n, self->out);
+		break;
+	case FORMAT_SC12:
+		cf_to_sc12(buf, self->outbuf, n);
+		fwrite(self->outbuf, sizeof(sc12_t), n, self->out);
+		break;
+	case FORMAT_CF16:
+		cf_to_cf16(buf, self->outbuf, n);
+		fwrite(self->outbuf, sizeof(cf16_t), n, self->out);
+		break;
+	case FORMAT_CF32:
+		fwrite(buf, sizeof(sample_t), n, self->out);
+		break;
+	default:
+		// Other formats are rejected in init
+		break;
+	}
+}
+
+
+/* Input thread.
+ * Reads the input ahead into the ring, so that the DSP thread
+ * does not need to wait for the file or pipe. */
+static void *in_thread_main(void *arg)
+{
+	struct file_io *self = arg;
+	const size_t size = format_size(self->conf.format);
+	struct ring_block *b;
+	// The ring is closed from the other side if processing stops early
+	while (!block_ring_closed(self->in_ring)
+	&& (b = block_ring_write_get(self->in_ring, -1)) != NULL) {
+		if (self->iqz_in != NULL) {
+			// Decompress here so that it does not load the DSP thread
+			ssize_t n = iqz_read(self->iqz_in, b->data, &b->time);
+			b->len = n > 0 ? n : 0;
+		} else {
+			b->len = fread(b->data, size, self->conf.buffer, self->in);
+		}
+		if (b->len == 0)
+			break;
+		block_ring_write_put(self->in_ring);
+	}
+	block_ring_close(self->in_ring);
+	return NULL;
+}
+
+
+/* Output thread.
+ * Writes the blocks produced by the DSP thread until the ring
+ * has been closed and emptied. */
+static void *out_thread_main(void *arg)
+{
+	struct file_io *self = arg;
+	struct ring_block *b;
+	while ((b = block_ring_read_get(self->out_ring, -1)) != NULL) {
+		write_output(self, b->data, b->len, b->time);
+		block_ring_read_put(self->out_ring);
+	}
+	fflush(self->out);
+	return NULL;
+}
+
+
+static int start_io_threads(struct file_io *self, bool input, bool output)
+{
+	const struct file_io_conf *const conf = &self->conf;
+	int ret;
+	if (input) {
+		self->in_ring = block_ring_init(conf->io_buffers, format_size(conf->format) * self->buflen);
+		if (self->in_ring == NULL)
+			return -1;
+		ret = pthread_create(&self->in_thread, NULL, in_thread_main, self);
+		if (ret != 0) {
+			fprintf(stderr, "Failed to create input thread: %s\n", strerror(ret));
+			return -1;
+		}
+		self->in_started = 1;
+	}
+	if (output) {
+		self->out_ring = block_ring_init(conf->io_buffers, sizeof(sample_t) * self->buflen);
+		if (self->out_ring == NULL)
+			return -1;
+		ret = pthread_create(&self->out_thread, NULL, out_thread_main, self);
+		if (ret != 0) {
+			fprintf(stderr, "Failed to create output thread: %s\n", strerror(ret));
+			return -1;
+		}
+		self->out_started = 1;
+	}
+	return 0;
+}
+
+
+static void stop_io_threads(struct file_io *self)
+{
+	if (self->in_ring != NULL)
+		block_ring_close(self->in_ring);
+	if (self->out_ring != NULL)
+		block_ring_close(self->out_ring);
+	if (self->in_started)
+		pthread_join(self->in_thread, NULL);
+	if (self->out_started)
+		pthread_join(self->out_thread, NULL);
+	self->in_started = self->out_started = 0;
+	block_ring_destroy(self->in_ring);
+	block_ring_destroy(self->out_ring);
+	self->in_ring = self->out_ring = NULL;
+}
+
+
+/* Read the next block of input signal.
+ * Return the number of samples and a pointer to them in *samples.
+ * With a memory-mapped CF32 file, the pointer points straight
+ * to the mapping and the samples are not copied at all.
+ * Compressed input has timestamps, which are returned in *time.
+ * Return 0 at the end of input. */
+static size_t read_input(struct file_io *self, const sample_t **samples, timestamp_t *time)
+{
+	const size_t size = format_size(self->conf.format);
+	size_t n;
+	if (self->map != NULL) {
+		n = (self->map_size - self->map_pos) / size;
+		if (n > self->conf.buffer)
+			n = self->conf.buffer;
+		if (n == 0)
+			return 0;
+		*samples = convert_input(self->conf.format, self->map + self->map_pos, self->buf, n);
+		self->map_pos += n * size;
+	} else if (self->in_ring != NULL) {
+		// Release the block the receiver got last time
+		if (self->in_held)
+			block_ring_read_put(self->in_ring);
+		struct ring_block *b = ring_get(self->in_ring, 0, &self->in_stall);
+		self->in_held = b != NULL;
+		if (b == NULL)
+			return 0;
+		n = b->len;
+		if (self->iqz_in != NULL)
+			*time = b->time;
+		*samples = convert_input(self->conf.format, b->data, self->buf, n);
+	} else if (self->iqz_in != NULL) {
+		ssize_t r = iqz_read(self->iqz_in, self->inbuf, time);
+		if (r <= 0)
+			return 0;
+		n = r;
+		*samples = convert_input(self->conf.format, self->inbuf, self->buf, n);
+	} else {
+		void *in = self->conf.format == FORMAT_CF32 || self->conf.format == FORMAT_F32
+			? (void*)self->buf : self->inbuf;
+		n = fread(in, size, self->conf.buffer, self->in);
+		if (n == 0)
+			return 0;
+		*samples = convert_input(self->conf.format, in, self->buf, n);
+	}
+	return n;
+}
+
+
+/* Seek the input to the configured time.
+ * Return the number of the sample seeked to. */
+static uint64_t seek_input(struct file_io *self)
+{
+	const timestamp_t time = 1e9 * self->conf.seek;
+	if (self->iqz_in != NULL) {
+		// Timestamps come from the file after this
+		if (iqz_seek(self->iqz_in, time) < 0)
+			fprintf(stderr, "Warning: cannot seek compressed input without an index\n");
+		return 0;
+	}
+	const size_t size = format_size(self->conf.format);
+	const uint64_t sample = self->conf.seek * self->conf.samplerate;
+	if (self->map != NULL) {
+		self->map_pos = sample * size < self->map_size ? sample * size : self->map_size;
+	} else if (fseeko(self->in, (off_t)(sample * size), SEEK_SET) < 0) {
+		perror("Warning: cannot seek input");
+		return 0;
+	}
+	return sample;
+}
+
+
+/* -------------------------------------------
+ * Batch mode: process a file in parallel chunks
+ * -------------------------------------------
+ *
+ * The file is split into chunks of batch_chunk samples.
+ * Each chunk is processed by a new receiver instance in one of
+ * the worker threads, starting batch_overlap samples before the
+ * chunk so that frames crossing the chunk boundary get received
+ * completely. Frames are collected per chunk and, once a chunk and
+ * the next one are done, passed to the RX output in timestamp order.
+ * Frames received from the overlap by both chunks are passed once.
+ */
+
+struct batch_chunk {
+	// Sample index where the chunk begins, not including the overlap
+	uint64_t begin;
+	// Received frames, in the order they were received
+	struct frame **frames;
+	size_t nframes, maxframes;
+	bool done;
+};
+
+struct batch {
+	struct file_io *io;
+	uint64_t total; // Number of samples in the file
+	struct batch_chunk *chunks;
+	size_t nchunks, next_chunk;
+	pthread_mutex_t lock;
+	pthread_cond_t done_cond;
+};
+
+struct batch_worker {
+	struct batch *batch;
+	struct batch_chunk *chunk; // Chunk being processed
+	pthread_t thread;
+	bool started;
+};
+
+
+static timestamp_t sample_time(struct file_io *self, uint64_t sample)
+{
+	return 1e9 * (double)sample / self->conf.samplerate;
+}
+
+
+static int chunk_add_frame(struct batch_chunk *c, struct frame *f)
+{
+	if (c->nframes >= c->maxframes) {
+		size_t max = c->maxframes ? 2 * c->maxframes : 16;
+		struct frame **frames = realloc(c->frames, max * sizeof(struct frame *));
+		if (frames == NULL)
+			return -1;
+		c->frames = frames;
+		c->maxframes = max;
+	}
+	c->frames[c->nframes++] = f;
+	return 0;
+}
+
+
+// RX output callback to collect frames from a chunk
+static int batch_frame(void *arg, const struct frame *frame)
+{
+	struct batch_chunk *c = ((struct batch_worker *)arg)->chunk;
+	const size_t size = sizeof(struct frame) + frame->m.len;
+	struct frame *f = malloc(size);
+	if (f == NULL)
+		return -1;
+	memcpy(f, frame, size);
+	if (chunk_add_frame(c, f) < 0) {
+		free(f);
+		return -1;
+	}
+	return 0;
+}
+
+
+// Ticks are passed to the RX output in the order of chunks instead
+static int batch_tick(void *arg, timestamp_t timenow)
+{
+	(void)arg; (void)timenow;
+	return 0;
+}
+
+
+static const struct rx_output_code batch_output_code = { "file_io_batch", NULL, NULL, NULL, NULL, NULL, batch_frame, batch_tick };
+
+
+/* Run a new receiver instance through a chunk.
+ * Return -1 on failure. */
+static int batch_process_chunk(struct batch_worker *w, FILE *f, void *inbuf, sample_t *buf)
+{
+	struct batch *b = w->batch;
+	struct file_io *self = b->io;
+	const struct file_io_conf *const conf = &self->conf;
+	const size_t size = format_size(conf->format);
+	const struct batch_chunk *c = w->chunk;
+
+	uint64_t pos = c->begin > conf->batch_overlap ? c->begin - conf->batch_overlap : 0;
+	uint64_t end = c->begin + conf->batch_chunk;
+	if (end > b->total)
+		end = b->total;
+
+	void *receiver_arg = self->receiver->init(self->receiver_conf);
+	if (receiver_arg == NULL)
+		return -1;
+	self->receiver->set_callbacks(receiver_arg, &batch_output_code, w);
+
+	int ret = 0;
+	if (fseeko(f, (off_t)(pos * size), SEEK_SET) < 0) {
+		perror("Batch: seek failed");
+		ret = -1;
+	}
+	while (ret == 0 && pos < end) {
+		size_t n = conf->buffer;
+		if (n > end - pos)
+			n = end - pos;
+		n = fread(inbuf, size, n, f);
+		if (n == 0)
+			break;
+		const sample_t *samples = convert_input(conf->format, inbuf, buf, n);
+		run_receiver(self, receiver_arg, samples, buf, n, sample_time(self, pos));
+		pos += n;
+	}
+
+	self->receiver->destroy(receiver_arg);
+	return ret;
+}
+
+
+static void *batch_worker_main(void *arg)
+{
+	struct batch_worker *w = arg;
+	struct batch *b = w->batch;
+	const struct file_io_conf *const conf = &b->io->conf;
+
+	FILE *f = fopen(conf->input, "rb");
+	void *inbuf = malloc(format_size(conf->format) * conf->buffer);
+	sample_t *buf = malloc(sizeof(sample_t) * conf->buffer);
+	if (f == NULL)
+		perror("Batch: failed to open input");
+
+	for (;;) {
+		pthread_mutex_lock(&b->lock);
+		size_t k = b->next_chunk++;
+		pthread_mutex_unlock(&b->lock);
+		if (k >= b->nchunks)
+			break;
+
+		w->chunk = &b->chunks[k];
+		if (f == NULL || inbuf == NULL || buf == NULL
+		|| batch_process_chunk(w, f, inbuf, buf) < 0)
+			fprintf(stderr, "Batch: failed to process chunk %zu\n", k);
+
+		// The main thread waits for chunks to be done in order
+		pthread_mutex_lock(&b->lock);
+		w->chunk->done = 1;
+		pthread_cond_broadcast(&b->done_cond);
+		pthread_mutex_unlock(&b->lock);
+	}
+
+	if (f != NULL)
+		fclose(f);
+	free(inbuf);
+	free(buf);
+	return NULL;
+}
+
+
+static bool same_frame(const struct frame *a, const struct frame *b, timestamp_t tolerance)
+{
+	int64_t dt = (int64_t)(a->m.time - b->m.time);
+	return (dt <= (int64_t)tolerance && dt >= -(int64_t)tolerance)
+	    && a->m.len == b->m.len
+	    && memcmp(a->data, b->data, a->m.len) == 0;
+}
+
+
+static int compare_frame_time(const void *a, const void *b)
+{
+	const struct frame *fa = *(struct frame *const *)a;
+	const struct frame *fb = *(struct frame *const *)b;
+	if (fa->m.time != fb->m.time)
+		return fa->m.time < fb->m.time ? -1 : 1;
+	// Keep the received order for equal timestamps
+	return fa < fb ? -1 : (fa > fb);
+}
+
+
+/* Pass frames of a chunk to the RX output, together with the frames
+ * of the next chunk which are timestamped before the next chunk begins.
+ * Drop frames from the next chunk that were already received by this one. */
+static void batch_emit(struct batch *b, struct batch_chunk *c, struct batch_chunk *next)
+{
+	struct file_io *self = b->io;
+	const timestamp_t tolerance = 1e9 * self->conf.batch_tolerance;
+	size_t i, j;
+	const size_t n = c->nframes;
+
+	if (next != NULL) {
+		const timestamp_t next_begin = sample_time(self, next->begin);
+		size_t kept = 0;
+		for (i = 0; i < next->nframes; i++) {
+			struct frame *f = next->frames[i];
+			bool dup = 0, early = f->m.time < next_begin;
+			if (f->m.time < next_begin + tolerance) {
+				for (j = 0; j < n && !dup; j++)
+					dup = same_frame(f, c->frames[j], tolerance);
+			}
+			if (dup) {
+				free(f);
+			} else if (early) {
+				// Move to this chunk to be passed in order
+				if (chunk_add_frame(c, f) < 0)
+					free(f);
+			} else {
+				next->frames[kept++] = f;
+			}
+		}
+		next->nframes = kept;
+	}
+
+	qsort(c->frames, c->nframes, sizeof(struct frame *), compare_frame_time);
+	for (i = 0; i < c->nframes; i++) {
+		self->rx_output->frame(self->rx_output_arg, c->frames[i]);
+		free(c->frames[i]);
+	}
+	free(c->frames);
+	c->frames = NULL;
+	c->nframes = c->maxframes = 0;
+
+	if (self->rx_output->tick != NULL) {
+		uint64_t end = c->begin + self->conf.batch_chunk;
+		self->rx_output->tick(self->rx_output_arg, sample_time(self, end < b->total ? end : b->total));
+	}
+}
+
+
+static int execute_batch(struct file_io *self)
+{
+	const struct file_io_conf *const conf = &self->conf;
+	const unsigned nthreads = conf->batch_threads;
+	struct batch b = { .io = self };
+	struct batch_worker *workers = NULL;
+	unsigned i;
+	size_t k;
+	int ret = -1;
+
+	if (self->receiver == NULL || self->receiver_conf == NULL || self->rx_output == NULL) {
+		fprintf(stderr, "Batch mode needs a receiver and an RX output\n");
+		return -1;
+	}
+	if (conf->input == NULL || conf->batch_chunk == 0) {
+		fprintf(stderr, "Batch mode needs an input file\n");
+		return -1;
+	}
+	if (conf->format == FORMAT_IQZ) {
+		fprintf(stderr, "Batch mode does not support compressed input\n");
+		return -1;
+	}
+	if (self->transmitter != NULL)
+		fprintf(stderr, "Warning: TX is not used in batch mode\n");
+
+	if (fseeko(self->in, 0, SEEK_END) < 0) {
+		perror("Batch: input is not seekable");
+		return -1;
+	}
+	b.total = ftello(self->in) / format_size(conf->format);
+	b.nchunks = (b.total + conf->batch_chunk - 1) / conf->batch_chunk;
+	b.chunks = calloc(b.nchunks, sizeof(struct batch_chunk));
+	workers = calloc(nthreads, sizeof(struct batch_worker));
+	if ((b.chunks == NULL && b.nchunks > 0) || workers == NULL)
+		goto exit;
+	for (k = 0; k < b.nchunks; k++)
+		b.chunks[k].begin = (uint64_t)k * conf->batch_chunk;
+	pthread_mutex_init(&b.lock, NULL);
+	pthread_cond_init(&b.done_cond, NULL);
+
+	fprintf(stderr, "Processing %zu chunks in %u threads\n", b.nchunks, nthreads);
+	for (i = 0; i < nthreads; i++) {
+		workers[i].batch = &b;
+		if (pthread_create(&workers[i].thread, NULL, batch_worker_main, &workers[i]) != 0) {
+			fprintf(stderr, "Failed to create batch worker thread\n");
+			break;
+		}
+		workers[i].started = 1;
+	}
+
+	if (i > 0) {
+		for (k = 0; k < b.nchunks; k++) {
+			struct batch_chunk *next = k + 1 < b.nchunks ? &b.chunks[k + 1] : NULL;
+			pthread_mutex_lock(&b.lock);
+			while (!b.chunks[k].done || (next != NULL && !next->done))
+				pthread_cond_wait(&b.done_cond, &b.lock);
+			pthread_mutex_unlock(&b.lock);
+			batch_emit(&b, &b.chunks[k], next);
+		}
+		ret = 0;
+	} else {
+		// No workers, so nothing will take the remaining chunks
+		b.next_chunk = b.nchunks;
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		if (workers[i].started)
+			pthread_join(workers[i].thread, NULL);
+	}
+	pthread_mutex_destroy(&b.lock);
+	pthread_cond_destroy(&b.done_cond);
+exit:
+	free(workers);
+	free(b.chunks);
+	return ret;
+}
+
 
 static int execute(void *arg)
 {
 	struct file_io *self = arg;
-	enum inputformat inputformat = self->conf.format;
+	size_t buflen = self->conf.buffer;
 	timestamp_t timestamp = 0, tx_latency_time = 0;
-	sample_t buf2[BUFLEN];
+	// Number of samples from the beginning of input
+	uint64_t pos = 0;
+	int ret = 0;
 
 	if (self->in == NULL)
 		return -1;
+	if (self->conf.batch_threads > 0)
+		return execute_batch(self);
+	if (self->conf.buffer == 0)
+		return -1;
+	if (self->conf.format == FORMAT_IQZ && self->receiver != NULL) {
+		self->iqz_in = iqz_reader_open(self->in);
+		if (self->iqz_in == NULL)
+			return -1;
+		if (iqz_block_len(self->iqz_in) > buflen)
+			buflen = iqz_block_len(self->iqz_in);
+	}
+	self->buflen = buflen;
+	self->inbuf = malloc(format_size(self->conf.format) * buflen);
+	self->buf = malloc(sizeof(sample_t) * buflen);
+	self->outbuf = malloc(sizeof(cs16_t) * buflen);
+	if (self->inbuf == NULL || self->buf == NULL || self->outbuf == NULL)
+		return -1;
+	if (self->transmitter != NULL && self->conf.output_format == FORMAT_IQZ) {
+		self->iqz_out = iqz_writer_open(self->out, IQZ_BLOCK, self->conf.samplerate);
+		if (self->iqz_out == NULL)
+			return -1;
+	}
+	if (self->conf.mmap && self->receiver != NULL && self->iqz_in == NULL)
+		map_input(self);
+	if (self->receiver != NULL && self->conf.seek > 0)
+		pos = seek_input(self);
+	/* Compressed input is always decompressed in the input thread */
+	if (self->conf.io_thread || self->iqz_in != NULL) {
+		if (start_io_threads(self,
+			self->receiver != NULL && self->map == NULL,
+			self->transmitter != NULL && self->conf.io_thread) < 0) {
+			ret = -1;
+			goto exit;
+		}
+	}
+	const long long start_time = monotonic_ns();
+	self->pace_start = start_time;
+	self->next_report = start_time + (long long)(1e9 * self->conf.report_interval);
+	/* Offset added to the timestamps, so that they
+	 * begin from the current time if wallclock is set */
+	timestamp_t time_offset = 0;
+	bool first = 1;
+
 	for(;;) {
-		size_t n = BUFLEN;
+		size_t n = buflen;
+		const sample_t *samples = NULL;
+		/* Timestamps are computed from the sample count
+		 * in the same way as in batch mode, so that they do not
+		 * accumulate rounding errors. Compressed input
+		 * replaces them by timestamps from the file. */
+		timestamp = sample_time(self, pos);
 		if (self->receiver != NULL) {
-			if(inputformat == FORMAT_CU8) {
-				cu8_t buf1[BUFLEN];
-				n = fread(buf1, sizeof(cu8_t), BUFLEN, self->in);
-				if(n == 0) break;
-				cu8_to_cf(buf1, buf2, n);
-			} else if(inputformat == FORMAT_CS16) {
-				cs16_t buf1[BUFLEN];
-				n = fread(buf1, sizeof(cs16_t), BUFLEN, self->in);
-				if(n == 0) break;
-				cs16_to_cf(buf1, buf2, n);
-			} else {
-				n = fread(buf2, sizeof(sample_t), BUFLEN, self->in);
-				if(n == 0) break;
-			}
-			self->receiver->execute(self->receiver_arg, buf2, n, timestamp);
+			n = read_input(self, &samples, &timestamp);
+			if (n == 0) break;
 		}
+		if (first && self->conf.wallclock)
+			time_offset = realtime_ns() - timestamp;
+		first = 0;
+		if (self->conf.realtime)
+			pace_wait(self, n);
+
+		if (self->receiver != NULL)
+			run_receiver(self, self->receiver_arg, samples, self->buf, n, timestamp + time_offset);
 
 		if (self->transmitter != NULL) {
-			assert(n <= BUFLEN);
+			assert(n <= buflen);
 			tx_return_t tr;
-			tr = self->transmitter->execute(self->transmitter_arg, buf2, n, timestamp + tx_latency_time);
-			fwrite(buf2, sizeof(sample_t), tr.len, self->out);
+			if (self->out_ring != NULL) {
+				/* Generate straight into a block that
+				 * the output thread then writes */
+				struct ring_block *b = ring_get(self->out_ring, 1, &self->out_stall);
+				if (b == NULL) break;
+				tr = self->transmitter->execute(self->transmitter_arg, b->data, n, timestamp + time_offset + tx_latency_time);
+				b->len = tr.len;
+				b->time = timestamp + time_offset + tx_latency_time;
+				block_ring_write_put(self->out_ring);
+			} else {
+				tr = self->transmitter->execute(self->transmitter_arg, self->buf, n, timestamp + time_offset + tx_latency_time);
+				write_output(self, self->buf, tr.len, timestamp + time_offset + tx_latency_time);
+			}
 		}
+		if (self->conf.realtime)
+			pace_done(self);
 
-		timestamp += 1e9 * n / self->conf.samplerate;
+		pos += n;
 	}
 
-	return 0;
+	if (self->conf.io_thread || self->iqz_in != NULL) {
+		/* Stall time shows whether the DSP or the I/O is the bottleneck.
+		 * If the DSP thread rarely waits, DSP is the bottleneck. */
+		fprintf(stderr, "Processing took %.3f s, waited %.3f s for input and %.3f s for output\n",
+			1e-9 * (double)(monotonic_ns() - start_time),
+			1e-9 * (double)self->in_stall, 1e-9 * (double)self->out_stall);
+	}
+	if (self->conf.realtime)
+		print_lag(self);
+exit:
+	self->in_held = 0;
+	stop_io_threads(self);
+	unmap_input(self);
+	if (self->iqz_out != NULL) {
+		iqz_writer_close(self->iqz_out);
+		self->iqz_out = NULL;
+	}
+	return ret;
 }
 
 
@@ -112,7 +946,20 @@ const struct file_io_conf file_io_defaults = {
 	.samplerate = 1e6,
 	.input = NULL,
 	.output = NULL,
-	.format = 1
+	.format = 1,
+	.buffer = 4096,
+	.mmap = 0,
+	.io_thread = 0,
+	.io_buffers = 4,
+	.batch_threads = 0,
+	.batch_chunk = 10000000,
+	.batch_overlap = 100000,
+	.batch_tolerance = 1e-3,
+	.output_format = 2,
+	.seek = 0,
+	.realtime = 0,
+	.wallclock = 0,
+	.report_interval = 10
 };
 
 CONFIG_BEGIN(file_io)
@@ -120,7 +967,20 @@ CONFIG_F(samplerate)
 CONFIG_C(input)
 CONFIG_C(output)
 CONFIG_I(format)
+CONFIG_I(output_format)
+CONFIG_F(seek)
+CONFIG_I(realtime)
+CONFIG_I(wallclock)
+CONFIG_F(report_interval)
+CONFIG_I(buffer)
+CONFIG_I(mmap)
+CONFIG_I(io_thread)
+CONFIG_I(io_buffers)
+CONFIG_I(batch_threads)
+CONFIG_I(batch_chunk)
+CONFIG_I(batch_overlap)
+CONFIG_F(batch_tolerance)
 CONFIG_END()
 
 
-const struct signal_io_code file_io_code = { "file_io", init, destroy, init_conf, set_conf, set_callbacks, execute };
+const struct signal_io_code file_io_code = { "file_io", init, destroy, init_conf, set_conf, set_callbacks, execute, set_receiver_conf };
@@ -9,8 +9,55 @@ struct file_io_conf {
 	const char *input;
 	// File name for output file containing transmitted signal
 	const char *output;
-	// Data format
+	/* Data format of input:
+	 * 0 = CU8, 1 = CS16, 2 = CF32,
+	 * 3 = compressed CS16 (see iq_compress.h),
+	 * 4 = CS8, 5 = packed 12-bit, 6 = CF16 (see conversion.h),
+	 * 7 = mono S16, 8 = mono F32.
+	 * Mono formats are real-valued and go to the execute_real
+	 * function of the receiver if it has one. */
 	unsigned format;
+	/* Data format of output: 1 = CS16, 2 = CF32, 3 = compressed CS16,
+	 * 4 = CS8, 5 = packed 12-bit, 6 = CF16 */
+	unsigned output_format;
+	/* Start reading input from this time (seconds).
+	 * With compressed input, this is compared to the timestamps
+	 * stored in the file. Otherwise input begins from time 0. */
+	double seek;
+	// Number of samples processed at a time
+	unsigned buffer;
+	/* Memory-map the input file instead of reading it.
+	 * Avoids copying when the format is CF32 (2).
+	 * Only works with regular files, not with stdin. */
+	unsigned char mmap:1;
+	/* Read input and write output in separate threads,
+	 * so that the DSP thread does not wait for the files */
+	unsigned char io_thread:1;
+	// Number of buffers between the I/O threads and the DSP thread
+	unsigned io_buffers;
+	/* Process the signal at the sample rate instead of as fast
+	 * as possible, as if it was coming from a radio */
+	unsigned char realtime:1;
+	// Make timestamps begin from the current wall-clock time
+	unsigned char wallclock:1;
+	/* Interval for reporting how much processing lags behind
+	 * real time in realtime mode (seconds). 0 only reports at the end. */
+	double report_interval;
+	/* Number of worker threads for batch mode.
+	 * In batch mode, the input file is split into chunks which
+	 * are processed in parallel by separate receiver instances.
+	 * 0 processes the file sequentially. */
+	unsigned batch_threads;
+	// Number of samples in a chunk in batch mode
+	unsigned batch_chunk;
+	/* Number of samples processed before the beginning of each chunk.
+	 * Should cover the longest frame together with filter delays
+	 * and synchronization time of the receiver. */
+	unsigned batch_overlap;
+	/* Frames with the same data received from the overlap by two
+	 * chunks are considered the same frame if their timestamps
+	 * differ by less than this (seconds) */
+	double batch_tolerance;
 };
 
 extern const struct file_io_conf file_io_defaults;
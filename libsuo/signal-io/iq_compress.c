@@ -0,0 +1,501 @@
+#include "iq_compress.h"
+#include <string.h>
+
+/* File layout:
+ *   Header:  "SUOIQZ1\0", u32 block length, u32 flags (0),
+ *            f64 sample rate
+ *   Blocks:  u32 number of samples, u32 payload bytes, u64 timestamp,
+ *            payload
+ *   Index:   u64 timestamp, u64 file offset for each block
+ *   Trailer: u64 number of blocks, u64 index offset, "SUOIQIDX"
+ *
+ * Payload begins with the coding mode and the Rice parameter.
+ * Values are coded in the order I0 Q0 I1 Q1 ... */
+
+static const char file_magic[8] = "SUOIQZ1";
+static const char index_magic[8] = "SUOIQIDX";
+
+#define HEADER_SIZE 24
+#define BLOCK_HEADER_SIZE 16
+#define TRAILER_SIZE 24
+
+enum { MODE_RICE = 0, MODE_RAW = 1 };
+
+/* A quotient this large is escaped and followed by the value in
+ * ESCAPE_BITS bits. Keeps the code length bounded for outliers. */
+#define ESCAPE 16
+#define ESCAPE_BITS 17
+#define MAX_K 16
+
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+	int i;
+	for (i = 0; i < 4; i++)
+		p[i] = v >> (8*i);
+}
+
+
+static void put_u64(uint8_t *p, uint64_t v)
+{
+	int i;
+	for (i = 0; i < 8; i++)
+		p[i] = v >> (8*i);
+}
+
+
+static uint32_t get_u32(const uint8_t *p)
+{
+	return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+
+static uint64_t get_u64(const uint8_t *p)
+{
+	return get_u32(p) | (uint64_t)get_u32(p + 4) << 32;
+}
+
+
+/* --------------
+ * Block coding
+ * -------------- */
+
+// Map signed deltas to unsigned values: 0, -1, 1, -2, 2...
+static inline uint32_t zigzag(int32_t v)
+{
+	return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+
+static inline int32_t unzigzag(uint32_t u)
+{
+	return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+}
+
+
+struct bit_writer {
+	uint8_t *p;
+	uint64_t acc;
+	int n;
+};
+
+
+static inline void put_bits(struct bit_writer *w, uint32_t v, int nbits)
+{
+	w->acc = (w->acc << nbits) | v;
+	w->n += nbits;
+	while (w->n >= 8) {
+		w->n -= 8;
+		*w->p++ = w->acc >> w->n;
+	}
+}
+
+
+struct bit_reader {
+	const uint8_t *p, *end;
+	// Bits not consumed yet, aligned to the most significant bit
+	uint64_t buf;
+	int n;
+};
+
+
+static inline void refill(struct bit_reader *r)
+{
+	while (r->n <= 56) {
+		uint64_t byte = r->p < r->end ? *r->p : 0;
+		r->p++;
+		r->buf |= byte << (56 - r->n);
+		r->n += 8;
+	}
+}
+
+
+static inline uint32_t get_bits(struct bit_reader *r, int nbits)
+{
+	if (nbits == 0)
+		return 0;
+	uint32_t v = r->buf >> (64 - nbits);
+	r->buf <<= nbits;
+	r->n -= nbits;
+	return v;
+}
+
+
+size_t iqz_max_size(size_t n)
+{
+	return 2 + 2 * n * sizeof(int16_t);
+}
+
+
+size_t iqz_encode(const cs16_t *in, size_t n, uint8_t *out)
+{
+	const int16_t *x = (const int16_t *)in;
+	size_t i;
+	uint64_t sum = 0;
+	int k = 0;
+
+	// Choose the Rice parameter from the mean of the deltas
+	int32_t prev[2] = { 0, 0 };
+	for (i = 0; i < 2*n; i++) {
+		sum += zigzag(x[i] - prev[i & 1]);
+		prev[i & 1] = x[i];
+	}
+	while (k < MAX_K && ((uint64_t)(2*n) << (k + 1)) < sum)
+		k++;
+
+	struct bit_writer w = { out + 2, 0, 0 };
+	uint8_t *const raw_end = out + iqz_max_size(n);
+	prev[0] = prev[1] = 0;
+	for (i = 0; i < 2*n; i++) {
+		uint32_t u = zigzag(x[i] - prev[i & 1]);
+		prev[i & 1] = x[i];
+		uint32_t q = u >> k;
+		if (q < ESCAPE) {
+			put_bits(&w, (2u << q) - 2, q + 1);
+			put_bits(&w, u & ((1u << k) - 1), k);
+		} else {
+			put_bits(&w, (1u << ESCAPE) - 1, ESCAPE);
+			put_bits(&w, u, ESCAPE_BITS);
+		}
+		// Give up if it does not compress
+		if (w.p + 8 >= raw_end)
+			break;
+	}
+	if (i == 2*n) {
+		if (w.n > 0)
+			*w.p++ = w.acc << (8 - w.n);
+		out[0] = MODE_RICE;
+		out[1] = k;
+		return w.p - out;
+	}
+
+	out[0] = MODE_RAW;
+	out[1] = 0;
+	for (i = 0; i < 2*n; i++) {
+		out[2 + 2*i] = x[i];
+		out[3 + 2*i] = (uint16_t)x[i] >> 8;
+	}
+	return iqz_max_size(n);
+}
+
+
+int iqz_decode(const uint8_t *in, size_t nbytes, cs16_t *out, size_t n)
+{
+	int16_t *x = (int16_t *)out;
+	size_t i;
+	if (nbytes < 2)
+		return -1;
+
+	if (in[0] == MODE_RAW) {
+		if (nbytes < iqz_max_size(n))
+			return -1;
+		for (i = 0; i < 2*n; i++)
+			x[i] = (int16_t)(in[2 + 2*i] | in[3 + 2*i] << 8);
+		return 0;
+	}
+	if (in[0] != MODE_RICE || in[1] > MAX_K)
+		return -1;
+
+	const int k = in[1];
+	struct bit_reader r = { in + 2, in + nbytes, 0, 0 };
+	int32_t prev[2] = { 0, 0 };
+	for (i = 0; i < 2*n; i++) {
+		refill(&r);
+		// Count the ones before a zero, at most ESCAPE
+		int q = __builtin_clzll(~r.buf | (1ULL << (63 - ESCAPE)));
+		uint32_t u;
+		if (q < ESCAPE) {
+			get_bits(&r, q + 1);
+			u = ((uint32_t)q << k) | get_bits(&r, k);
+		} else {
+			get_bits(&r, ESCAPE);
+			u = get_bits(&r, ESCAPE_BITS);
+		}
+		prev[i & 1] += unzigzag(u);
+		x[i] = prev[i & 1];
+	}
+	// Check that the data did not run out
+	if ((size_t)(r.p - in) * 8 - r.n > nbytes * 8)
+		return -1;
+	return 0;
+}
+
+
+/* --------------
+ * Writing files
+ * -------------- */
+
+struct iqz_index_entry {
+	timestamp_t time;
+	uint64_t offset;
+};
+
+struct iqz_writer {
+	FILE *f;
+	double samplerate;
+	// Samples collected for the next block
+	cs16_t *block;
+	size_t block_len, n;
+	timestamp_t block_time;
+	uint8_t *payload;
+	// Number of bytes written so far
+	uint64_t pos;
+	struct iqz_index_entry *index;
+	size_t nblocks, maxblocks;
+};
+
+
+struct iqz_writer *iqz_writer_open(FILE *f, size_t block_len, double samplerate)
+{
+	struct iqz_writer *w = calloc(1, sizeof(*w));
+	if (w == NULL)
+		return NULL;
+	w->f = f;
+	w->samplerate = samplerate;
+	w->block_len = block_len > 0 ? block_len : IQZ_BLOCK;
+	w->block = malloc(sizeof(cs16_t) * w->block_len);
+	w->payload = malloc(BLOCK_HEADER_SIZE + iqz_max_size(w->block_len));
+	if (w->block == NULL || w->payload == NULL)
+		goto fail;
+
+	uint8_t header[HEADER_SIZE];
+	memcpy(header, file_magic, 8);
+	put_u32(header + 8, w->block_len);
+	put_u32(header + 12, 0);
+	uint64_t sr;
+	memcpy(&sr, &samplerate, 8);
+	put_u64(header + 16, sr);
+	if (fwrite(header, HEADER_SIZE, 1, f) != 1)
+		goto fail;
+	w->pos = HEADER_SIZE;
+	return w;
+
+fail:
+	free(w->block);
+	free(w->payload);
+	free(w);
+	return NULL;
+}
+
+
+static int write_block(struct iqz_writer *w)
+{
+	if (w->n == 0)
+		return 0;
+	if (w->nblocks >= w->maxblocks) {
+		size_t max = w->maxblocks ? 2 * w->maxblocks : 256;
+		struct iqz_index_entry *index = realloc(w->index, max * sizeof(*index));
+		if (index == NULL)
+			return -1;
+		w->index = index;
+		w->maxblocks = max;
+	}
+	w->index[w->nblocks++] = (struct iqz_index_entry){ w->block_time, w->pos };
+
+	size_t nbytes = iqz_encode(w->block, w->n, w->payload + BLOCK_HEADER_SIZE);
+	put_u32(w->payload, w->n);
+	put_u32(w->payload + 4, nbytes);
+	put_u64(w->payload + 8, w->block_time);
+	nbytes += BLOCK_HEADER_SIZE;
+	w->n = 0;
+	if (fwrite(w->payload, nbytes, 1, w->f) != 1)
+		return -1;
+	w->pos += nbytes;
+	return 0;
+}
+
+
+int iqz_write(struct iqz_writer *w, const cs16_t *samples, size_t n, timestamp_t time)
+{
+	while (n > 0) {
+		if (w->n == 0)
+			w->block_time = time;
+		size_t len = w->block_len - w->n;
+		if (len > n)
+			len = n;
+		memcpy(w->block + w->n, samples, sizeof(cs16_t) * len);
+		w->n += len;
+		samples += len;
+		n -= len;
+		time += 1e9 * (double)len / w->samplerate;
+		if (w->n == w->block_len && write_block(w) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+
+int iqz_writer_close(struct iqz_writer *w)
+{
+	int ret = write_block(w);
+	size_t i;
+
+	uint8_t entry[16];
+	const uint64_t index_pos = w->pos;
+	for (i = 0; i < w->nblocks && ret == 0; i++) {
+		put_u64(entry, w->index[i].time);
+		put_u64(entry + 8, w->index[i].offset);
+		if (fwrite(entry, 16, 1, w->f) != 1)
+			ret = -1;
+	}
+	uint8_t trailer[TRAILER_SIZE];
+	put_u64(trailer, w->nblocks);
+	put_u64(trailer + 8, index_pos);
+	memcpy(trailer + 16, index_magic, 8);
+	if (ret == 0 && fwrite(trailer, TRAILER_SIZE, 1, w->f) != 1)
+		ret = -1;
+	fflush(w->f);
+
+	free(w->block);
+	free(w->payload);
+	free(w->index);
+	free(w);
+	return ret;
+}
+
+
+/* --------------
+ * Reading files
+ * -------------- */
+
+struct iqz_reader {
+	FILE *f;
+	size_t block_len;
+	double samplerate;
+	uint8_t *payload;
+	// Index, if the file has one and can be seeked
+	struct iqz_index_entry *index;
+	size_t nblocks;
+	// File offset where the index begins, i.e. where the blocks end
+	uint64_t blocks_end;
+	uint64_t pos;
+};
+
+
+/* Read the index from the end of the file.
+ * The file position is restored afterwards. */
+static void read_index(struct iqz_reader *r)
+{
+	uint8_t trailer[TRAILER_SIZE];
+	const off_t start = ftello(r->f);
+	if (start < 0 || fseeko(r->f, -TRAILER_SIZE, SEEK_END) < 0)
+		return;
+	if (fread(trailer, TRAILER_SIZE, 1, r->f) != 1
+	|| memcmp(trailer + 16, index_magic, 8) != 0) {
+		fprintf(stderr, "Warning: compressed file has no index\n");
+		goto done;
+	}
+	const uint64_t nblocks = get_u64(trailer);
+	const uint64_t index_pos = get_u64(trailer + 8);
+	if (fseeko(r->f, index_pos, SEEK_SET) < 0)
+		goto done;
+	r->index = malloc(nblocks * sizeof(*r->index));
+	if (r->index == NULL)
+		goto done;
+	uint64_t i;
+	for (i = 0; i < nblocks; i++) {
+		uint8_t entry[16];
+		if (fread(entry, 16, 1, r->f) != 1)
+			break;
+		r->index[i].time = get_u64(entry);
+		r->index[i].offset = get_u64(entry + 8);
+	}
+	r->nblocks = i;
+	r->blocks_end = index_pos;
+done:
+	fseeko(r->f, start, SEEK_SET);
+}
+
+
+struct iqz_reader *iqz_reader_open(FILE *f)
+{
+	uint8_t header[HEADER_SIZE];
+	if (fread(header, HEADER_SIZE, 1, f) != 1 || memcmp(header, file_magic, 8) != 0) {
+		fprintf(stderr, "Not a compressed signal file\n");
+		return NULL;
+	}
+	struct iqz_reader *r = calloc(1, sizeof(*r));
+	if (r == NULL)
+		return NULL;
+	r->f = f;
+	r->block_len = get_u32(header + 8);
+	uint64_t sr = get_u64(header + 16);
+	memcpy(&r->samplerate, &sr, 8);
+	r->payload = malloc(iqz_max_size(r->block_len));
+	if (r->payload == NULL) {
+		free(r);
+		return NULL;
+	}
+	r->pos = HEADER_SIZE;
+	r->blocks_end = UINT64_MAX;
+	read_index(r);
+	return r;
+}
+
+
+void iqz_reader_close(struct iqz_reader *r)
+{
+	if (r == NULL)
+		return;
+	free(r->payload);
+	free(r->index);
+	free(r);
+}
+
+
+size_t iqz_block_len(const struct iqz_reader *r)
+{
+	return r->block_len;
+}
+
+
+double iqz_samplerate(const struct iqz_reader *r)
+{
+	return r->samplerate;
+}
+
+
+ssize_t iqz_read(struct iqz_reader *r, cs16_t *out, timestamp_t *time)
+{
+	uint8_t header[BLOCK_HEADER_SIZE];
+	// Stop at the index instead of reading it as a block
+	if (r->pos + BLOCK_HEADER_SIZE > r->blocks_end)
+		return 0;
+	if (fread(header, BLOCK_HEADER_SIZE, 1, r->f) != 1)
+		return 0;
+	const size_t n = get_u32(header);
+	const size_t nbytes = get_u32(header + 4);
+	if (n > r->block_len || nbytes > iqz_max_size(r->block_len)) {
+		fprintf(stderr, "Corrupted block in compressed file\n");
+		return -1;
+	}
+	if (fread(r->payload, 1, nbytes, r->f) != nbytes)
+		return 0;
+	r->pos += BLOCK_HEADER_SIZE + nbytes;
+	if (iqz_decode(r->payload, nbytes, out, n) < 0) {
+		fprintf(stderr, "Corrupted block in compressed file\n");
+		return -1;
+	}
+	*time = get_u64(header + 8);
+	return n;
+}
+
+
+int iqz_seek(struct iqz_reader *r, timestamp_t time)
+{
+	if (r->index == NULL || r->nblocks == 0)
+		return -1;
+	// Find the last block beginning before the time
+	size_t lo = 0, hi = r->nblocks;
+	while (hi - lo > 1) {
+		size_t mid = (lo + hi) / 2;
+		if (r->index[mid].time <= time)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	if (fseeko(r->f, r->index[lo].offset, SEEK_SET) < 0)
+		return -1;
+	r->pos = r->index[lo].offset;
+	return 0;
+}
@@ -0,0 +1,61 @@
+#ifndef LIBSUO_IQ_COMPRESS_H
+#define LIBSUO_IQ_COMPRESS_H
+#include "suo.h"
+#include <stdio.h>
+#include <sys/types.h>
+
+/* Lossless compressed format for CS16 signal captures.
+ *
+ * A file consists of a header, independently compressed blocks
+ * of signal and an index of the blocks at the end of the file.
+ * I and Q are delta coded and the deltas Rice coded, with the Rice
+ * parameter chosen separately for each block. This suits
+ * oversampled signals and captures where the signal does not use
+ * the whole 16-bit range, which is most of them.
+ *
+ * Each block has the timestamp of its first sample, and the index
+ * lists the timestamp and the file offset of every block, so that
+ * a reader can seek to a given time without reading the file through.
+ * All numbers in the file are little-endian. */
+
+// Default number of samples in a block
+#define IQZ_BLOCK 65536
+
+struct iqz_writer;
+struct iqz_reader;
+
+/* Compress a block of samples into a buffer.
+ * The buffer needs to have space for iqz_max_size(n) bytes.
+ * Return the number of bytes used. */
+size_t iqz_encode(const cs16_t *in, size_t n, uint8_t *out);
+size_t iqz_max_size(size_t n);
+/* Decompress a block of n samples.
+ * Return 0 on success, -1 if the data is corrupted. */
+int iqz_decode(const uint8_t *in, size_t nbytes, cs16_t *out, size_t n);
+
+/* Start writing a compressed file. Samples are collected
+ * into blocks of block_len samples. The sample rate is used
+ * to calculate timestamps of blocks and stored in the file. */
+struct iqz_writer *iqz_writer_open(FILE *f, size_t block_len, double samplerate);
+/* Write samples. time is the timestamp of the first one. */
+int iqz_write(struct iqz_writer *, const cs16_t *samples, size_t n, timestamp_t time);
+/* Write the remaining samples and the index and free the writer.
+ * The file is not closed. */
+int iqz_writer_close(struct iqz_writer *);
+
+/* Start reading a compressed file.
+ * Return NULL if it is not a compressed file. */
+struct iqz_reader *iqz_reader_open(FILE *f);
+void iqz_reader_close(struct iqz_reader *);
+// Maximum number of samples in a block of the file
+size_t iqz_block_len(const struct iqz_reader *);
+double iqz_samplerate(const struct iqz_reader *);
+/* Read and decompress the next block.
+ * out needs to have space for iqz_block_len samples.
+ * Return the number of samples, 0 at end of file or -1 on error. */
+ssize_t iqz_read(struct iqz_reader *, cs16_t *out, timestamp_t *time);
+/* Seek to the block containing a given time, using the index.
+ * Return -1 if the file has no index or cannot be seeked. */
+int iqz_seek(struct iqz_reader *, timestamp_t time);
+
+#endif
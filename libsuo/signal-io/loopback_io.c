@@ -0,0 +1,404 @@
+#include "loopback_io.h"
+#include "suo_macros.h"
+#include "noise.h"
+#include "clock.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+// Half length of the fractional delay filter (samples)
+#define DELAY_HALF 8
+
+struct loopback_io {
+	struct loopback_io_conf conf;
+
+	const struct receiver_code *receiver;
+	void *receiver_arg;
+	const struct transmitter_code *transmitter;
+	void *transmitter_arg;
+	// The real RX output, called by the frame counting wrapper
+	const struct rx_output_code *rx_output;
+	void *rx_output_arg;
+
+	sample_t *txbuf, *rxbuf;
+
+	/* Multipath and delay filter.
+	 * fir_buf has the last ntaps-1 input samples
+	 * followed by space for a new buffer. */
+	sample_t *taps, *fir_buf, *fir_out;
+	size_t ntaps;
+	// Number of output samples still to drop to compensate for filter delay
+	size_t fir_skip;
+
+	/* Clock drift resampler. rs_buf has the last 3 input
+	 * samples followed by space for a new buffer.
+	 * rs_pos is the position of the next output sample. */
+	sample_t *rs_buf;
+	double rs_step, rs_pos;
+
+	// Frequency offset oscillator
+	sample_t osc, osc_step;
+
+	// Noise generator state and signal power measurement
+	struct noise noise;
+	double burst_energy;
+	uint64_t burst_samples;
+
+	// Statistics
+	uint64_t tx_frames, rx_frames;
+	uint64_t tx_samples, rx_samples;
+	bool in_burst;
+	long long start_ns, next_report;
+};
+
+
+static void *init(const void *conf)
+{
+	struct loopback_io *self;
+	self = calloc(1, sizeof(*self));
+	if (self == NULL)
+		return self;
+	self->conf = *(struct loopback_io_conf*)conf;
+	noise_init(&self->noise, self->conf.seed);
+	return self;
+}
+
+
+static int destroy(void *arg)
+{
+	struct loopback_io *self = arg;
+	free(self->txbuf);
+	free(self->rxbuf);
+	free(self->taps);
+	free(self->fir_buf);
+	free(self->fir_out);
+	free(self->rs_buf);
+	free(self);
+	return 0;
+}
+
+
+/* The receiver is given an RX output which counts
+ * the received frames and then passes them on */
+static int count_frame(void *arg, const struct frame *frame)
+{
+	struct loopback_io *self = arg;
+	self->rx_frames++;
+	if (self->rx_output == NULL)
+		return 0;
+	return self->rx_output->frame(self->rx_output_arg, frame);
+}
+
+
+static int count_tick(void *arg, timestamp_t timenow)
+{
+	struct loopback_io *self = arg;
+	if (self->rx_output == NULL)
+		return 0;
+	return self->rx_output->tick(self->rx_output_arg, timenow);
+}
+
+
+static const struct rx_output_code count_output_code = { "loopback_io_count", NULL, NULL, NULL, NULL, NULL, count_frame, count_tick };
+
+
+static int set_callbacks(void *arg, const struct receiver_code *receiver, void *receiver_arg, const struct transmitter_code *transmitter, void *transmitter_arg)
+{
+	struct loopback_io *self = arg;
+	self->receiver_arg = receiver_arg;
+	self->receiver = receiver;
+	self->transmitter_arg = transmitter_arg;
+	self->transmitter = transmitter;
+	if (receiver != NULL)
+		receiver->set_callbacks(receiver_arg, &count_output_code, self);
+	return 0;
+}
+
+
+static int set_receiver_conf(void *arg, const void *receiver_conf, const struct rx_output_code *rx_output, void *rx_output_arg)
+{
+	struct loopback_io *self = arg;
+	(void)receiver_conf;
+	self->rx_output = rx_output;
+	self->rx_output_arg = rx_output_arg;
+	return 0;
+}
+
+
+/* Windowed sinc interpolator for a delay of d samples,
+ * evaluated at tap position t */
+static double delay_tap(double t, double d)
+{
+	const double x = t - d - DELAY_HALF;
+	if (fabs(x) >= DELAY_HALF)
+		return 0;
+	const double sinc = x == 0 ? 1 : sin(M_PI * x) / (M_PI * x);
+	// Blackman window
+	const double w = 0.42 + 0.5 * cos(M_PI * x / DELAY_HALF) + 0.08 * cos(2 * M_PI * x / DELAY_HALF);
+	return sinc * w;
+}
+
+
+/* Design a filter which sums the direct ray and the echo,
+ * each with its own fractional delay. The filter has an extra
+ * delay of DELAY_HALF samples, which is dropped from the output. */
+static int init_channel_filter(struct loopback_io *self)
+{
+	const struct loopback_io_conf *conf = &self->conf;
+	const double echo = conf->echo_delay > 0 ? conf->echo_delay : 0;
+	const sample_t echo_gain = (float)pow(10, conf->echo_gain / 20)
+		* cexpf(I * (float)(conf->echo_phase * M_PI / 180));
+	size_t i;
+
+	self->ntaps = (size_t)ceil(conf->delay + echo) + 2 * DELAY_HALF + 1;
+	self->taps = calloc(self->ntaps, sizeof(sample_t));
+	self->fir_buf = calloc(self->ntaps - 1 + conf->buffer, sizeof(sample_t));
+	self->fir_out = malloc(conf->buffer * sizeof(sample_t));
+	if (self->taps == NULL || self->fir_buf == NULL || self->fir_out == NULL)
+		return -1;
+	for (i = 0; i < self->ntaps; i++) {
+		self->taps[i] = (float)delay_tap(i, conf->delay);
+		if (echo > 0)
+			self->taps[i] += echo_gain * (float)delay_tap(i, conf->delay + echo);
+	}
+	self->fir_skip = DELAY_HALF;
+	return 0;
+}
+
+
+/* Filter a buffer of n samples.
+ * Return the number of output samples in fir_out. */
+static size_t channel_filter(struct loopback_io *self, const sample_t *in, size_t n)
+{
+	const size_t nt = self->ntaps;
+	const sample_t *taps = self->taps;
+	sample_t *x = self->fir_buf;
+	size_t i, j, nout = 0;
+
+	memcpy(x + nt - 1, in, n * sizeof(sample_t));
+	for (i = 0; i < n; i++) {
+		if (self->fir_skip > 0) {
+			self->fir_skip--;
+			continue;
+		}
+		sample_t y = 0;
+		for (j = 0; j < nt; j++)
+			y += taps[j] * x[i + nt - 1 - j];
+		self->fir_out[nout++] = y;
+	}
+	memmove(x, x + n, (nt - 1) * sizeof(sample_t));
+	return nout;
+}
+
+
+/* Resample a buffer of n samples with cubic interpolation.
+ * Return the number of samples written to out. */
+static size_t resample(struct loopback_io *self, const sample_t *in, size_t n, sample_t *out)
+{
+	sample_t *x = self->rs_buf;
+	double pos = self->rs_pos;
+	size_t nout = 0;
+
+	memcpy(x + 3, in, n * sizeof(sample_t));
+	// Output sample is between x[i+1] and x[i+2]
+	while (pos < n) {
+		const size_t i = (size_t)pos;
+		const float mu = (float)(pos - i);
+		const float c0 = -mu * (mu - 1) * (mu - 2) / 6;
+		const float c1 = (mu + 1) * (mu - 1) * (mu - 2) / 2;
+		const float c2 = -(mu + 1) * mu * (mu - 2) / 2;
+		const float c3 = (mu + 1) * mu * (mu - 1) / 6;
+		out[nout++] = c0 * x[i] + c1 * x[i+1] + c2 * x[i+2] + c3 * x[i+3];
+		pos += self->rs_step;
+	}
+	self->rs_pos = pos - n;
+	memmove(x, x + n, 3 * sizeof(sample_t));
+	return nout;
+}
+
+
+/* Add frequency offset and noise to a buffer, in place */
+static void add_cfo_noise(struct loopback_io *self, sample_t *s, size_t n)
+{
+	const struct loopback_io_conf *conf = &self->conf;
+	size_t i;
+
+	if (conf->cfo != 0) {
+		sample_t osc = self->osc;
+		for (i = 0; i < n; i++) {
+			s[i] *= osc;
+			osc *= self->osc_step;
+		}
+		// Keep the amplitude from drifting because of rounding
+		self->osc = osc / cabsf(osc);
+	}
+
+	if (conf->snr < 200) {
+		// Assume unit power until a burst has been transmitted
+		double power = 1;
+		if (self->burst_samples > 0)
+			power = self->burst_energy / (double)self->burst_samples;
+		const double sigma = sqrt(power * pow(10, -conf->snr / 10) / 2);
+		noise_add(&self->noise, s, n, sigma);
+	}
+}
+
+
+/* Generate a buffer of transmit signal.
+ * Count the transmitted bursts and measure their power. */
+static size_t transmit(struct loopback_io *self, size_t n, timestamp_t time)
+{
+	sample_t *s = self->txbuf;
+	size_t i;
+
+	if (self->transmitter == NULL) {
+		memset(s, 0, n * sizeof(sample_t));
+		return n;
+	}
+	tx_return_t r = self->transmitter->execute(self->transmitter_arg, s, n, time);
+	if (r.len < 0 || (size_t)r.len > n)
+		r.len = n;
+	if (r.end > r.begin) {
+		// Burst starting after the beginning of the buffer is a new one
+		if (!self->in_burst || r.begin > 0)
+			self->tx_frames++;
+		self->in_burst = r.end == r.len;
+		for (i = r.begin; i < (size_t)r.end; i++)
+			self->burst_energy += (double)crealf(s[i] * conjf(s[i]));
+		self->burst_samples += r.end - r.begin;
+	} else {
+		r.begin = r.end = r.len;
+		self->in_burst = 0;
+	}
+	// Signal outside of a burst is not transmitted
+	memset(s, 0, r.begin * sizeof(sample_t));
+	memset(s + r.end, 0, (r.len - r.end) * sizeof(sample_t));
+	return r.len;
+}
+
+
+static void print_report(struct loopback_io *self, long long now)
+{
+	const double t = 1e-9 * (double)(now - self->start_ns);
+	double fer = 0;
+	if (self->tx_frames > 0)
+		fer = 1.0 - (double)self->rx_frames / (double)self->tx_frames;
+	if (fer < 0)
+		fer = 0;
+	fprintf(stderr, "Loopback: %llu frames sent, %llu received, FER %.4f, "
+		"%.1f frames/s, %.3f Msps, %.1fx real time\n",
+		(unsigned long long)self->tx_frames, (unsigned long long)self->rx_frames, fer,
+		(double)self->tx_frames / t, 1e-6 * (double)self->tx_samples / t,
+		(double)self->tx_samples / self->conf.samplerate / t);
+}
+
+
+static int execute(void *arg)
+{
+	struct loopback_io *self = arg;
+	const struct loopback_io_conf *conf = &self->conf;
+	const size_t buffer = conf->buffer;
+	const uint64_t total = (uint64_t)(conf->duration * conf->samplerate);
+	int ret = -1;
+
+	if (buffer == 0 || conf->drift <= -1e6)
+		return -1;
+	self->rs_step = 1.0 / (1.0 + 1e-6 * conf->drift);
+	self->txbuf = malloc(buffer * sizeof(sample_t));
+	// Drift can make the receiver take more samples than were transmitted
+	self->rxbuf = malloc(((size_t)(buffer / self->rs_step) + 2) * sizeof(sample_t));
+	if (self->txbuf == NULL || self->rxbuf == NULL)
+		goto exit;
+	if (conf->delay > 0 || conf->echo_delay > 0) {
+		if (init_channel_filter(self) < 0)
+			goto exit;
+	}
+	if (conf->drift != 0) {
+		self->rs_buf = calloc(buffer + 3, sizeof(sample_t));
+		if (self->rs_buf == NULL)
+			goto exit;
+		// Start at the first new sample to avoid extra delay
+		self->rs_pos = 2;
+	}
+	self->osc = 1;
+	self->osc_step = cexpf(I * (float)(2 * M_PI * conf->cfo / conf->samplerate));
+
+	self->start_ns = monotonic_ns();
+	self->next_report = self->start_ns + (long long)(1e9 * conf->report_interval);
+
+	while (total == 0 || self->tx_samples < total) {
+		size_t n = buffer;
+		if (total > 0 && total - self->tx_samples < n)
+			n = total - self->tx_samples;
+
+		const timestamp_t tx_time = (timestamp_t)(1e9 * (double)self->tx_samples / conf->samplerate);
+		n = transmit(self, n, tx_time);
+		self->tx_samples += n;
+
+		const sample_t *s = self->txbuf;
+		if (self->taps != NULL) {
+			n = channel_filter(self, s, n);
+			s = self->fir_out;
+		}
+		if (self->rs_buf != NULL) {
+			n = resample(self, s, n, self->rxbuf);
+		} else {
+			memcpy(self->rxbuf, s, n * sizeof(sample_t));
+		}
+		add_cfo_noise(self, self->rxbuf, n);
+
+		if (self->receiver != NULL) {
+			const timestamp_t rx_time = (timestamp_t)(1e9 * (double)self->rx_samples / conf->samplerate);
+			self->receiver->execute(self->receiver_arg, self->rxbuf, n, rx_time);
+		}
+		self->rx_samples += n;
+
+		if (conf->report_interval > 0) {
+			const long long now = monotonic_ns();
+			if (now >= self->next_report) {
+				print_report(self, now);
+				self->next_report = now + (long long)(1e9 * conf->report_interval);
+			}
+		}
+	}
+	ret = 0;
+
+exit:
+	print_report(self, monotonic_ns());
+	return ret;
+}
+
+
+const struct loopback_io_conf loopback_io_defaults = {
+	.samplerate = 1e6,
+	.buffer = 4096,
+	.duration = 10,
+	.snr = 200,
+	.cfo = 0,
+	.drift = 0,
+	.delay = 0,
+	.echo_delay = 0,
+	.echo_gain = -6,
+	.echo_phase = 0,
+	.seed = 1,
+	.report_interval = 1
+};
+
+CONFIG_BEGIN(loopback_io)
+CONFIG_F(samplerate)
+CONFIG_I(buffer)
+CONFIG_F(duration)
+CONFIG_F(snr)
+CONFIG_F(cfo)
+CONFIG_F(drift)
+CONFIG_F(delay)
+CONFIG_F(echo_delay)
+CONFIG_F(echo_gain)
+CONFIG_F(echo_phase)
+CONFIG_I(seed)
+CONFIG_F(report_interval)
+CONFIG_END()
+
+
+const struct signal_io_code loopback_io_code = { "loopback_io", init, destroy, init_conf, set_conf, set_callbacks, execute, set_receiver_conf };
@@ -0,0 +1,52 @@
+#ifndef LIBSUO_LOOPBACK_IO_H
+#define LIBSUO_LOOPBACK_IO_H
+#include "suo.h"
+
+/* Channel simulator which connects the transmitter to the receiver.
+ *
+ * Transmitted signal goes through a model of a radio channel
+ * and is then received. Signal is processed as fast as possible,
+ * not in real time, so this can be used to measure both throughput
+ * and sensitivity of a modem without any hardware.
+ *
+ * Impairments are applied in the order: multipath and delay,
+ * sample clock drift, frequency offset, noise.
+ * Each one is skipped when set to its default value. */
+
+struct loopback_io_conf {
+	// Sample rate of the simulated signal
+	double samplerate;
+	// Number of samples processed at a time
+	unsigned buffer;
+	// Amount of signal to simulate (seconds). 0 runs forever.
+	double duration;
+	/* Signal-to-noise ratio (dB) in the whole sample rate bandwidth.
+	 * Signal power is measured from the transmitted bursts.
+	 * Large values (at least 200) disable the noise. */
+	double snr;
+	// Carrier frequency offset (Hz)
+	double cfo;
+	// Sample clock frequency error of the receiver (ppm)
+	double drift;
+	// Delay of the signal (samples, can be fractional)
+	double delay;
+	/* Multipath propagation with a second ray arriving
+	 * echo_delay samples after the direct one.
+	 * 0 means no multipath. */
+	double echo_delay;
+	// Gain of the second ray relative to the direct one (dB)
+	double echo_gain;
+	// Phase of the second ray relative to the direct one (degrees)
+	double echo_phase;
+	// Seed of the noise generator
+	unsigned seed;
+	/* Interval for printing frame counts and throughput
+	 * (seconds of processing time). 0 only prints at the end. */
+	double report_interval;
+};
+
+extern const struct loopback_io_conf loopback_io_defaults;
+
+extern const struct signal_io_code loopback_io_code;
+
+#endif
@@ -0,0 +1,46 @@
+#include "noise.h"
+#include <math.h>
+
+
+void noise_init(struct noise *self, uint64_t seed)
+{
+	// Spread the seed over the bits and avoid the all-zero state
+	self->rng = seed * 0x9E3779B97F4A7C15ULL + 1;
+}
+
+
+double noise_uniform(struct noise *self)
+{
+	// xorshift64*
+	uint64_t x = self->rng;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	self->rng = x;
+	return ((x * 0x2545F4914F6CDD1DULL >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+
+// Box-Muller transform
+static sample_t gaussian(struct noise *self, double sigma)
+{
+	const double r = sigma * sqrt(-2 * log(noise_uniform(self)));
+	const double a = 2 * M_PI * noise_uniform(self);
+	return (float)(r * cos(a)) + I * (float)(r * sin(a));
+}
+
+
+void noise_generate(struct noise *self, sample_t *s, size_t n, double sigma)
+{
+	size_t i;
+	for (i = 0; i < n; i++)
+		s[i] = gaussian(self, sigma);
+}
+
+
+void noise_add(struct noise *self, sample_t *s, size_t n, double sigma)
+{
+	size_t i;
+	for (i = 0; i < n; i++)
+		s[i] += gaussian(self, sigma);
+}
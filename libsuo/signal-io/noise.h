@@ -0,0 +1,27 @@
+#ifndef LIBSUO_NOISE_H
+#define LIBSUO_NOISE_H
+#include "suo.h"
+
+/* Random numbers and complex white Gaussian noise
+ * for the simulated signal I/O modules.
+ *
+ * The generator is xorshift64*, so that a given seed gives
+ * the same signal on every platform. */
+
+struct noise {
+	uint64_t rng;
+};
+
+void noise_init(struct noise *self, uint64_t seed);
+
+// Uniformly distributed number in (0, 1]
+double noise_uniform(struct noise *self);
+
+/* Write n samples of noise to s.
+ * sigma is the standard deviation of each of I and Q. */
+void noise_generate(struct noise *self, sample_t *s, size_t n, double sigma);
+
+// Add n samples of noise to s
+void noise_add(struct noise *self, sample_t *s, size_t n, double sigma);
+
+#endif
@@ -0,0 +1,293 @@
+#ifndef _WIN32
+#include "rtl_tcp_io.h"
+#include "suo_macros.h"
+#include "conversion.h"
+#include "block_ring.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+// Commands of the rtl_tcp protocol
+#define CMD_FREQUENCY  0x01
+#define CMD_SAMPLERATE 0x02
+#define CMD_GAIN_MODE  0x03
+#define CMD_GAIN       0x04
+#define CMD_PPM        0x05
+#define CMD_AGC        0x08
+
+// Size of the socket receive buffer to request (bytes)
+#define SOCKET_BUFFER 0x400000
+
+struct rtl_tcp_io {
+	struct rtl_tcp_io_conf conf;
+	const struct receiver_code *receiver;
+	void *receiver_arg;
+
+	int sock;
+	/* Ring of received blocks in CU8 format.
+	 * Block time is the timestamp of the first sample. */
+	struct block_ring *ring;
+	pthread_t thread;
+	bool thread_started;
+
+	// Buffer for signal converted to sample_t
+	sample_t *buf;
+	// Scratch buffer for reads that do not fit in a full ring
+	uint8_t *discard;
+};
+
+
+static void *init(const void *conf)
+{
+	struct rtl_tcp_io *self;
+	self = calloc(1, sizeof(*self));
+	if (self == NULL)
+		return self;
+	self->conf = *(struct rtl_tcp_io_conf*)conf;
+	self->sock = -1;
+	return self;
+}
+
+
+static int destroy(void *arg)
+{
+	struct rtl_tcp_io *self = arg;
+	if (self->sock >= 0)
+		close(self->sock);
+	block_ring_destroy(self->ring);
+	free(self->buf);
+	free(self->discard);
+	free(self);
+	return 0;
+}
+
+
+static int set_callbacks(void *arg, const struct receiver_code *receiver, void *receiver_arg, const struct transmitter_code *transmitter, void *transmitter_arg)
+{
+	struct rtl_tcp_io *self = arg;
+	self->receiver_arg = receiver_arg;
+	self->receiver = receiver;
+	(void)transmitter_arg;
+	if (transmitter != NULL)
+		fprintf(stderr, "Warning: rtl_tcp_io does not support transmitting\n");
+	return 0;
+}
+
+
+/* Receive len bytes unless the connection is closed.
+ * Return the number of bytes received. */
+static size_t recv_all(int sock, void *buf, size_t len)
+{
+	size_t got = 0;
+	while (got < len) {
+		ssize_t ret = recv(sock, (char *)buf + got, len - got, 0);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			break;
+		got += ret;
+	}
+	return got;
+}
+
+
+static int send_command(struct rtl_tcp_io *self, uint8_t cmd, uint32_t param)
+{
+	// Parameter is big-endian
+	const uint8_t b[5] = { cmd, param >> 24, param >> 16, param >> 8, param };
+	if (send(self->sock, b, sizeof(b), MSG_NOSIGNAL) != sizeof(b)) {
+		perror("Failed to send command to rtl_tcp server");
+		return -1;
+	}
+	return 0;
+}
+
+
+static int connect_server(struct rtl_tcp_io *self)
+{
+	const struct rtl_tcp_io_conf *conf = &self->conf;
+	struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+	struct addrinfo *res, *ai;
+	char port[16];
+	int ret;
+
+	snprintf(port, sizeof(port), "%u", conf->port);
+	ret = getaddrinfo(conf->host, port, &hints, &res);
+	if (ret != 0) {
+		fprintf(stderr, "Failed to resolve %s: %s\n", conf->host, gai_strerror(ret));
+		return -1;
+	}
+	for (ai = res; ai != NULL; ai = ai->ai_next) {
+		self->sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (self->sock < 0)
+			continue;
+		if (connect(self->sock, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+		close(self->sock);
+		self->sock = -1;
+	}
+	freeaddrinfo(res);
+	if (self->sock < 0) {
+		fprintf(stderr, "Failed to connect to rtl_tcp server %s:%u\n", conf->host, conf->port);
+		return -1;
+	}
+
+	/* A large socket buffer absorbs scheduling hiccups of the I/O thread,
+	 * and commands should not wait for more to send */
+	int opt = SOCKET_BUFFER;
+	setsockopt(self->sock, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt));
+	opt = 1;
+	setsockopt(self->sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+	/* Server begins with a header: "RTL0", tuner type
+	 * and number of gain values, both 32-bit big-endian */
+	uint8_t h[12];
+	if (recv_all(self->sock, h, sizeof(h)) != sizeof(h) || memcmp(h, "RTL0", 4) != 0) {
+		fprintf(stderr, "Invalid header from rtl_tcp server\n");
+		return -1;
+	}
+	fprintf(stderr, "Connected to rtl_tcp server, tuner type %u, %u gain values\n",
+		(unsigned)h[4] << 24 | h[5] << 16 | h[6] << 8 | h[7],
+		(unsigned)h[8] << 24 | h[9] << 16 | h[10] << 8 | h[11]);
+	return 0;
+}
+
+
+static int configure_server(struct rtl_tcp_io *self)
+{
+	const struct rtl_tcp_io_conf *conf = &self->conf;
+	if (send_command(self, CMD_SAMPLERATE, (uint32_t)conf->samplerate) < 0
+	|| send_command(self, CMD_FREQUENCY, (uint32_t)conf->centerfreq) < 0
+	|| send_command(self, CMD_PPM, (uint32_t)conf->ppm) < 0
+	|| send_command(self, CMD_AGC, conf->agc) < 0)
+		return -1;
+	if (conf->gain < 0)
+		return send_command(self, CMD_GAIN_MODE, 0);
+	if (send_command(self, CMD_GAIN_MODE, 1) < 0)
+		return -1;
+	// Gain is given in tenths of dB
+	return send_command(self, CMD_GAIN, (uint32_t)(conf->gain * 10 + 0.5));
+}
+
+
+/* I/O thread.
+ * Reads the socket into the ring as fast as possible.
+ * If the ring is full, a buffer is read and dropped. */
+static void *io_thread_main(void *arg)
+{
+	struct rtl_tcp_io *self = arg;
+	const size_t bytes = sizeof(cu8_t) * self->conf.buffer;
+	const double sample_ns = 1e9 / self->conf.samplerate;
+	uint64_t pos = 0;
+
+	for (;;) {
+		struct ring_block *b = block_ring_write_get(self->ring, 0);
+		const size_t n = recv_all(self->sock, b != NULL ? b->data : self->discard, bytes) / sizeof(cu8_t);
+		if (n == 0)
+			break;
+		if (b != NULL) {
+			b->len = n;
+			b->time = (timestamp_t)(sample_ns * pos);
+			block_ring_write_put(self->ring);
+		}
+		pos += n;
+	}
+	fprintf(stderr, "rtl_tcp connection closed\n");
+	block_ring_close(self->ring);
+	return NULL;
+}
+
+
+static void print_stats(struct rtl_tcp_io *self)
+{
+	struct block_ring_stats st;
+	block_ring_get_stats(self->ring, &st);
+	fprintf(stderr, "rtl_tcp: ring %zu/%zu buffers used, max %zu, %llu buffers dropped\n",
+		st.fill, st.size, st.high_water, (unsigned long long)st.overflows);
+}
+
+
+static int execute(void *arg)
+{
+	struct rtl_tcp_io *self = arg;
+	const struct rtl_tcp_io_conf *conf = &self->conf;
+	const timestamp_t report_ns = (timestamp_t)(1e9 * conf->report_interval);
+	timestamp_t next_report = report_ns;
+	struct ring_block *b;
+	int ret = -1;
+
+	if (self->receiver == NULL || conf->buffer == 0 || conf->io_buffers == 0)
+		return -1;
+	self->buf = malloc(sizeof(sample_t) * conf->buffer);
+	self->discard = malloc(sizeof(cu8_t) * conf->buffer);
+	self->ring = block_ring_init(conf->io_buffers, sizeof(cu8_t) * conf->buffer);
+	if (self->buf == NULL || self->discard == NULL || self->ring == NULL) {
+		fprintf(stderr, "rtl_tcp: failed to allocate buffers\n");
+		return -1;
+	}
+	if (connect_server(self) < 0 || configure_server(self) < 0)
+		goto exit;
+	if (pthread_create(&self->thread, NULL, io_thread_main, self) != 0)
+		goto exit;
+	self->thread_started = 1;
+
+	// Runs until the connection is closed and the ring emptied
+	while ((b = block_ring_read_get(self->ring, -1)) != NULL) {
+		cu8_to_cf(b->data, self->buf, b->len);
+		const timestamp_t time = b->time;
+		self->receiver->execute(self->receiver_arg, self->buf, b->len, time);
+		block_ring_read_put(self->ring);
+		if (report_ns > 0 && time >= next_report) {
+			print_stats(self);
+			next_report = time + report_ns;
+		}
+	}
+	ret = 0;
+
+exit:
+	if (self->thread_started) {
+		shutdown(self->sock, SHUT_RDWR);
+		pthread_join(self->thread, NULL);
+		self->thread_started = 0;
+		print_stats(self);
+	}
+	return ret;
+}
+
+
+const struct rtl_tcp_io_conf rtl_tcp_io_defaults = {
+	.host = "127.0.0.1",
+	.port = 1234,
+	.samplerate = 1e6,
+	.centerfreq = 433.8e6,
+	.gain = -1,
+	.ppm = 0,
+	.agc = 0,
+	.buffer = 65536,
+	.io_buffers = 16,
+	.report_interval = 10
+};
+
+CONFIG_BEGIN(rtl_tcp_io)
+CONFIG_C(host)
+CONFIG_I(port)
+CONFIG_F(samplerate)
+CONFIG_F(centerfreq)
+CONFIG_F(gain)
+CONFIG_I(ppm)
+CONFIG_I(agc)
+CONFIG_I(buffer)
+CONFIG_I(io_buffers)
+CONFIG_F(report_interval)
+CONFIG_END()
+
+
+const struct signal_io_code rtl_tcp_io_code = { "rtl_tcp_io", init, destroy, init_conf, set_conf, set_callbacks, execute, NULL };
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef LIBSUO_RTL_TCP_IO_H
+#define LIBSUO_RTL_TCP_IO_H
+#include "suo.h"
+
+/* Receive signal from an rtl_tcp server over the network.
+ *
+ * Samples are received in an I/O thread into a ring of large
+ * buffers, so that the receiver does not delay reading the socket.
+ * If the receiver does not keep up and the ring gets full,
+ * samples are dropped, and the timestamps given to the receiver
+ * skip over them.
+ *
+ * The protocol has no timestamps, so time is counted from
+ * the number of samples received. Receive only.
+ * Not supported on Windows. */
+
+struct rtl_tcp_io_conf {
+	// Address of the server
+	const char *host;
+	// TCP port of the server
+	unsigned port;
+	// Sample rate to set
+	double samplerate;
+	// Center frequency to set (Hz)
+	double centerfreq;
+	/* Tuner gain to set (dB).
+	 * Negative value uses automatic gain. */
+	double gain;
+	// Frequency correction to set (ppm)
+	int ppm;
+	// Enable the AGC of RTL2832
+	unsigned char agc:1;
+	// Number of samples passed to the receiver at a time
+	unsigned buffer;
+	// Number of buffers in the ring between the I/O thread and the receiver
+	unsigned io_buffers;
+	/* Interval for printing statistics (seconds of signal).
+	 * 0 disables the reports. */
+	double report_interval;
+};
+
+extern const struct rtl_tcp_io_conf rtl_tcp_io_defaults;
+
+extern const struct signal_io_code rtl_tcp_io_code;
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef _WIN32
+#include "shm_io.h"
+#include "shm_ring.h"
+#include "suo_macros.h"
+#include "clock.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+struct shm_io {
+	struct shm_io_conf conf;
+	const struct receiver_code *receiver;
+	void *receiver_arg;
+	struct shm_ring *ring;
+
+	// Statistics since the previous report
+	uint64_t blocks, lost, torn, max_lag;
+};
+
+
+static void *init(const void *conf)
+{
+	struct shm_io *self;
+	self = calloc(1, sizeof(*self));
+	if (self == NULL)
+		return self;
+	self->conf = *(struct shm_io_conf*)conf;
+	return self;
+}
+
+
+static int destroy(void *arg)
+{
+	struct shm_io *self = arg;
+	shm_ring_destroy(self->ring);
+	free(self);
+	return 0;
+}
+
+
+static int set_callbacks(void *arg, const struct receiver_code *receiver, void *receiver_arg, const struct transmitter_code *transmitter, void *transmitter_arg)
+{
+	struct shm_io *self = arg;
+	self->receiver_arg = receiver_arg;
+	self->receiver = receiver;
+	(void)transmitter_arg;
+	if (transmitter != NULL)
+		fprintf(stderr, "Warning: shm_io does not support transmitting\n");
+	return 0;
+}
+
+
+static void print_stats(struct shm_io *self)
+{
+	fprintf(stderr, "Shared memory ring: %llu blocks, %llu lost, %llu overwritten while processing, max %llu blocks behind\n",
+		(unsigned long long)self->blocks, (unsigned long long)self->lost,
+		(unsigned long long)self->torn, (unsigned long long)self->max_lag);
+	self->blocks = self->lost = self->torn = self->max_lag = 0;
+}
+
+
+/* Attach to the ring and check that its writer is running.
+ * A ring left behind by a writer that was killed
+ * would otherwise look like one that just has no new signal. */
+static int attach(struct shm_io *self)
+{
+	self->ring = shm_ring_attach(self->conf.name);
+	if (self->ring == NULL) {
+		fprintf(stderr, "Failed to attach to shared memory ring %s\n", self->conf.name);
+		return -1;
+	}
+	if (!shm_ring_alive(self->ring)) {
+		fprintf(stderr, "Writer of shared memory ring %s is not running\n", self->conf.name);
+		shm_ring_destroy(self->ring);
+		self->ring = NULL;
+		return -1;
+	}
+	const struct shm_ring_header *h = shm_ring_header(self->ring);
+	fprintf(stderr, "Attached to shared memory ring %s: sample rate %g, %u blocks of %u samples\n",
+		self->conf.name, h->samplerate, h->nblocks, h->block_len);
+	return 0;
+}
+
+
+/* Read blocks from the attached ring until it is closed
+ * or the writer is gone.
+ * Return 0 if the writer closed it, 1 if the writer is gone. */
+static int read_ring(struct shm_io *self)
+{
+	const struct shm_ring_header *h = shm_ring_header(self->ring);
+	const uint64_t nblocks = h->nblocks;
+
+	/* Poll for new blocks a few times per block duration */
+	const long long poll_ns = (long long)(0.25e9 * h->block_len / h->samplerate);
+	const struct timespec poll = { poll_ns / 1000000000LL, poll_ns % 1000000000LL };
+	const long long timeout_ns = (long long)(1e9 * self->conf.timeout);
+	const timestamp_t report_ns = (timestamp_t)(1e9 * self->conf.report_interval);
+	timestamp_t next_report = 0;
+	long long last_block = monotonic_ns();
+
+	// Start from the newest block
+	uint64_t n = shm_ring_head(self->ring);
+	for (;;) {
+		const uint64_t head = shm_ring_head(self->ring);
+		if (n >= head) {
+			if (atomic_load(&h->closed))
+				return 0;
+			/* If no blocks arrive for a while, check that
+			 * the writer has not died or replaced the ring.
+			 * A live writer may just have stopped receiving
+			 * for a moment, so keep waiting for it. */
+			if (timeout_ns > 0 && monotonic_ns() - last_block > timeout_ns) {
+				if (!shm_ring_alive(self->ring))
+					return 1;
+				last_block = monotonic_ns();
+			}
+			nanosleep(&poll, NULL);
+			continue;
+		}
+		if (timeout_ns > 0)
+			last_block = monotonic_ns();
+		if (head - n > self->max_lag)
+			self->max_lag = head - n;
+		if (head - n >= nblocks) {
+			/* Fell behind by more than the whole ring.
+			 * Skip to the middle of the ring to have some margin
+			 * before the writer catches up again. */
+			const uint64_t skip_to = head - nblocks / 2;
+			self->lost += skip_to - n;
+			n = skip_to;
+		}
+
+		const struct shm_ring_block *b = shm_ring_get(self->ring, n);
+		const timestamp_t time = b != NULL ? b->time : 0;
+		const size_t len = b != NULL ? b->len : 0;
+		if (b == NULL || !shm_ring_check(self->ring, b, n) || len > h->block_len) {
+			// Overwritten before we got to it
+			self->lost++;
+			n++;
+			continue;
+		}
+		self->receiver->execute(self->receiver_arg, shm_ring_samples(b), len, time);
+		if (!shm_ring_check(self->ring, b, n))
+			self->torn++;
+		self->blocks++;
+		n++;
+
+		if (report_ns > 0 && time >= next_report) {
+			if (next_report != 0)
+				print_stats(self);
+			next_report = time + report_ns;
+		}
+	}
+}
+
+
+static int execute(void *arg)
+{
+	struct shm_io *self = arg;
+	int ret = 0;
+	if (self->receiver == NULL || self->conf.name == NULL)
+		return -1;
+	if (attach(self) < 0)
+		return -1;
+
+	/* If the writer is gone, reattach in case it was restarted
+	 * and created a new ring. Otherwise give up. */
+	while (read_ring(self) != 0) {
+		fprintf(stderr, "Writer of shared memory ring %s is gone\n", self->conf.name);
+		print_stats(self);
+		shm_ring_destroy(self->ring);
+		if (attach(self) < 0) {
+			ret = -1;
+			break;
+		}
+	}
+	if (ret == 0) {
+		fprintf(stderr, "Shared memory ring closed by the writer\n");
+		print_stats(self);
+	}
+	return ret;
+}
+
+
+const struct shm_io_conf shm_io_defaults = {
+	.name = "/suo",
+	.report_interval = 10,
+	.timeout = 2
+};
+
+CONFIG_BEGIN(shm_io)
+CONFIG_C(name)
+CONFIG_F(report_interval)
+CONFIG_F(timeout)
+CONFIG_END()
+
+
+const struct signal_io_code shm_io_code = { "shm_io", init, destroy, init_conf, set_conf, set_callbacks, execute, NULL };
+
+#endif
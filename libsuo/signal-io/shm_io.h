@@ -0,0 +1,26 @@
+#ifndef LIBSUO_SHM_IO_H
+#define LIBSUO_SHM_IO_H
+#include "suo.h"
+
+/* Receive signal from a shared memory ring written by another
+ * process, such as soapysdr_io with shm_name set.
+ * See shm_ring.h. Receive only. */
+
+struct shm_io_conf {
+	// Name of the shared memory ring
+	const char *name;
+	/* Interval for printing statistics (seconds of signal).
+	 * 0 disables the reports. */
+	double report_interval;
+	/* Time without new blocks (seconds) after which the writer
+	 * is checked to be still running. If it is not, the ring is
+	 * attached again in case the writer was restarted.
+	 * 0 disables the check. */
+	double timeout;
+};
+
+extern const struct shm_io_conf shm_io_defaults;
+
+extern const struct signal_io_code shm_io_code;
+
+#endif
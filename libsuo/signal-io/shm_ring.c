@@ -0,0 +1,216 @@
+#ifndef _WIN32
+#include "shm_ring.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct shm_ring {
+	struct shm_ring_header *h;
+	size_t size;
+	char *name;
+	// Set if the ring was created by this process
+	bool writer;
+	// Identity of the shared memory object, for readers
+	dev_t dev;
+	ino_t ino;
+	double sample_ns;
+};
+
+
+_Static_assert(sizeof(struct shm_ring_header) <= SHM_RING_BLOCK_HEADER, "ring header too long");
+
+
+// The ring header takes the space of one block header before the first block
+static struct shm_ring_block *block(const struct shm_ring *self, uint64_t n)
+{
+	return (struct shm_ring_block *)((char *)self->h
+		+ SHM_RING_BLOCK_HEADER + (n % self->h->nblocks) * self->h->block_size);
+}
+
+
+struct shm_ring *shm_ring_create(const char *name, size_t nblocks, size_t block_len, double samplerate)
+{
+	struct shm_ring *self;
+	const size_t block_size = (SHM_RING_BLOCK_HEADER + block_len * sizeof(sample_t) + 63) & ~(size_t)63;
+	const size_t size = SHM_RING_BLOCK_HEADER + nblocks * block_size;
+	int fd = -1;
+
+	if (nblocks == 0 || block_len == 0)
+		return NULL;
+	self = calloc(1, sizeof(*self));
+	if (self == NULL)
+		return NULL;
+	self->size = size;
+	self->sample_ns = 1e9 / samplerate;
+
+	// Readers of a previous ring with the same name keep their own copy
+	shm_unlink(name);
+	fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0 || ftruncate(fd, size) < 0) {
+		perror("Failed to create shared memory ring");
+		goto fail;
+	}
+	void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		perror("Failed to map shared memory ring");
+		goto fail;
+	}
+	close(fd);
+	self->h = map;
+	self->name = strdup(name);
+	self->writer = 1;
+
+	self->h->nblocks = nblocks;
+	self->h->block_len = block_len;
+	self->h->block_size = block_size;
+	self->h->samplerate = samplerate;
+	atomic_init(&self->h->head, 0);
+	atomic_init(&self->h->closed, 0);
+	self->h->writer_pid = getpid();
+	// Readers check the magic, so write it last
+	atomic_thread_fence(memory_order_release);
+	memcpy(self->h->magic, SHM_RING_MAGIC, sizeof(self->h->magic));
+	return self;
+
+fail:
+	if (fd >= 0) {
+		close(fd);
+		shm_unlink(name);
+	}
+	free(self);
+	return NULL;
+}
+
+
+void shm_ring_write(struct shm_ring *self, const sample_t *samples, size_t n, timestamp_t time)
+{
+	struct shm_ring_header *h = self->h;
+	while (n > 0) {
+		const size_t len = n < h->block_len ? n : h->block_len;
+		const uint64_t head = atomic_load_explicit(&h->head, memory_order_relaxed);
+		struct shm_ring_block *b = block(self, head);
+
+		// Mark the block as being written before touching the data
+		atomic_store_explicit(&b->seq, 2*head + 1, memory_order_relaxed);
+		atomic_thread_fence(memory_order_release);
+		b->time = time;
+		b->len = len;
+		b->flags = 0;
+		memcpy((char *)b + SHM_RING_BLOCK_HEADER, samples, len * sizeof(sample_t));
+		atomic_store_explicit(&b->seq, 2*head + 2, memory_order_release);
+		atomic_store_explicit(&h->head, head + 1, memory_order_release);
+
+		samples += len;
+		n -= len;
+		time += (timestamp_t)(self->sample_ns * len);
+	}
+}
+
+
+struct shm_ring *shm_ring_attach(const char *name)
+{
+	struct shm_ring *self;
+	struct stat st;
+	int fd;
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0)
+		return NULL;
+	self = calloc(1, sizeof(*self));
+	if (self == NULL || fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(struct shm_ring_header))
+		goto fail;
+	self->size = st.st_size;
+	self->dev = st.st_dev;
+	self->ino = st.st_ino;
+	void *map = mmap(NULL, self->size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		goto fail;
+	close(fd);
+	self->h = map;
+	atomic_thread_fence(memory_order_acquire);
+	if (memcmp(self->h->magic, SHM_RING_MAGIC, sizeof(self->h->magic)) != 0
+	|| SHM_RING_BLOCK_HEADER + self->h->nblocks * self->h->block_size > self->size) {
+		fprintf(stderr, "%s is not a valid shared memory ring\n", name);
+		munmap(map, self->size);
+		free(self);
+		return NULL;
+	}
+	self->sample_ns = 1e9 / self->h->samplerate;
+	self->name = strdup(name);
+	return self;
+
+fail:
+	close(fd);
+	free(self);
+	return NULL;
+}
+
+
+const struct shm_ring_header *shm_ring_header(const struct shm_ring *self)
+{
+	return self->h;
+}
+
+
+uint64_t shm_ring_head(const struct shm_ring *self)
+{
+	return atomic_load_explicit(&self->h->head, memory_order_acquire);
+}
+
+
+const struct shm_ring_block *shm_ring_get(const struct shm_ring *self, uint64_t n)
+{
+	const struct shm_ring_block *b = block(self, n);
+	if (atomic_load_explicit(&b->seq, memory_order_acquire) != 2*n + 2)
+		return NULL;
+	return b;
+}
+
+
+bool shm_ring_check(const struct shm_ring *self, const struct shm_ring_block *b, uint64_t n)
+{
+	(void)self;
+	// Make sure the samples were read before reading the sequence number
+	atomic_thread_fence(memory_order_acquire);
+	return atomic_load_explicit(&b->seq, memory_order_relaxed) == 2*n + 2;
+}
+
+
+bool shm_ring_alive(const struct shm_ring *self)
+{
+	struct stat st;
+	bool same = 0;
+	if (kill(self->h->writer_pid, 0) < 0 && errno == ESRCH)
+		return 0;
+	if (self->name == NULL)
+		return 1;
+	int fd = shm_open(self->name, O_RDONLY, 0);
+	if (fd < 0)
+		return 0;
+	if (fstat(fd, &st) == 0)
+		same = st.st_dev == self->dev && st.st_ino == self->ino;
+	close(fd);
+	return same;
+}
+
+
+void shm_ring_destroy(struct shm_ring *self)
+{
+	if (self == NULL)
+		return;
+	if (self->writer) {
+		atomic_store(&self->h->closed, 1);
+		if (self->name != NULL)
+			shm_unlink(self->name);
+	}
+	free(self->name);
+	munmap(self->h, self->size);
+	free(self);
+}
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef LIBSUO_SHM_RING_H
+#define LIBSUO_SHM_RING_H
+#include "suo.h"
+#include <stdatomic.h>
+
+/* Ring of sample blocks in POSIX shared memory.
+ *
+ * One process writes received signal into the ring and any number
+ * of other processes can read it. Readers map the ring read-only
+ * and use the blocks in place, so nothing is copied per reader.
+ *
+ * The writer never waits for readers. Blocks are numbered and each
+ * block has a sequence number which tells which block is stored in
+ * it and whether it is completely written, like a seqlock: a reader
+ * checks it before and after using a block to find out whether the
+ * writer overwrote the block in the meantime.
+ *
+ * Samples are stored as sample_t in the native byte order,
+ * so readers need to run on the same machine as the writer. */
+
+#define SHM_RING_MAGIC "SUOSHM2"
+
+// Beginning of the shared memory
+struct shm_ring_header {
+	char magic[8];
+	// Number of blocks in the ring
+	uint32_t nblocks;
+	// Maximum number of samples in a block
+	uint32_t block_len;
+	// Distance between blocks (bytes)
+	uint64_t block_size;
+	double samplerate;
+	// Number of blocks written since the ring was created
+	_Atomic uint64_t head;
+	// Set when the writer has stopped
+	_Atomic uint32_t closed;
+	// Process ID of the writer
+	int32_t writer_pid;
+};
+
+struct shm_ring_block {
+	/* 2*n+1 while block number n is being written,
+	 * 2*n+2 after it has been written */
+	_Atomic uint64_t seq;
+	// Timestamp of the first sample
+	timestamp_t time;
+	// Number of samples
+	uint32_t len;
+	uint32_t flags;
+};
+
+// Offset of samples from the beginning of a block
+#define SHM_RING_BLOCK_HEADER 64
+
+struct shm_ring;
+
+/* Create a ring for writing. name is a POSIX shared memory name
+ * and should begin with a slash. An existing ring with the same
+ * name is replaced. */
+struct shm_ring *shm_ring_create(const char *name, size_t nblocks, size_t block_len, double samplerate);
+/* Write samples, splitting them into blocks as needed.
+ * time is the timestamp of the first sample. */
+void shm_ring_write(struct shm_ring *, const sample_t *samples, size_t n, timestamp_t time);
+
+/* Attach to an existing ring for reading.
+ * Return NULL if it does not exist. */
+struct shm_ring *shm_ring_attach(const char *name);
+const struct shm_ring_header *shm_ring_header(const struct shm_ring *);
+// Number of blocks written so far
+uint64_t shm_ring_head(const struct shm_ring *);
+/* Get block number n.
+ * Return NULL if it has been overwritten or is being written. */
+const struct shm_ring_block *shm_ring_get(const struct shm_ring *, uint64_t n);
+/* Check that block number n was not overwritten while it was used.
+ * If it was, the samples read from it may be corrupted. */
+bool shm_ring_check(const struct shm_ring *, const struct shm_ring_block *, uint64_t n);
+/* Check that the writer of an attached ring is still running
+ * and that the name still refers to the attached ring.
+ * A writer that crashes or is killed cannot mark the ring closed,
+ * and a restarted writer replaces the ring with a new one.
+ * The writer is looked up by its process ID, so the reader
+ * should run in the same PID namespace. */
+bool shm_ring_alive(const struct shm_ring *);
+static inline const sample_t *shm_ring_samples(const struct shm_ring_block *b)
+{
+	return (const sample_t *)((const char *)b + SHM_RING_BLOCK_HEADER);
+}
+
+/* Detach from the ring. If it was created by this process,
+ * mark it closed so that readers stop, and remove it. */
+void shm_ring_destroy(struct shm_ring *);
+
+#endif
@@ -2,14 +2,22 @@
  * Main loop with SoapySDR interfacing
  */
 
+#define _GNU_SOURCE // for pthread_setaffinity_np
 #include "suo.h"
 #include "suo_macros.h"
 #include "soapysdr_io.h"
+#include "block_ring.h"
+#include "conversion.h"
+#include "shm_ring.h"
+#include "clock.h"
 
 #include <string.h>
 #include <stdio.h>
 #include <signal.h>
 #include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
 #include <SoapySDR/Version.h>
 #include <SoapySDR/Device.h>
 #include <SoapySDR/Formats.h>
@@ -19,12 +27,97 @@
 #include <windows.h>
 #endif
 
+enum stream_format { FORMAT_CF32, FORMAT_CS16, FORMAT_CS8 };
+
+struct soapysdr_io;
+
+/* State of one channel in multi-channel reception.
+ * Each channel has its own receiver instance running in
+ * its own worker thread, fed through a ring from the main loop. */
+struct rx_chan {
+	struct soapysdr_io *io;
+	size_t channel; // Radio channel number, used as the frame ID
+	void *receiver_arg;
+	struct block_ring *ring;
+	sample_t *convbuf;
+	/* Copy of a received frame, used to add the channel ID */
+	struct frame *frame;
+	size_t frame_size;
+	pthread_t thread;
+	bool thread_started;
+};
+
 struct soapysdr_io {
 	const struct receiver_code *receiver;
 	void *receiver_arg;
 	const struct transmitter_code *transmitter;
 	void *transmitter_arg;
 	struct soapysdr_io_conf conf;
+
+	SoapySDRDevice *sdr;
+	SoapySDRStream *rxstream, *txstream;
+
+	/* Values derived from the configuration */
+	double sample_ns;
+	long timeout_us;
+
+	/* Sample format used on the streams, size of one sample
+	 * in that format and scaling to and from sample_t */
+	enum stream_format format;
+	size_t format_size;
+	float rx_scale, tx_scale;
+	/* Buffers for samples converted from or to the stream format.
+	 * Only used if the format is not CF32. */
+	sample_t *rx_convbuf;
+	void *tx_convbuf;
+
+	/* RX time tracking. current_time is the estimated time
+	 * at the end of the latest received buffer. */
+	long long current_time;
+
+	/* TX state. tx_last_end_time is when the previous produced
+	 * TX buffer ended, i.e. where the next buffer should begin */
+	long long tx_latency_time;
+	long long tx_last_end_time;
+	bool tx_burst_going;
+	sample_t *txbuf;
+	size_t tx_buflen;
+
+	/* Direct buffer access: whether it is used for each stream,
+	 * and the TX buffer currently acquired from the driver */
+	bool rx_direct, tx_direct;
+	bool tx_direct_held;
+	size_t tx_direct_handle;
+	void *tx_direct_buf;
+	size_t tx_direct_len;
+
+	/* RX reader thread and the ring it fills */
+	struct block_ring *rx_ring;
+	pthread_t rx_thread;
+	bool rx_thread_started;
+
+	/* Multi-channel reception. Receiver instances for the additional
+	 * channels are created using receiver_conf and their output
+	 * is serialized to rx_output using output_lock. */
+	const void *receiver_conf;
+	const struct rx_output_code *rx_output;
+	void *rx_output_arg;
+	unsigned nchan;
+	struct rx_chan *chans;
+	// Scratch buffer for reads that do not fit in a full ring
+	void *rx_discard;
+	pthread_mutex_t output_lock;
+
+	/* TX thread. The main loop publishes the latest known
+	 * stream time together with the monotonic clock time when it
+	 * was observed, and the TX thread extrapolates from those. */
+	pthread_t tx_thread;
+	bool tx_thread_started;
+	pthread_mutex_t time_lock;
+	long long sync_time, sync_clock;
+
+	/* Shared memory ring where received signal is published */
+	struct shm_ring *shm;
 };
 
 
@@ -59,6 +152,695 @@ static void sighandler(int sig)
 #endif
 
 
+/* Estimate current time from the end of a received buffer
+ * and return the timestamp of the beginning of the buffer.
+ * If there's no timestamp, make one up by incrementing time.
+ *
+ * If there were no lost samples, the received buffer should
+ * begin from the previous "current" time. Calculate the
+ * difference to detect lost samples.
+ * TODO: if configured, feed zero padding samples to receiver
+ * module to correct timing after lost samples. */
+static long long rx_time(struct soapysdr_io *self, size_t len, int flags, long long rx_timestamp)
+{
+	const double sample_ns = self->sample_ns;
+	// Used for lost sample detection
+	const long long timediff_max = sample_ns * 0.5;
+
+	if (self->conf.use_time && (flags & SOAPY_SDR_HAS_TIME)) {
+		long long prev_time = self->current_time;
+		self->current_time = rx_timestamp + sample_ns * len;
+
+		long long timediff = rx_timestamp - prev_time;
+		// this can produce a lot of print, not the best way to do it
+		if (timediff < -timediff_max)
+			fprintf(stderr, "%20lld: Time went backwards %lld ns!\n", rx_timestamp, -timediff);
+		else if (timediff > timediff_max)
+			fprintf(stderr, "%20lld: Lost samples for %lld ns!\n", rx_timestamp, timediff);
+	} else {
+		rx_timestamp = self->current_time; // from previous iteration
+		self->current_time += sample_ns * len + 0.5;
+	}
+	return rx_timestamp;
+}
+
+
+/* Convert a received buffer to sample_t if needed
+ * and pass it to a receiver */
+static void rx_execute(struct soapysdr_io *self, void *receiver_arg, sample_t *convbuf, const void *buf, size_t len, long long rx_timestamp)
+{
+	const sample_t *samples = buf;
+	if (self->format != FORMAT_CF32) {
+		if (self->format == FORMAT_CS16)
+			cs16_to_cf_scale(buf, convbuf, len, self->rx_scale);
+		else
+			cs8_to_cf_scale(buf, convbuf, len, self->rx_scale);
+		samples = convbuf;
+	}
+#ifndef _WIN32
+	// Only the first channel is published
+	if (self->shm != NULL && receiver_arg == self->receiver_arg)
+		shm_ring_write(self->shm, samples, len, rx_timestamp);
+#endif
+	if (self->receiver != NULL)
+		self->receiver->execute(receiver_arg, samples, len, rx_timestamp);
+}
+
+
+// Pass a received buffer to the receiver
+static void rx_process(struct soapysdr_io *self, const void *buf, size_t len, int flags, long long rx_timestamp)
+{
+	rx_timestamp = rx_time(self, len, flags, rx_timestamp);
+	rx_execute(self, self->receiver_arg, self->rx_convbuf, buf, len, rx_timestamp);
+}
+
+
+/* RX reader thread.
+ * It does nothing but drain the device into the ring as fast as
+ * possible, so that a slow receiver does not delay the next read
+ * and make the driver lose samples. If the ring is full,
+ * the buffer is read into a scratch buffer and discarded.
+ * The receiver notices that from the timestamps. */
+static void *rx_reader_main(void *arg)
+{
+	struct soapysdr_io *self = arg;
+	const size_t rx_buflen = self->conf.buffer;
+
+	while (running) {
+		struct ring_block *b = block_ring_write_get(self->rx_ring, 0);
+		void *rxbuffs[] = { b != NULL ? b->data : self->rx_discard };
+		long long rx_timestamp = 0;
+		int flags = 0, ret;
+		ret = SoapySDRDevice_readStream(self->sdr, self->rxstream,
+			rxbuffs, rx_buflen, &flags, &rx_timestamp, self->timeout_us);
+		if (ret <= 0) {
+			soapy_fail("SoapySDRDevice_readStream", ret);
+			continue;
+		}
+		if (b != NULL) {
+			b->len = ret;
+			b->flags = flags;
+			b->time = rx_timestamp;
+			block_ring_write_put(self->rx_ring);
+		}
+	}
+
+	block_ring_close(self->rx_ring);
+	return NULL;
+}
+
+
+/* Try to give a thread a real-time priority, so that it gets
+ * to run even when DSP is keeping every core busy.
+ * This needs permissions, so just warn if it fails. */
+static void set_realtime_priority(pthread_t thread, const char *what)
+{
+	struct sched_param param = {
+		.sched_priority = sched_get_priority_max(SCHED_FIFO) / 2
+	};
+	int ret = pthread_setschedparam(thread, SCHED_FIFO, &param);
+	if (ret != 0)
+		fprintf(stderr, "Warning: could not set real-time priority for %s thread: %s\n", what, strerror(ret));
+}
+
+
+static int start_rx_reader(struct soapysdr_io *self)
+{
+	const struct soapysdr_io_conf *const conf = &self->conf;
+	const size_t blockbytes = self->format_size * conf->buffer;
+	int ret;
+
+	self->rx_ring = block_ring_init(conf->rx_ring, blockbytes);
+	self->rx_discard = malloc(blockbytes);
+	if (self->rx_ring == NULL || self->rx_discard == NULL)
+		return -1;
+
+	ret = pthread_create(&self->rx_thread, NULL, rx_reader_main, self);
+	if (ret != 0) {
+		fprintf(stderr, "Failed to create RX reader thread: %s\n", strerror(ret));
+		return -1;
+	}
+	self->rx_thread_started = 1;
+	set_realtime_priority(self->rx_thread, "RX reader");
+	return 0;
+}
+
+
+static void print_ring_stats(struct block_ring *ring, const char *name)
+{
+	struct block_ring_stats st;
+	block_ring_get_stats(ring, &st);
+	fprintf(stderr, "%s: %zu/%zu blocks filled, high-water mark %zu, %llu overflows\n",
+		name, st.fill, st.size, st.high_water, (unsigned long long)st.overflows);
+}
+
+
+static void print_chan_stats(struct rx_chan *ch)
+{
+	char name[40];
+	snprintf(name, sizeof(name), "RX channel %zu ring", ch->channel);
+	print_ring_stats(ch->ring, name);
+}
+
+
+static void print_rx_ring_stats(struct soapysdr_io *self)
+{
+	unsigned i;
+	if (self->rx_ring != NULL)
+		print_ring_stats(self->rx_ring, "RX ring");
+	for (i = 0; i < self->nchan; i++) {
+		if (self->chans[i].ring != NULL)
+			print_chan_stats(&self->chans[i]);
+	}
+}
+
+
+/* RX output used by the receivers in multi-channel reception.
+ * Tags frames with the channel number and passes them on
+ * to the actual RX output, one at a time. */
+static int chan_frame(void *arg, const struct frame *frame)
+{
+	struct rx_chan *ch = arg;
+	struct soapysdr_io *self = ch->io;
+	int ret;
+
+	const size_t size = sizeof(struct frame) + frame->m.len;
+	if (size > ch->frame_size) {
+		struct frame *f = realloc(ch->frame, size);
+		if (f == NULL)
+			return -1;
+		ch->frame = f;
+		ch->frame_size = size;
+	}
+	memcpy(ch->frame, frame, size);
+	if (!(ch->frame->m.flags & METADATA_ID)) {
+		ch->frame->m.id = ch->channel;
+		ch->frame->m.flags |= METADATA_ID;
+	}
+
+	pthread_mutex_lock(&self->output_lock);
+	ret = self->rx_output->frame(self->rx_output_arg, ch->frame);
+	pthread_mutex_unlock(&self->output_lock);
+	return ret;
+}
+
+
+/* All channels share the same time, so pass ticks only from the first one */
+static int chan_tick(void *arg, timestamp_t timenow)
+{
+	struct rx_chan *ch = arg;
+	struct soapysdr_io *self = ch->io;
+	int ret;
+	if (ch != &self->chans[0] || self->rx_output->tick == NULL)
+		return 0;
+	pthread_mutex_lock(&self->output_lock);
+	ret = self->rx_output->tick(self->rx_output_arg, timenow);
+	pthread_mutex_unlock(&self->output_lock);
+	return ret;
+}
+
+
+static const struct rx_output_code chan_output_code = { "soapysdr_io_channel", NULL, NULL, NULL, NULL, NULL, chan_frame, chan_tick };
+
+
+static void *rx_worker_main(void *arg)
+{
+	struct rx_chan *ch = arg;
+	struct ring_block *b;
+	// Runs until the ring has been closed and emptied
+	while ((b = block_ring_read_get(ch->ring, -1)) != NULL) {
+		rx_execute(ch->io, ch->receiver_arg, ch->convbuf, b->data, b->len, b->time);
+		block_ring_read_put(ch->ring);
+	}
+	return NULL;
+}
+
+
+/* Pin a thread to a CPU core, so that the receivers
+ * of different channels do not compete for the same core */
+static void set_thread_cpu(pthread_t thread, int cpu)
+{
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	int ret = pthread_setaffinity_np(thread, sizeof(set), &set);
+	if (ret != 0)
+		fprintf(stderr, "Warning: could not pin RX worker thread to CPU %d: %s\n", cpu, strerror(ret));
+#else
+	(void)thread;
+	fprintf(stderr, "Warning: pinning RX worker thread to CPU %d not supported\n", cpu);
+#endif
+}
+
+
+/* Create a receiver instance, a ring and a worker thread for each
+ * RX channel. The first channel uses the receiver instance
+ * given in set_callbacks. */
+static int start_rx_channels(struct soapysdr_io *self, unsigned nchan)
+{
+	const struct soapysdr_io_conf *const conf = &self->conf;
+	const size_t blockbytes = self->format_size * conf->buffer;
+	unsigned i;
+	int ret;
+
+	if (self->receiver_conf == NULL || self->rx_output == NULL) {
+		fprintf(stderr, "Multi-channel RX needs a receiver configuration\n");
+		return -1;
+	}
+	self->chans = calloc(nchan, sizeof(struct rx_chan));
+	self->rx_discard = malloc(blockbytes);
+	if (self->chans == NULL || self->rx_discard == NULL)
+		return -1;
+	self->nchan = nchan;
+
+	for (i = 0; i < nchan; i++) {
+		struct rx_chan *ch = &self->chans[i];
+		ch->io = self;
+		ch->channel = conf->rx_channel + i;
+		if (i == 0)
+			ch->receiver_arg = self->receiver_arg;
+		else
+			ch->receiver_arg = self->receiver->init(self->receiver_conf);
+		if (ch->receiver_arg == NULL)
+			return -1;
+		self->receiver->set_callbacks(ch->receiver_arg, &chan_output_code, ch);
+
+		ch->ring = block_ring_init(conf->rx_ring, blockbytes);
+		if (ch->ring == NULL)
+			return -1;
+		if (self->format != FORMAT_CF32
+		&& (ch->convbuf = malloc(sizeof(sample_t) * conf->buffer)) == NULL)
+			return -1;
+	}
+
+	for (i = 0; i < nchan; i++) {
+		struct rx_chan *ch = &self->chans[i];
+		ret = pthread_create(&ch->thread, NULL, rx_worker_main, ch);
+		if (ret != 0) {
+			fprintf(stderr, "Failed to create RX worker thread: %s\n", strerror(ret));
+			return -1;
+		}
+		ch->thread_started = 1;
+		if (conf->rx_cpu >= 0)
+			set_thread_cpu(ch->thread, conf->rx_cpu + i);
+	}
+	fprintf(stderr, "Receiving %u channels\n", nchan);
+	return 0;
+}
+
+
+static void stop_rx_channels(struct soapysdr_io *self)
+{
+	unsigned i;
+	if (self->chans == NULL)
+		return;
+	for (i = 0; i < self->nchan; i++) {
+		if (self->chans[i].ring != NULL)
+			block_ring_close(self->chans[i].ring);
+	}
+	for (i = 0; i < self->nchan; i++) {
+		struct rx_chan *ch = &self->chans[i];
+		if (ch->thread_started)
+			pthread_join(ch->thread, NULL);
+		if (ch->ring != NULL)
+			print_chan_stats(ch);
+		block_ring_destroy(ch->ring);
+		free(ch->convbuf);
+		free(ch->frame);
+		if (i > 0 && ch->receiver_arg != NULL)
+			self->receiver->destroy(ch->receiver_arg);
+	}
+	// Give the first receiver its original output back
+	self->receiver->set_callbacks(self->receiver_arg, self->rx_output, self->rx_output_arg);
+	free(self->chans);
+	self->chans = NULL;
+	self->nchan = 0;
+}
+
+
+/* Read all RX channels and pass them to the worker threads.
+ * If the ring of a channel is full, the samples of that channel
+ * are read into a scratch buffer and discarded. */
+static void rx_read_channels(struct soapysdr_io *self)
+{
+	const unsigned nchan = self->nchan;
+	struct ring_block *blocks[nchan];
+	void *rxbuffs[nchan];
+	long long rx_timestamp = 0;
+	int flags = 0, ret;
+	unsigned i;
+
+	for (i = 0; i < nchan; i++) {
+		blocks[i] = block_ring_write_get(self->chans[i].ring, 0);
+		rxbuffs[i] = blocks[i] != NULL ? blocks[i]->data : self->rx_discard;
+	}
+	ret = SoapySDRDevice_readStream(self->sdr, self->rxstream,
+		rxbuffs, self->conf.buffer, &flags, &rx_timestamp, self->timeout_us);
+	if (ret <= 0) {
+		soapy_fail("SoapySDRDevice_readStream", ret);
+		return;
+	}
+	// All channels come from the same stream and share the timestamp
+	rx_timestamp = rx_time(self, ret, flags, rx_timestamp);
+	for (i = 0; i < nchan; i++) {
+		if (blocks[i] == NULL)
+			continue;
+		blocks[i]->len = ret;
+		blocks[i]->flags = flags;
+		blocks[i]->time = rx_timestamp;
+		block_ring_write_put(self->chans[i].ring);
+	}
+}
+
+
+/* Acquire a buffer from the driver for direct TX */
+static int tx_direct_acquire(struct soapysdr_io *self)
+{
+	void *buffs[1];
+	int ret = SoapySDRDevice_acquireWriteBuffer(self->sdr, self->txstream,
+		&self->tx_direct_handle, buffs, self->timeout_us);
+	if (ret <= 0) {
+		soapy_fail("SoapySDRDevice_acquireWriteBuffer", ret);
+		return -1;
+	}
+	self->tx_direct_held = 1;
+	self->tx_direct_buf = buffs[0];
+	self->tx_direct_len = ret;
+	return 0;
+}
+
+
+/* Write a part of the TX buffer to buffers from the driver.
+ * If it does not fit in the held buffer, the rest is written
+ * to further buffers and only the last one gets
+ * the end of burst flag. */
+static void tx_write_direct(struct soapysdr_io *self, sample_t *buf, size_t len, int flags, long long time)
+{
+	while (len > 0) {
+		if (!self->tx_direct_held && tx_direct_acquire(self) < 0)
+			return;
+		const size_t n = len < self->tx_direct_len ? len : self->tx_direct_len;
+		int f = n < len ? flags & ~SOAPY_SDR_END_BURST : flags;
+		if (self->format != FORMAT_CF32) {
+			if (self->format == FORMAT_CS16)
+				cf_to_cs16_scale(buf, self->tx_direct_buf, n, self->tx_scale);
+			else
+				cf_to_cs8_scale(buf, self->tx_direct_buf, n, self->tx_scale);
+		} else if (buf != self->tx_direct_buf) {
+			/* Move the data to the beginning of the driver's buffer
+			 * if the burst starts in the middle, or copy it there
+			 * if a new buffer was taken for the burst. Either
+			 * only happens once per burst. */
+			memmove(self->tx_direct_buf, buf, sizeof(sample_t) * n);
+		}
+		SoapySDRDevice_releaseWriteBuffer(self->sdr, self->txstream,
+			self->tx_direct_handle, n, &f, time);
+		self->tx_direct_held = 0;
+		buf += n;
+		len -= n;
+		time += (long long)(self->sample_ns * n);
+	}
+}
+
+
+/* Write a part of the TX buffer to the stream */
+static void tx_write(struct soapysdr_io *self, sample_t *buf, size_t len, int flags, long long time)
+{
+	int ret;
+	void *out = buf;
+	if (self->tx_direct) {
+		tx_write_direct(self, buf, len, flags, time);
+		return;
+	}
+	if (self->format != FORMAT_CF32) {
+		// Convert into a buffer for writeStream
+		out = self->tx_convbuf;
+		if (self->format == FORMAT_CS16)
+			cf_to_cs16_scale(buf, out, len, self->tx_scale);
+		else
+			cf_to_cs8_scale(buf, out, len, self->tx_scale);
+	}
+
+	const void *txbuffs[] = { out };
+	ret = SoapySDRDevice_writeStream(self->sdr, self->txstream,
+		txbuffs, len, &flags, time, self->timeout_us);
+	if(ret <= 0)
+		soapy_fail("SoapySDRDevice_writeStream", ret);
+}
+
+
+/* Generate TX signal until tx_latency ahead of current time
+ * and write it to the stream */
+static void tx_process(struct soapysdr_io *self, long long current_time)
+{
+	const struct soapysdr_io_conf *const conf = &self->conf;
+	const double sample_ns = self->sample_ns;
+	const int time_flags = conf->use_time ? SOAPY_SDR_HAS_TIME : 0;
+	int ret;
+	tx_return_t ntx = { 0, 0, 0 };
+	timestamp_t tx_from_time, tx_until_time;
+	tx_from_time = self->tx_last_end_time;
+	tx_until_time = current_time + self->tx_latency_time;
+	int nsamp = round((double)(tx_until_time - tx_from_time) / sample_ns);
+	//fprintf(stderr, "TX nsamp: %d\n", nsamp);
+
+	sample_t *txbuf = self->txbuf;
+	size_t tx_buflen = self->tx_buflen;
+	if (nsamp > 0 && self->tx_direct) {
+		/* Generate the signal straight into a buffer from the driver.
+		 * If nothing ends up being transmitted, the buffer is kept
+		 * and used again next time. */
+		if (!self->tx_direct_held && tx_direct_acquire(self) < 0)
+			return;
+		/* If the stream format is not CF32, the signal is
+		 * converted into the driver's buffer when written. */
+		if (self->format == FORMAT_CF32)
+			txbuf = self->tx_direct_buf;
+		if (tx_buflen > self->tx_direct_len)
+			tx_buflen = self->tx_direct_len;
+	}
+
+	if (nsamp > 0) {
+		if ((unsigned)nsamp > tx_buflen)
+			nsamp = tx_buflen;
+		ntx = self->transmitter->execute(self->transmitter_arg, txbuf, nsamp, tx_from_time);
+		assert(ntx.len >= 0 && ntx.len <= nsamp);
+		assert(ntx.end >= 0 && ntx.end <= /*ntx.len*/nsamp);
+		assert(ntx.begin >= 0 && ntx.begin <= /*ntx.len*/nsamp);
+		if (conf->tx_cont) {
+			// Disregard begin and end in case continuous transmit stream is configured
+			ntx.begin = 0;
+			ntx.end = ntx.len;
+		}
+		self->tx_last_end_time = tx_from_time + (timestamp_t)(sample_ns * ntx.len);
+	}
+
+	if (self->tx_burst_going && ntx.begin > 0) {
+		/* If end of burst flag wasn't sent in last round,
+		 * send it now together with one dummy sample.
+		 * One sample is sent because trying to send
+		 * zero samples gave a timeout error. */
+		sample_t zero[1] = { 0 };
+		int flags = time_flags | SOAPY_SDR_END_BURST;
+		self->tx_burst_going = 0;
+		if (self->tx_direct) {
+			/* Send the dummy sample in the held buffer so that
+			 * buffers go back to the driver in order. The new burst
+			 * is then written to further buffers. A signal generated
+			 * straight into the held buffer is saved first.
+			 * The dummy sample overwrites the first sample,
+			 * which is before the new burst begins. */
+			if (txbuf == self->tx_direct_buf && ntx.end > ntx.begin) {
+				memcpy(self->txbuf + ntx.begin, txbuf + ntx.begin,
+					sizeof(sample_t) * (ntx.end - ntx.begin));
+				txbuf = self->txbuf;
+			}
+			tx_write(self, zero, 1, flags, tx_from_time);
+		} else {
+			const void *txbuffs[] = { zero };
+			ret = SoapySDRDevice_writeStream(self->sdr, self->txstream,
+				txbuffs, 1, &flags,
+				tx_from_time, self->timeout_us);
+			if(ret <= 0)
+				soapy_fail("SoapySDRDevice_writeStream (end of burst)", ret);
+		}
+	}
+
+	if (ntx.end > ntx.begin) {
+		int flags = time_flags;
+		// If ntx.end does not point to end of the buffer, a burst has ended
+		if (ntx.end < ntx.len) {
+			flags |= SOAPY_SDR_END_BURST;
+			self->tx_burst_going = 0;
+		} else {
+			self->tx_burst_going = 1;
+		}
+
+		tx_write(self, txbuf + ntx.begin, ntx.end - ntx.begin, flags,
+			tx_from_time + (timestamp_t)(sample_ns * ntx.begin));
+	} else {
+		self->tx_burst_going = 0;
+	}
+}
+
+
+// Tell the TX thread the current stream time
+static void publish_time(struct soapysdr_io *self, long long current_time)
+{
+	long long clock = monotonic_ns();
+	pthread_mutex_lock(&self->time_lock);
+	self->sync_time = current_time;
+	self->sync_clock = clock;
+	pthread_mutex_unlock(&self->time_lock);
+}
+
+
+// Estimate the current stream time from the latest published one
+static long long estimate_time(struct soapysdr_io *self)
+{
+	long long clock = monotonic_ns();
+	pthread_mutex_lock(&self->time_lock);
+	long long t = self->sync_time + (clock - self->sync_clock);
+	pthread_mutex_unlock(&self->time_lock);
+	return t;
+}
+
+
+/* TX thread.
+ * Keeps the generated signal tx_latency ahead of the stream time,
+ * independently of how long the receiver takes to process a buffer.
+ * The driver's TX buffers work as the queue of generated signal.
+ * When enough has been generated, the thread sleeps until the
+ * lead has dropped to 3/4 of tx_latency. */
+static void *tx_thread_main(void *arg)
+{
+	struct soapysdr_io *self = arg;
+	const long long report_time = 1.0e9 * self->conf.report_interval;
+	long long now = estimate_time(self);
+	long long next_report_time = now + report_time;
+	// Lead time statistics for reports
+	long long lead_min = LLONG_MAX, lead_sum = 0;
+	unsigned long lead_n = 0, underruns = 0;
+
+	while (running) {
+		now = estimate_time(self);
+		long long lead = self->tx_last_end_time - now;
+		if (lead < lead_min)
+			lead_min = lead;
+		lead_sum += lead;
+		lead_n++;
+		if (lead < 0)
+			underruns++;
+
+		tx_process(self, now);
+
+		if (report_time > 0 && now >= next_report_time) {
+			fprintf(stderr, "TX lead time: min %lld us, average %lld us, %lu underruns\n",
+				lead_min / 1000, lead_sum / (long long)lead_n / 1000, underruns);
+			lead_min = LLONG_MAX;
+			lead_sum = 0;
+			lead_n = underruns = 0;
+			next_report_time = now + report_time;
+		}
+
+		long long sleep_ns = self->tx_last_end_time - now - self->tx_latency_time * 3 / 4;
+		if (sleep_ns > 0) {
+			struct timespec t = { sleep_ns / 1000000000LL, sleep_ns % 1000000000LL };
+			nanosleep(&t, NULL);
+		}
+	}
+	return NULL;
+}
+
+
+static int start_tx_thread(struct soapysdr_io *self, long long current_time)
+{
+	int ret;
+	publish_time(self, current_time);
+	ret = pthread_create(&self->tx_thread, NULL, tx_thread_main, self);
+	if (ret != 0) {
+		fprintf(stderr, "Failed to create TX thread: %s\n", strerror(ret));
+		return -1;
+	}
+	self->tx_thread_started = 1;
+	set_realtime_priority(self->tx_thread, "TX");
+	return 0;
+}
+
+
+/* Check whether direct buffer access can be used for a stream */
+static bool direct_access_supported(SoapySDRDevice *sdr, SoapySDRStream *stream, const char *what)
+{
+	size_t n = SoapySDRDevice_getNumDirectAccessBuffers(sdr, stream);
+	if (n == 0) {
+		fprintf(stderr, "Warning: %s stream does not support direct buffer access, copying samples\n", what);
+		return 0;
+	}
+	fprintf(stderr, "Using direct buffer access on %s stream (%zu buffers, MTU %zu)\n",
+		what, n, SoapySDRDevice_getStreamMTU(sdr, stream));
+	return 1;
+}
+
+
+/* Parse the format configuration and find out the scaling
+ * between sample_t and the stream format. */
+/* Full scale value of the stream format in one direction.
+ * Some devices do not use the whole range of the format,
+ * e.g. 12-bit converters with CS16. If the format is native
+ * to the device, use the full scale value it reports. */
+static float native_full_scale(struct soapysdr_io *self, SoapySDRDevice *sdr, int dir, size_t ch, float full_scale)
+{
+	const struct soapysdr_io_conf *const conf = &self->conf;
+	double native_scale = 0;
+	char *native = SoapySDRDevice_getNativeStreamFormat(sdr, dir, ch, &native_scale);
+	if (native != NULL) {
+		fprintf(stderr, "Native %s stream format %s, full scale %g\n",
+			dir == SOAPY_SDR_RX ? "RX" : "TX", native, native_scale);
+		if (strcmp(native, conf->format) == 0 && native_scale > 0 && self->format != FORMAT_CF32)
+			full_scale = native_scale;
+#if SOAPY_SDR_API_VERSION >= 0x00080000
+		SoapySDR_free(native);
+#else
+		free(native);
+#endif
+	}
+	return full_scale;
+}
+
+
+static int setup_format(struct soapysdr_io *self, SoapySDRDevice *sdr)
+{
+	const struct soapysdr_io_conf *const conf = &self->conf;
+	float full_scale;
+	if (strcmp(conf->format, SOAPY_SDR_CF32) == 0) {
+		self->format = FORMAT_CF32;
+		self->format_size = sizeof(sample_t);
+		full_scale = 1.0f;
+	} else if (strcmp(conf->format, SOAPY_SDR_CS16) == 0) {
+		self->format = FORMAT_CS16;
+		self->format_size = sizeof(cs16_t);
+		full_scale = 0x8000;
+	} else if (strcmp(conf->format, SOAPY_SDR_CS8) == 0) {
+		self->format = FORMAT_CS8;
+		self->format_size = sizeof(cs8_t);
+		full_scale = 0x80;
+	} else {
+		fprintf(stderr, "Unsupported stream format %s\n", conf->format);
+		return -1;
+	}
+
+	// The converters in each direction may have a different range
+	self->rx_scale = 1.0f / (conf->rx_on
+		? native_full_scale(self, sdr, SOAPY_SDR_RX, conf->rx_channel, full_scale)
+		: full_scale);
+	self->tx_scale = conf->tx_on
+		? native_full_scale(self, sdr, SOAPY_SDR_TX, conf->tx_channel, full_scale)
+		: full_scale;
+	return 0;
+}
+
+
 static int execute(void *arg)
 {
 	struct soapysdr_io *self = arg;
@@ -69,13 +851,17 @@ static int execute(void *arg)
 
 	const double sample_ns = 1.0e9 / conf->samplerate;
 	const long long tx_latency_time = sample_ns * conf->tx_latency;
-	const size_t rx_buflen = conf->buffer;
-	// Reserve a bit more space in TX buffer to allow for timing variations
-	const size_t tx_buflen = rx_buflen * 3 / 2;
-	// Timeout a few times the buffer length
-	const long timeout_us = sample_ns * 0.001 * 10.0 * rx_buflen;
-	// Used for lost sample detection
-	const long long timediff_max = sample_ns * 0.5;
+	size_t rx_buflen;
+	long timeout_us;
+	const long long report_time = 1.0e9 * conf->report_interval;
+	// Number of RX channels and their channel numbers
+	const unsigned nrx = conf->rx_channels > 1 ? conf->rx_channels : 1;
+	size_t rx_chan_list[nrx];
+	unsigned i;
+	for (i = 0; i < nrx; i++)
+		rx_chan_list[i] = conf->rx_channel + i;
+	self->sample_ns = sample_ns;
+	self->tx_latency_time = tx_latency_time;
 
 	/*--------------------------------
 	 ---- Hardware initialization ----
@@ -102,25 +888,25 @@ static int execute(void *arg)
 		goto exit_soapy;
 	}
 
-	if (conf->rx_on) {
-		fprintf(stderr, "Configuring RX\n");
+	if (conf->rx_on) for (i = 0; i < nrx; i++) {
+		fprintf(stderr, "Configuring RX channel %zu\n", rx_chan_list[i]);
 		/* On some devices (e.g. xtrx), sample rate needs to be set before
 		* center frequency or the driver crashes */
 		SOAPYCHECK(SoapySDRDevice_setSampleRate,
-			sdr, SOAPY_SDR_RX, conf->rx_channel,
+			sdr, SOAPY_SDR_RX, rx_chan_list[i],
 			conf->samplerate);
 
 		SOAPYCHECK(SoapySDRDevice_setFrequency,
-			sdr, SOAPY_SDR_RX, conf->rx_channel,
+			sdr, SOAPY_SDR_RX, rx_chan_list[i],
 			conf->rx_centerfreq, NULL);
 
 		if(conf->rx_antenna != NULL)
 			SOAPYCHECK(SoapySDRDevice_setAntenna,
-				sdr, SOAPY_SDR_RX, conf->rx_channel,
+				sdr, SOAPY_SDR_RX, rx_chan_list[i],
 				conf->rx_antenna);
 
 		SOAPYCHECK(SoapySDRDevice_setGain,
-			sdr, SOAPY_SDR_RX, conf->rx_channel,
+			sdr, SOAPY_SDR_RX, rx_chan_list[i],
 			conf->rx_gain);
 	}
 
@@ -144,22 +930,25 @@ static int execute(void *arg)
 			conf->samplerate);
 	}
 
+	if (setup_format(self, sdr) < 0)
+		goto exit_soapy;
+
 #if SOAPY_SDR_API_VERSION < 0x00080000
 	if (conf->rx_on) {
 		SOAPYCHECK(SoapySDRDevice_setupStream,
 			sdr, &rxstream, SOAPY_SDR_RX,
-			SOAPY_SDR_CF32, &conf->rx_channel, 1, &conf->rx_args);
+			conf->format, rx_chan_list, nrx, &conf->rx_args);
 	}
 
 	if (conf->tx_on) {
 		SOAPYCHECK(SoapySDRDevice_setupStream,
 			sdr, &txstream, SOAPY_SDR_TX,
-			SOAPY_SDR_CF32, &conf->tx_channel, 1, &conf->tx_args);
+			conf->format, &conf->tx_channel, 1, &conf->tx_args);
 	}
 #else
 	if (conf->rx_on) {
 		rxstream = SoapySDRDevice_setupStream(sdr,
-			SOAPY_SDR_RX, SOAPY_SDR_CF32, &conf->rx_channel, 1, &conf->rx_args);
+			SOAPY_SDR_RX, conf->format, rx_chan_list, nrx, &conf->rx_args);
 		if(rxstream == NULL) {
 			soapy_fail("SoapySDRDevice_setupStream", 0);
 			goto exit_soapy;
@@ -168,7 +957,7 @@ static int execute(void *arg)
 
 	if (conf->tx_on) {
 		txstream = SoapySDRDevice_setupStream(sdr,
-			SOAPY_SDR_TX, SOAPY_SDR_CF32, &conf->tx_channel, 1, &conf->tx_args);
+			SOAPY_SDR_TX, conf->format, &conf->tx_channel, 1, &conf->tx_args);
 		if(txstream == NULL) {
 			soapy_fail("SoapySDRDevice_setupStream", 0);
 			goto exit_soapy;
@@ -176,6 +965,64 @@ static int execute(void *arg)
 	}
 #endif
 
+	self->sdr = sdr;
+	self->rxstream = rxstream;
+	self->txstream = txstream;
+
+	if (conf->direct_buffers) {
+		if (conf->rx_on && (conf->rx_thread || nrx > 1))
+			fprintf(stderr, "Warning: direct buffer access is not used for RX with rx_thread or multiple channels\n");
+		else if (conf->rx_on)
+			self->rx_direct = direct_access_supported(sdr, rxstream, "RX");
+		if (conf->tx_on)
+			self->tx_direct = direct_access_supported(sdr, txstream, "TX");
+	}
+	size_t rx_mtu = 0;
+	if (self->rx_direct) {
+		/* RX buffers come from the driver one packet at a time.
+		 * Align the buffer size to the packet size as well,
+		 * since it determines the timeouts and TX buffer size. */
+		size_t mtu = rx_mtu = SoapySDRDevice_getStreamMTU(sdr, rxstream);
+		if (mtu > 0 && conf->buffer % mtu != 0) {
+			size_t n = (conf->buffer + mtu / 2) / mtu;
+			self->conf.buffer = (n > 0 ? n : 1) * mtu;
+			fprintf(stderr, "RX buffer size aligned to %u samples\n", conf->buffer);
+		}
+	}
+
+	rx_buflen = conf->buffer;
+	// Timeout a few times the buffer length
+	timeout_us = sample_ns * 0.001 * 10.0 * rx_buflen;
+	self->timeout_us = timeout_us;
+	// Reserve a bit more space in TX buffer to allow for timing variations
+	self->tx_buflen = rx_buflen * 3 / 2;
+	/* With direct TX of CF32, this is only used to save the signal
+	 * when the end of a previous burst is sent */
+	if (conf->tx_on) {
+		self->txbuf = malloc(sizeof(sample_t) * self->tx_buflen);
+		if (self->txbuf == NULL)
+			goto exit_soapy;
+	}
+	if (self->format != FORMAT_CF32) {
+		// Direct RX buffers may be longer than the configured length
+		size_t n = rx_buflen > rx_mtu ? rx_buflen : rx_mtu;
+		if (conf->rx_on && (self->rx_convbuf = malloc(sizeof(sample_t) * n)) == NULL)
+			goto exit_soapy;
+		if (conf->tx_on && (self->tx_convbuf = malloc(self->format_size * self->tx_buflen)) == NULL)
+			goto exit_soapy;
+	}
+
+	if (conf->rx_on && conf->shm_name != NULL) {
+#ifndef _WIN32
+		self->shm = shm_ring_create(conf->shm_name, conf->shm_blocks, rx_buflen, conf->samplerate);
+		if (self->shm == NULL)
+			goto exit_soapy;
+		fprintf(stderr, "Publishing received signal in shared memory ring %s\n", conf->shm_name);
+#else
+		fprintf(stderr, "Warning: shared memory ring is not supported on Windows\n");
+#endif
+	}
+
 	fprintf(stderr, "Starting streams\n");
 	if (conf->rx_on)
 		SOAPYCHECK(SoapySDRDevice_activateStream, sdr,
@@ -189,17 +1036,61 @@ static int execute(void *arg)
 	 --------- Main loop ---------
 	 -----------------------------*/
 
-	bool tx_burst_going = 0;
-
 	long long current_time = 0;
 	if (conf->use_time)
 		current_time = SoapySDRDevice_getHardwareTime(sdr, "");
-	/* tx_last_end_time is when the previous produced TX buffer
-	 * ended, i.e. where the next buffer should begin */
-	long long tx_last_end_time = current_time + tx_latency_time;
+	self->current_time = current_time;
+	self->tx_last_end_time = current_time + tx_latency_time;
+	self->tx_burst_going = 0;
+	long long next_report_time = current_time + report_time;
+
+	if (conf->rx_on && nrx > 1) {
+		if (start_rx_channels(self, nrx) < 0)
+			goto exit_soapy;
+	} else if (conf->rx_on && conf->rx_thread) {
+		if (start_rx_reader(self) < 0)
+			goto exit_soapy;
+	}
+	if (conf->tx_on && conf->tx_thread) {
+		if (start_tx_thread(self, current_time) < 0)
+			goto exit_soapy;
+	}
 
 	while(running) {
-		if (conf->rx_on) {
+		if (conf->rx_on && self->nchan > 0) {
+			rx_read_channels(self);
+			current_time = self->current_time;
+			if (report_time > 0 && current_time >= next_report_time) {
+				print_rx_ring_stats(self);
+				next_report_time = current_time + report_time;
+			}
+		} else if (conf->rx_on && self->rx_ring != NULL) {
+			struct ring_block *b = block_ring_read_get(self->rx_ring, timeout_us);
+			if (b != NULL) {
+				rx_process(self, b->data, b->len, b->flags, b->time);
+				block_ring_read_put(self->rx_ring);
+			}
+			current_time = self->current_time;
+			if (report_time > 0 && current_time >= next_report_time) {
+				print_rx_ring_stats(self);
+				next_report_time = current_time + report_time;
+			}
+		} else if (conf->rx_on && self->rx_direct) {
+			/* Pass the driver's buffer straight to the receiver */
+			const void *rxbuffs[1];
+			size_t handle;
+			long long rx_timestamp = 0;
+			int flags = 0, ret;
+			ret = SoapySDRDevice_acquireReadBuffer(sdr, rxstream,
+				&handle, rxbuffs, &flags, &rx_timestamp, timeout_us);
+			if (ret > 0) {
+				rx_process(self, rxbuffs[0], ret, flags, rx_timestamp);
+				SoapySDRDevice_releaseReadBuffer(sdr, rxstream, handle);
+				current_time = self->current_time;
+			} else {
+				soapy_fail("SoapySDRDevice_acquireReadBuffer", ret);
+			}
+		} else if (conf->rx_on) {
 			sample_t rxbuf[rx_buflen];
 			void *rxbuffs[] = { rxbuf };
 			long long rx_timestamp = 0;
@@ -207,32 +1098,20 @@ static int execute(void *arg)
 			ret = SoapySDRDevice_readStream(sdr, rxstream,
 				rxbuffs, rx_buflen, &flags, &rx_timestamp, timeout_us);
 			if (ret > 0) {
-				/* Estimate current time from the end of the received buffer.
-				* If there's no timestamp, make one up by incrementing time.
-				*
-				* If there were no lost samples, the received buffer should
-				* begin from the previous "current" time. Calculate the
-				* difference to detect lost samples.
-				* TODO: if configured, feed zero padding samples to receiver
-				* module to correct timing after lost samples. */
-				if (conf->use_time && (flags & SOAPY_SDR_HAS_TIME)) {
-					long long prev_time = current_time;
-					current_time = rx_timestamp + sample_ns * ret;
-
-					long long timediff = rx_timestamp - prev_time;
-					// this can produce a lot of print, not the best way to do it
-					if (timediff < -timediff_max)
-						fprintf(stderr, "%20lld: Time went backwards %lld ns!\n", rx_timestamp, -timediff);
-					else if (timediff > timediff_max)
-						fprintf(stderr, "%20lld: Lost samples for %lld ns!\n", rx_timestamp, timediff);
-				} else {
-					rx_timestamp = current_time; // from previous iteration
-					current_time += sample_ns * ret + 0.5;
-				}
-				self->receiver->execute(self->receiver_arg, rxbuf, ret, rx_timestamp);
+				rx_process(self, rxbuf, ret, flags, rx_timestamp);
+				current_time = self->current_time;
 			} else if(ret <= 0) {
 				soapy_fail("SoapySDRDevice_readStream", ret);
 			}
+		} else if (self->tx_thread_started) {
+			/* TX-only case with the TX thread.
+			 * Just keep the TX thread in sync with hardware time. */
+			long long t = sample_ns * conf->buffer;
+			struct timespec ts = { t / 1000000000LL, t % 1000000000LL };
+			nanosleep(&ts, NULL);
+			if (conf->use_time)
+				publish_time(self, SoapySDRDevice_getHardwareTime(sdr, ""));
+			continue;
 		} else {
 			/* TX-only case */
 			if (conf->use_time) {
@@ -249,77 +1128,49 @@ static int execute(void *arg)
 			}
 		}
 
-		if (conf->tx_on) {
-			sample_t txbuf[tx_buflen];
-			int flags = 0, ret;
-			tx_return_t ntx = { 0, 0, 0 };
-			timestamp_t tx_from_time, tx_until_time;
-			tx_from_time = tx_last_end_time;
-			tx_until_time = current_time + tx_latency_time;
-			int nsamp = round((double)(tx_until_time - tx_from_time) / sample_ns);
-			//fprintf(stderr, "TX nsamp: %d\n", nsamp);
-
-			if (nsamp > 0) {
-				if ((unsigned)nsamp > tx_buflen)
-					nsamp = tx_buflen;
-				ntx = self->transmitter->execute(self->transmitter_arg, txbuf, nsamp, tx_from_time);
-				assert(ntx.len >= 0 && ntx.len <= nsamp);
-				assert(ntx.end >= 0 && ntx.end <= /*ntx.len*/nsamp);
-				assert(ntx.begin >= 0 && ntx.begin <= /*ntx.len*/nsamp);
-				if (conf->tx_cont) {
-					// Disregard begin and end in case continuous transmit stream is configured
-					ntx.begin = 0;
-					ntx.end = ntx.len;
-				}
-				tx_last_end_time = tx_from_time + (timestamp_t)(sample_ns * ntx.len);
-			}
-
-			if (conf->use_time)
-				flags = SOAPY_SDR_HAS_TIME;
-
-			if (tx_burst_going && ntx.begin > 0) {
-				/* If end of burst flag wasn't sent in last round,
-				 * send it now together with one dummy sample.
-				 * One sample is sent because trying to send
-				 * zero samples gave a timeout error. */
-				txbuf[0] = 0;
-				const void *txbuffs[] = { txbuf };
-				flags |= SOAPY_SDR_END_BURST;
-				ret = SoapySDRDevice_writeStream(sdr, txstream,
-					txbuffs, 1, &flags,
-					tx_from_time, timeout_us);
-				if(ret <= 0)
-					soapy_fail("SoapySDRDevice_writeStream (end of burst)", ret);
-				tx_burst_going = 0;
-			}
-
-			if (ntx.end > ntx.begin) {
-				// If ntx.end does not point to end of the buffer, a burst has ended
-				if (ntx.end < ntx.len) {
-					flags |= SOAPY_SDR_END_BURST;
-					tx_burst_going = 0;
-				} else {
-					tx_burst_going = 1;
-				}
-
-				const void *txbuffs[] = { txbuf + ntx.begin };
-
-				ret = SoapySDRDevice_writeStream(sdr, txstream,
-					txbuffs, ntx.end - ntx.begin, &flags,
-					tx_from_time + (timestamp_t)(sample_ns * ntx.begin),
-					timeout_us);
-				if(ret <= 0)
-					soapy_fail("SoapySDRDevice_writeStream", ret);
-			} else {
-				tx_burst_going = 0;
-			}
-		}
+		if (self->tx_thread_started) {
+			/* Only publish new times, since the time of
+			 * publishing should match the time of reception */
+			if (current_time != self->sync_time)
+				publish_time(self, current_time);
+		} else if (conf->tx_on)
+			tx_process(self, current_time);
 	}
 
 	fprintf(stderr, "Stopped receiving\n");
 
 exit_soapy:
 	//deinitialize(suo); //TODO moved somewhere else
+	running = 0;
+	if (self->tx_thread_started) {
+		pthread_join(self->tx_thread, NULL);
+		self->tx_thread_started = 0;
+	}
+	if (self->rx_thread_started) {
+		pthread_join(self->rx_thread, NULL);
+		self->rx_thread_started = 0;
+		print_rx_ring_stats(self);
+	}
+	stop_rx_channels(self);
+	block_ring_destroy(self->rx_ring);
+	self->rx_ring = NULL;
+	free(self->rx_discard);
+	self->rx_discard = NULL;
+	free(self->txbuf);
+	self->txbuf = NULL;
+	free(self->rx_convbuf);
+	self->rx_convbuf = NULL;
+	free(self->tx_convbuf);
+	self->tx_convbuf = NULL;
+#ifndef _WIN32
+	shm_ring_destroy(self->shm);
+	self->shm = NULL;
+#endif
+	if (self->tx_direct_held) {
+		int flags = 0;
+		SoapySDRDevice_releaseWriteBuffer(sdr, txstream, self->tx_direct_handle, 0, &flags, 0);
+		self->tx_direct_held = 0;
+	}
 
 	if(rxstream != NULL) {
 		fprintf(stderr, "Deactivating stream\n");
@@ -343,6 +1194,8 @@ static void *init(const void *conf)
 	if (self == NULL)
 		return self;
 	self->conf = *(struct soapysdr_io_conf*)conf;
+	pthread_mutex_init(&self->output_lock, NULL);
+	pthread_mutex_init(&self->time_lock, NULL);
 	if (strcmp(SoapySDR_getABIVersion(), SOAPY_SDR_ABI_VERSION) != 0)
 		fprintf(stderr, "Warning: Wrong SoapySDR ABI version\n");
 	return self;
@@ -368,12 +1221,27 @@ static int set_callbacks(void *arg, const struct receiver_code *receiver, void *
 }
 
 
+static int set_receiver_conf(void *arg, const void *receiver_conf, const struct rx_output_code *rx_output, void *rx_output_arg)
+{
+	struct soapysdr_io *self = arg;
+	self->receiver_conf = receiver_conf;
+	self->rx_output = rx_output;
+	self->rx_output_arg = rx_output_arg;
+	return 0;
+}
+
+
 const struct soapysdr_io_conf soapysdr_io_defaults = {
 	.buffer = 2048,
 	.rx_on = 1,
 	.tx_on = 1,
 	.tx_cont = 0,
 	.use_time = 1,
+	.rx_thread = 0,
+	.tx_thread = 0,
+	.direct_buffers = 0,
+	.rx_ring = 32,
+	.report_interval = 10,
 	.tx_latency = 8192,
 	.samplerate = 1e6,
 	.rx_centerfreq = 433.8e6,
@@ -381,9 +1249,14 @@ const struct soapysdr_io_conf soapysdr_io_defaults = {
 	.rx_gain = 60,
 	.tx_gain = 80,
 	.rx_channel = 0,
+	.rx_channels = 1,
+	.rx_cpu = -1,
 	.tx_channel = 0,
 	.rx_antenna = NULL,
-	.tx_antenna = NULL
+	.tx_antenna = NULL,
+	.format = SOAPY_SDR_CF32,
+	.shm_name = NULL,
+	.shm_blocks = 64
 };
 
 CONFIG_BEGIN(soapysdr_io)
@@ -391,7 +1264,12 @@ CONFIG_I(rx_on)
 CONFIG_I(tx_on)
 CONFIG_I(tx_cont)
 CONFIG_I(use_time)
+CONFIG_I(rx_thread)
+CONFIG_I(tx_thread)
+CONFIG_I(direct_buffers)
 CONFIG_I(buffer)
+CONFIG_I(rx_ring)
+CONFIG_F(report_interval)
 CONFIG_I(tx_latency)
 CONFIG_F(samplerate)
 CONFIG_F(rx_centerfreq)
@@ -399,9 +1277,14 @@ CONFIG_F(tx_centerfreq)
 CONFIG_F(rx_gain)
 CONFIG_F(tx_gain)
 CONFIG_I(rx_channel)
+CONFIG_I(rx_channels)
+CONFIG_I(rx_cpu)
 CONFIG_I(tx_channel)
 CONFIG_C(rx_antenna)
 CONFIG_C(tx_antenna)
+CONFIG_C(format)
+CONFIG_C(shm_name)
+CONFIG_I(shm_blocks)
 	if (strncmp(parameter, "soapy-", 6) == 0) {
 		SoapySDRKwargs_set(&c->args, parameter+6, value);
 		return 0;
@@ -421,4 +1304,4 @@ CONFIG_C(tx_antenna)
 CONFIG_END()
 
 
-const struct signal_io_code soapysdr_io_code = { "soapysdr_io", init, destroy, init_conf, set_conf, set_callbacks, execute };
+const struct signal_io_code soapysdr_io_code = { "soapysdr_io", init, destroy, init_conf, set_conf, set_callbacks, execute, set_receiver_conf };
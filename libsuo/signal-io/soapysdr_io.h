@@ -10,9 +10,22 @@ struct soapysdr_io_conf {
 	rx_on:1,     // Enable reception
 	tx_on:1,     // Enable transmission
 	tx_cont:1,   // Write TX as a continuous stream
-	use_time:1;  // Enable use of stream timestamps
+	use_time:1,  // Enable use of stream timestamps
+	rx_thread:1, // Read RX stream in a separate thread
+	/* Generate and write TX signal in a separate thread,
+	 * so that tx_latency does not need to cover RX processing time */
+	tx_thread:1,
+	/* Use direct access to driver buffers, if supported,
+	 * to avoid copying the samples */
+	direct_buffers:1;
 	// Number of samples in one RX buffer
 	unsigned buffer;
+	/* Number of RX buffers in the ring between the reader thread
+	 * and the receiver, if rx_thread is enabled */
+	unsigned rx_ring;
+	/* Interval for printing RX ring statistics (seconds).
+	 * 0 disables the reports. */
+	double report_interval;
 	/* How much ahead TX signal should be generated (samples).
 	 * Should usually be a few times the RX buffer length. */
 	unsigned tx_latency;
@@ -28,12 +41,30 @@ struct soapysdr_io_conf {
 	float tx_gain;
 	// Radio RX channel number
 	size_t rx_channel;
+	/* Number of RX channels to receive, starting from rx_channel.
+	 * With more than one channel, each channel gets its own
+	 * receiver instance running in its own thread. */
+	unsigned rx_channels;
+	/* CPU core for the receiver thread of the first RX channel.
+	 * Next channels use the next cores. -1 to not pin threads. */
+	int rx_cpu;
 	// Radio TX channel number
 	size_t tx_channel;
 	// Radio RX antenna name
 	const char *rx_antenna;
 	// Radio TX antenna name
 	const char *tx_antenna;
+	/* Sample format used on the streams: CF32, CS16 or CS8.
+	 * Using the native format of the device avoids conversions
+	 * in the driver and reduces memory bandwidth. */
+	const char *format;
+	/* Name of a POSIX shared memory ring to publish the received
+	 * signal in, so that other processes can receive it using
+	 * shm_io. Only the first RX channel is published.
+	 * NULL disables publishing. Not supported on Windows. */
+	const char *shm_name;
+	// Number of RX buffers in the shared memory ring
+	unsigned shm_blocks;
 	// SoapySDR device args, such as the driver to use
 	SoapySDRKwargs args;
 	// SoapySDR receive stream args
@@ -0,0 +1,496 @@
+#include "traffic_io.h"
+#include "suo_macros.h"
+#include "noise.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+// Maximum length of a frame given to the transmitter (bits)
+#define FRAMELEN_MAX 0x900
+/* Give up modulating a burst if the transmitter does not start it
+ * within this many buffers or it does not end within this many samples */
+#define START_TRIES 16
+#define BURST_MAX 10000000
+
+struct burst {
+	// Modulated signal, scaled to the SNR. NULL once it has been mixed in.
+	sample_t *wave;
+	size_t len;
+	// Position of the first sample in the stream
+	uint64_t start;
+	// Oscillator shifting the burst to its frequency
+	sample_t osc, osc_step;
+	// Ground truth
+	timestamp_t time_begin, time_end;
+	bool detected;
+};
+
+// Statistics for a step
+struct traffic_stats {
+	uint64_t offered, detected, missed, false_detections;
+	// Total length of the offered bursts (samples)
+	uint64_t burst_samples;
+	// CPU time used by the receiver and by the generator (ns)
+	long long rx_cpu, gen_cpu;
+};
+
+struct traffic_io {
+	struct traffic_io_conf conf;
+
+	const struct receiver_code *receiver;
+	void *receiver_arg;
+	const struct transmitter_code *transmitter;
+	void *transmitter_arg;
+	const struct rx_output_code *rx_output;
+	void *rx_output_arg;
+
+	sample_t *buf, *modbuf;
+
+	/* Frame given to the transmitter on its next get_frame call */
+	bool frame_pending;
+	struct frame *frame;
+	// Time line of the transmitter, independent of the stream
+	timestamp_t mod_time;
+
+	/* Bursts being mixed into the stream or waiting
+	 * for their detection status to be decided */
+	struct burst *bursts;
+	size_t nbursts, bursts_size;
+
+	// Stream position and time of the buffer given to the receiver
+	uint64_t pos;
+	timestamp_t rx_time;
+	double next_arrival;
+	double rate;
+	float noise_sigma;
+
+	struct noise noise;
+	struct traffic_stats st;
+};
+
+
+static long long cpu_ns(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	return (long long)t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+
+static void *init(const void *conf)
+{
+	struct traffic_io *self;
+	self = calloc(1, sizeof(*self));
+	if (self == NULL)
+		return self;
+	self->conf = *(struct traffic_io_conf*)conf;
+	noise_init(&self->noise, self->conf.seed);
+	self->frame = malloc(sizeof(struct frame) + FRAMELEN_MAX);
+	if (self->frame == NULL) {
+		free(self);
+		return NULL;
+	}
+	return self;
+}
+
+
+static int destroy(void *arg)
+{
+	struct traffic_io *self = arg;
+	size_t i;
+	for (i = 0; i < self->nbursts; i++)
+		free(self->bursts[i].wave);
+	free(self->bursts);
+	free(self->buf);
+	free(self->modbuf);
+	free(self->frame);
+	free(self);
+	return 0;
+}
+
+
+/* Transmitter input. Gives the prepared frame once. */
+static int traffic_get_frame(void *arg, struct frame *frame, size_t maxlen, timestamp_t time_dl)
+{
+	struct traffic_io *self = arg;
+	(void)time_dl;
+	if (!self->frame_pending || self->frame->m.len > maxlen)
+		return -1;
+	self->frame_pending = 0;
+	frame->m = self->frame->m;
+	memcpy(frame->data, self->frame->data, self->frame->m.len);
+	return frame->m.len;
+}
+
+
+static int traffic_tick(void *arg, timestamp_t timenow)
+{
+	(void)arg; (void)timenow;
+	return 0;
+}
+
+
+static const struct tx_input_code traffic_input_code = { "traffic_io_input", NULL, NULL, NULL, NULL, NULL, traffic_get_frame, traffic_tick };
+
+
+/* Receiver output. Matches received frames to the bursts
+ * and then passes them on to the configured output. */
+static int traffic_frame(void *arg, const struct frame *frame)
+{
+	struct traffic_io *self = arg;
+	const timestamp_t tol = (timestamp_t)(1e9 * self->conf.match_tolerance);
+	timestamp_t t = self->rx_time;
+	struct burst *match = NULL;
+	size_t i;
+
+	if (frame->m.flags & METADATA_TIME)
+		t = frame->m.time;
+	// Bursts are in the order of their start time, so take the first one
+	for (i = 0; i < self->nbursts; i++) {
+		struct burst *b = &self->bursts[i];
+		if (!b->detected && t + tol >= b->time_begin && t <= b->time_end + tol) {
+			match = b;
+			break;
+		}
+	}
+	if (match != NULL)
+		match->detected = 1;
+	else
+		self->st.false_detections++;
+
+	if (self->rx_output == NULL)
+		return 0;
+	return self->rx_output->frame(self->rx_output_arg, frame);
+}
+
+
+static int traffic_output_tick(void *arg, timestamp_t timenow)
+{
+	struct traffic_io *self = arg;
+	if (self->rx_output == NULL)
+		return 0;
+	return self->rx_output->tick(self->rx_output_arg, timenow);
+}
+
+
+static const struct rx_output_code traffic_output_code = { "traffic_io_output", NULL, NULL, NULL, NULL, NULL, traffic_frame, traffic_output_tick };
+
+
+static int set_callbacks(void *arg, const struct receiver_code *receiver, void *receiver_arg, const struct transmitter_code *transmitter, void *transmitter_arg)
+{
+	struct traffic_io *self = arg;
+	self->receiver_arg = receiver_arg;
+	self->receiver = receiver;
+	self->transmitter_arg = transmitter_arg;
+	self->transmitter = transmitter;
+	if (receiver != NULL)
+		receiver->set_callbacks(receiver_arg, &traffic_output_code, self);
+	if (transmitter != NULL)
+		transmitter->set_callbacks(transmitter_arg, &traffic_input_code, self);
+	return 0;
+}
+
+
+static int set_receiver_conf(void *arg, const void *receiver_conf, const struct rx_output_code *rx_output, void *rx_output_arg)
+{
+	struct traffic_io *self = arg;
+	(void)receiver_conf;
+	self->rx_output = rx_output;
+	self->rx_output_arg = rx_output_arg;
+	return 0;
+}
+
+
+/* Make a frame with random payload for the transmitter */
+static void make_frame(struct traffic_io *self)
+{
+	const struct traffic_io_conf *conf = &self->conf;
+	bit_t *bitp = self->frame->data;
+	size_t i;
+
+	for (i = 0; i < conf->preamblelen; i++)
+		*bitp++ = i & 1;
+	for (i = conf->synclen; i-- > 0; )
+		*bitp++ = (conf->syncword >> i) & 1;
+	for (i = 0; i < 8 * conf->frame_len; i++)
+		*bitp++ = noise_uniform(&self->noise) < 0.5;
+
+	// Not timed, so the transmitter starts it right away
+	self->frame->m = (struct metadata){ .len = bitp - self->frame->data };
+	self->frame_pending = 1;
+}
+
+
+// Append samples to the signal of a burst
+static int burst_append(struct burst *b, const sample_t *s, size_t n)
+{
+	sample_t *wave = realloc(b->wave, (b->len + n) * sizeof(sample_t));
+	if (wave == NULL)
+		return -1;
+	memcpy(wave + b->len, s, n * sizeof(sample_t));
+	b->wave = wave;
+	b->len += n;
+	return 0;
+}
+
+
+/* Run the transmitter until it has transmitted a frame.
+ * Return -1 if it does not transmit anything. */
+static int modulate(struct traffic_io *self, struct burst *b)
+{
+	const size_t n = self->conf.buffer;
+	const double sample_ns = 1e9 / self->conf.samplerate;
+	bool started = 0;
+	int tries = 0;
+
+	make_frame(self);
+	for (;;) {
+		tx_return_t r = self->transmitter->execute(self->transmitter_arg, self->modbuf, n, self->mod_time);
+		if (r.len <= 0)
+			r.len = n;
+		self->mod_time += (timestamp_t)(sample_ns * r.len);
+		if (r.end > r.begin) {
+			started = 1;
+			if (burst_append(b, self->modbuf + r.begin, r.end - r.begin) < 0)
+				return -1;
+			if (r.end < r.len || b->len >= BURST_MAX)
+				break;
+		} else if (started || ++tries >= START_TRIES) {
+			break;
+		}
+	}
+	self->frame_pending = 0;
+	return started ? 0 : -1;
+}
+
+
+/* Create a burst starting at a given position of the stream */
+static int add_burst(struct traffic_io *self, uint64_t start)
+{
+	const struct traffic_io_conf *conf = &self->conf;
+	struct burst *b;
+	size_t i;
+
+	if (self->nbursts >= self->bursts_size) {
+		size_t size = self->bursts_size ? 2 * self->bursts_size : 64;
+		b = realloc(self->bursts, size * sizeof(struct burst));
+		if (b == NULL)
+			return -1;
+		self->bursts = b;
+		self->bursts_size = size;
+	}
+	b = &self->bursts[self->nbursts];
+	*b = (struct burst){ .start = start };
+	if (modulate(self, b) < 0) {
+		free(b->wave);
+		return -1;
+	}
+
+	// Scale the burst so that it has the wanted SNR
+	const double snr = conf->snr_min + (conf->snr_max - conf->snr_min) * noise_uniform(&self->noise);
+	const double bw = conf->noise_bandwidth > 0 ? conf->noise_bandwidth : conf->samplerate;
+	const double target = pow(10, (conf->noise + snr) / 10) * bw / conf->samplerate;
+	double power = 0;
+	for (i = 0; i < b->len; i++)
+		power += (double)crealf(b->wave[i] * conjf(b->wave[i]));
+	power /= (double)b->len;
+	const float amp = power > 0 ? (float)sqrt(target / power) : 0;
+	for (i = 0; i < b->len; i++)
+		b->wave[i] *= amp;
+
+	const double freq = conf->freq_span * (noise_uniform(&self->noise) - 0.5);
+	b->osc = cexpf(I * (float)(2 * M_PI * noise_uniform(&self->noise)));
+	b->osc_step = cexpf(I * (float)(2 * M_PI * freq / conf->samplerate));
+	b->time_begin = (timestamp_t)(1e9 * (double)start / conf->samplerate);
+	b->time_end = (timestamp_t)(1e9 * (double)(start + b->len) / conf->samplerate);
+
+	self->nbursts++;
+	self->st.offered++;
+	self->st.burst_samples += b->len;
+	return 0;
+}
+
+
+/* Generate a buffer of n samples of the stream */
+static void generate(struct traffic_io *self, size_t n)
+{
+	const double sigma = self->noise_sigma;
+	sample_t *s = self->buf;
+	size_t i, j;
+
+	noise_generate(&self->noise, s, n, sigma);
+
+	// New bursts arriving during this buffer
+	while (self->next_arrival < (double)(self->pos + n)) {
+		if (add_burst(self, (uint64_t)self->next_arrival) < 0) {
+			fprintf(stderr, "Traffic generator: transmitter did not transmit a burst\n");
+			self->rate = 0;
+		}
+		if (self->rate <= 0) {
+			self->next_arrival = HUGE_VAL;
+			break;
+		}
+		self->next_arrival += -log(noise_uniform(&self->noise)) * self->conf.samplerate / self->rate;
+	}
+
+	for (j = 0; j < self->nbursts; j++) {
+		struct burst *b = &self->bursts[j];
+		if (b->wave == NULL || b->start >= self->pos + n)
+			continue;
+		const size_t off = self->pos > b->start ? self->pos - b->start : 0;
+		const size_t i0 = b->start > self->pos ? b->start - self->pos : 0;
+		size_t cnt = b->len - off;
+		if (cnt > n - i0)
+			cnt = n - i0;
+		sample_t osc = b->osc;
+		for (i = 0; i < cnt; i++) {
+			s[i0 + i] += b->wave[off + i] * osc;
+			osc *= b->osc_step;
+		}
+		b->osc = osc / cabsf(osc);
+		if (off + cnt == b->len) {
+			free(b->wave);
+			b->wave = NULL;
+		}
+	}
+}
+
+
+/* Decide the detection status of bursts which are far enough
+ * in the past and remove them */
+static void retire_bursts(struct traffic_io *self)
+{
+	const timestamp_t tol = (timestamp_t)(1e9 * self->conf.match_tolerance);
+	size_t i, j = 0;
+	for (i = 0; i < self->nbursts; i++) {
+		struct burst *b = &self->bursts[i];
+		if (b->wave == NULL && b->time_end + tol < self->rx_time) {
+			if (b->detected)
+				self->st.detected++;
+			else
+				self->st.missed++;
+			continue;
+		}
+		self->bursts[j++] = *b;
+	}
+	self->nbursts = j;
+}
+
+
+static void print_report(struct traffic_io *self, double seconds)
+{
+	struct traffic_stats *st = &self->st;
+	const uint64_t decided = st->detected + st->missed;
+	fprintf(stderr, "Traffic: %.1f bursts/s, %.2f overlapping, "
+		"%llu/%llu detected (%.1f %%), %llu false, "
+		"receiver CPU %.3f ms/burst (%.1f %% of real time), generator CPU %.3f ms/burst\n",
+		(double)st->offered / seconds,
+		(double)st->burst_samples / (seconds * self->conf.samplerate),
+		(unsigned long long)st->detected, (unsigned long long)decided,
+		decided > 0 ? 100.0 * (double)st->detected / (double)decided : 0.0,
+		(unsigned long long)st->false_detections,
+		st->offered > 0 ? 1e-6 * (double)st->rx_cpu / (double)st->offered : 0.0,
+		1e-7 * (double)st->rx_cpu / seconds,
+		st->offered > 0 ? 1e-6 * (double)st->gen_cpu / (double)st->offered : 0.0);
+	memset(st, 0, sizeof(*st));
+}
+
+
+static int execute(void *arg)
+{
+	struct traffic_io *self = arg;
+	const struct traffic_io_conf *conf = &self->conf;
+	const size_t buffer = conf->buffer;
+	const uint64_t total = (uint64_t)(conf->duration * conf->samplerate);
+	const uint64_t step = (uint64_t)(conf->step_duration * conf->samplerate);
+	uint64_t step_start = 0;
+
+	if (self->transmitter == NULL || buffer == 0 || step == 0)
+		return -1;
+	if (8 * conf->frame_len + conf->synclen + conf->preamblelen > FRAMELEN_MAX) {
+		fprintf(stderr, "Traffic generator: too long frames\n");
+		return -1;
+	}
+	self->buf = malloc(buffer * sizeof(sample_t));
+	self->modbuf = malloc(buffer * sizeof(sample_t));
+	if (self->buf == NULL || self->modbuf == NULL)
+		return -1;
+	self->noise_sigma = (float)sqrt(pow(10, conf->noise / 10) / 2);
+	self->rate = conf->burst_rate;
+	self->next_arrival = self->rate > 0 ? -log(noise_uniform(&self->noise)) * conf->samplerate / self->rate : HUGE_VAL;
+
+	while (total == 0 || self->pos < total) {
+		size_t n = buffer;
+		if (total > 0 && total - self->pos < n)
+			n = total - self->pos;
+
+		long long t0 = cpu_ns();
+		generate(self, n);
+		long long t1 = cpu_ns();
+		self->rx_time = (timestamp_t)(1e9 * (double)self->pos / conf->samplerate);
+		if (self->receiver != NULL)
+			self->receiver->execute(self->receiver_arg, self->buf, n, self->rx_time);
+		self->st.gen_cpu += t1 - t0;
+		self->st.rx_cpu += cpu_ns() - t1;
+		self->pos += n;
+		retire_bursts(self);
+
+		if (self->pos - step_start >= step) {
+			print_report(self, (double)(self->pos - step_start) / conf->samplerate);
+			step_start = self->pos;
+			if (conf->rate_step != 0) {
+				self->rate += conf->rate_step;
+				if (self->rate > 0 && self->next_arrival == HUGE_VAL)
+					self->next_arrival = (double)self->pos;
+			}
+		}
+	}
+	if (self->pos > step_start)
+		print_report(self, (double)(self->pos - step_start) / conf->samplerate);
+	return 0;
+}
+
+
+const struct traffic_io_conf traffic_io_defaults = {
+	.samplerate = 1e6,
+	.buffer = 4096,
+	.duration = 60,
+	.burst_rate = 10,
+	.rate_step = 0,
+	.step_duration = 10,
+	.freq_span = 0,
+	.snr_min = 10,
+	.snr_max = 20,
+	.noise_bandwidth = 0,
+	.noise = -40,
+	.frame_len = 32,
+	.syncword = 0x36994625,
+	.synclen = 32,
+	.preamblelen = 64,
+	.match_tolerance = 0.01,
+	.seed = 1
+};
+
+CONFIG_BEGIN(traffic_io)
+CONFIG_F(samplerate)
+CONFIG_I(buffer)
+CONFIG_F(duration)
+CONFIG_F(burst_rate)
+CONFIG_F(rate_step)
+CONFIG_F(step_duration)
+CONFIG_F(freq_span)
+CONFIG_F(snr_min)
+CONFIG_F(snr_max)
+CONFIG_F(noise_bandwidth)
+CONFIG_F(noise)
+CONFIG_I(frame_len)
+CONFIG_I(syncword)
+CONFIG_I(synclen)
+CONFIG_I(preamblelen)
+CONFIG_F(match_tolerance)
+CONFIG_I(seed)
+CONFIG_END()
+
+
+const struct signal_io_code traffic_io_code = { "traffic_io", init, destroy, init_conf, set_conf, set_callbacks, execute, set_receiver_conf };
@@ -0,0 +1,61 @@
+#ifndef LIBSUO_TRAFFIC_IO_H
+#define LIBSUO_TRAFFIC_IO_H
+#include "suo.h"
+
+/* Traffic generator for load testing of receivers.
+ *
+ * Synthesizes a stream with randomly arriving bursts at random
+ * frequency offsets and signal-to-noise ratios, and gives it to
+ * the receiver as fast as possible. Bursts may overlap in time.
+ *
+ * Each burst is modulated by the configured transmitter, which gets
+ * its frames from the traffic generator instead of the TX input.
+ * Frames have a preamble, a sync word and random payload bytes,
+ * like those made by basic_encoder without FEC.
+ *
+ * The time and frequency of every burst is stored, and received
+ * frames are matched to them by time. Statistics are reported
+ * after each step, and the burst rate can be increased step by step
+ * to find the load a receiver can handle. */
+
+struct traffic_io_conf {
+	// Sample rate of the stream
+	double samplerate;
+	// Number of samples processed at a time
+	unsigned buffer;
+	// Amount of signal to generate (seconds). 0 runs forever.
+	double duration;
+	// Average number of bursts per second in the first step
+	double burst_rate;
+	// Increase of burst_rate after each step
+	double rate_step;
+	// Length of a step (seconds of signal)
+	double step_duration;
+	/* Bursts are placed at frequency offsets distributed uniformly
+	 * over this bandwidth (Hz), centered at the transmitter frequency */
+	double freq_span;
+	// Range of signal-to-noise ratios of bursts (dB)
+	double snr_min, snr_max;
+	/* Bandwidth in which the signal-to-noise ratio is defined (Hz),
+	 * typically the signal bandwidth. 0 means the whole sample rate. */
+	double noise_bandwidth;
+	// Noise power in the whole sample rate bandwidth (dB)
+	double noise;
+	// Number of random payload bytes in a frame
+	unsigned frame_len;
+	// Framing
+	uint64_t syncword;
+	unsigned synclen, preamblelen;
+	/* Received frame is matched to a burst if its timestamp is
+	 * between the start and the end of the burst, with this much
+	 * tolerance (seconds) */
+	double match_tolerance;
+	// Seed of the random number generator
+	unsigned seed;
+};
+
+extern const struct traffic_io_conf traffic_io_defaults;
+
+extern const struct signal_io_code traffic_io_code;
+
+#endif
@@ -0,0 +1,481 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#include "udp_io.h"
+#include "suo_macros.h"
+#include "conversion.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <byteswap.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+// Sample formats, numbered the same way as in file_io
+#define FORMAT_CS16 1
+#define FORMAT_CF32 2
+#define FORMAT_CS8  4
+
+#define MAX_PACKET 0x10000
+// Longest VITA-49 header: header, stream ID, class ID, both timestamps
+#define MAX_HEADER 28
+/* Space after the payload of a full packet.
+ * Receives the VITA-49 trailer, and anything beyond that
+ * tells that the packet was longer than expected. */
+#define TAIL 8
+#define CONTROL_SIZE CMSG_SPACE(sizeof(uint32_t))
+
+struct udp_io {
+	struct udp_io_conf conf;
+	const struct receiver_code *receiver;
+	void *receiver_arg;
+	int sock;
+
+	// Size of a sample in the payload (bytes)
+	size_t sample_size;
+	// Length of the VITA-49 header preceding the payload (bytes)
+	size_t hdr_len;
+	// Number of samples in a full packet
+	size_t slot;
+	double sample_ns;
+
+	/* Buffers for a batch of datagrams.
+	 * Payload of datagram i is received at sample i*slot,
+	 * either in buf directly or in raw if it needs conversion. */
+	struct mmsghdr *msgs;
+	struct iovec *iovs;
+	uint8_t *hdrs, *tails;
+	char *control;
+	uint8_t *raw;
+	sample_t *buf;
+
+	// Previous VITA-49 packet count
+	unsigned count;
+	bool have_count;
+	/* Previous value of the kernel drop counter.
+	 * The counter starts from zero when the socket is created
+	 * and is only reported once it is non-zero. */
+	uint32_t kernel_drops;
+	// Number of samples received or lost, for counting time
+	uint64_t pos;
+
+	/* Run of consecutive samples not yet passed to the receiver.
+	 * Begins from the payload of datagram run_first. */
+	size_t run_first, run_len;
+	timestamp_t run_time;
+
+	// Statistics since the previous report
+	uint64_t packets, calls, lost, dropped, ignored;
+};
+
+
+static void *init(const void *conf)
+{
+	struct udp_io *self;
+	self = calloc(1, sizeof(*self));
+	if (self == NULL)
+		return self;
+	self->conf = *(struct udp_io_conf*)conf;
+	self->sock = -1;
+	return self;
+}
+
+
+static int destroy(void *arg)
+{
+	struct udp_io *self = arg;
+	if (self->sock >= 0)
+		close(self->sock);
+	free(self->msgs);
+	free(self->iovs);
+	free(self->hdrs);
+	free(self->tails);
+	free(self->control);
+	free(self->raw);
+	free(self->buf);
+	free(self);
+	return 0;
+}
+
+
+static int set_callbacks(void *arg, const struct receiver_code *receiver, void *receiver_arg, const struct transmitter_code *transmitter, void *transmitter_arg)
+{
+	struct udp_io *self = arg;
+	self->receiver_arg = receiver_arg;
+	self->receiver = receiver;
+	(void)transmitter_arg;
+	if (transmitter != NULL)
+		fprintf(stderr, "Warning: udp_io does not support transmitting\n");
+	return 0;
+}
+
+
+static int open_socket(struct udp_io *self)
+{
+	const struct udp_io_conf *conf = &self->conf;
+	struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_DGRAM, .ai_flags = AI_PASSIVE };
+	struct addrinfo *res;
+	char port[16];
+	int ret;
+
+	snprintf(port, sizeof(port), "%u", conf->port);
+	ret = getaddrinfo(conf->host, port, &hints, &res);
+	if (ret != 0) {
+		fprintf(stderr, "Failed to resolve %s: %s\n", conf->host, gai_strerror(ret));
+		return -1;
+	}
+	self->sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+	if (self->sock < 0 || bind(self->sock, res->ai_addr, res->ai_addrlen) < 0) {
+		perror("Failed to bind UDP socket");
+		freeaddrinfo(res);
+		return -1;
+	}
+	freeaddrinfo(res);
+
+	/* Try to bypass net.core.rmem_max first. That needs CAP_NET_ADMIN,
+	 * so fall back to the normal option if it fails. */
+	int opt = conf->socket_buffer;
+	socklen_t optlen = sizeof(opt);
+	if (setsockopt(self->sock, SOL_SOCKET, SO_RCVBUFFORCE, &opt, sizeof(opt)) < 0)
+		setsockopt(self->sock, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt));
+	// Kernel reports double the size it was given
+	if (getsockopt(self->sock, SOL_SOCKET, SO_RCVBUF, &opt, &optlen) == 0 && (unsigned)opt / 2 < conf->socket_buffer)
+		fprintf(stderr, "Warning: UDP socket buffer is only %d bytes. Consider raising net.core.rmem_max\n", opt / 2);
+
+	// Get the number of datagrams dropped by the kernel with every datagram
+	opt = 1;
+	setsockopt(self->sock, SOL_SOCKET, SO_RXQ_OVFL, &opt, sizeof(opt));
+	self->kernel_drops = 0;
+	return 0;
+}
+
+
+/* Parse a VITA-49 header from words in host byte order.
+ * Return the header length in words, or 0 if the packet is not IF data. */
+static size_t vita49_header_words(uint32_t w)
+{
+	const unsigned type = w >> 28;
+	if (type > 1)
+		return 0;
+	return 1 + type + 2 * ((w >> 27) & 1) + (((w >> 22) & 3) != 0) + 2 * (((w >> 20) & 3) != 0);
+}
+
+
+static uint32_t get_be32(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return ntohl(v);
+}
+
+
+/* Wait for the first data packet and find out the packet layout
+ * from it, without consuming it. */
+static int probe(struct udp_io *self)
+{
+	uint8_t *p = malloc(MAX_PACKET);
+	ssize_t len;
+	if (p == NULL)
+		return -1;
+	for (;;) {
+		len = recv(self->sock, p, MAX_PACKET, MSG_PEEK);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("Failed to receive UDP packet");
+			goto fail;
+		}
+		if (!self->conf.vita49)
+			break;
+		size_t hw = len >= 4 ? vita49_header_words(get_be32(p)) : 0;
+		if (hw != 0 && (size_t)len >= 4 * hw) {
+			const uint32_t w = get_be32(p);
+			self->hdr_len = 4 * hw;
+			// Trailer is not part of the payload
+			len = (ssize_t)(4 * (w & 0xFFFF)) - (ssize_t)self->hdr_len - 4 * ((w >> 26) & 1);
+			break;
+		}
+		// Consume the packet which was not IF data
+		recv(self->sock, p, MAX_PACKET, 0);
+	}
+	free(p);
+
+	if (self->slot == 0)
+		self->slot = len > 0 ? (size_t)len / self->sample_size : 0;
+	if (self->slot == 0) {
+		fprintf(stderr, "Empty UDP packet received, set packet_samples\n");
+		return -1;
+	}
+	fprintf(stderr, "Receiving UDP packets of %zu samples, %zu bytes of header\n", self->slot, self->hdr_len);
+	return 0;
+fail:
+	free(p);
+	return -1;
+}
+
+
+static int setup_buffers(struct udp_io *self)
+{
+	const size_t batch = self->conf.batch;
+	const size_t payload = self->slot * self->sample_size;
+	const bool zero_copy = self->conf.format == FORMAT_CF32;
+
+	self->msgs = calloc(batch, sizeof(*self->msgs));
+	self->iovs = calloc(3 * batch, sizeof(*self->iovs));
+	self->hdrs = malloc(batch * MAX_HEADER);
+	self->tails = malloc(batch * TAIL);
+	self->control = malloc(batch * CONTROL_SIZE);
+	self->buf = malloc(sizeof(sample_t) * batch * self->slot);
+	if (!zero_copy)
+		self->raw = malloc(batch * payload);
+	if (self->msgs == NULL || self->iovs == NULL || self->hdrs == NULL || self->tails == NULL
+	|| self->control == NULL || self->buf == NULL || (!zero_copy && self->raw == NULL))
+		return -1;
+
+	for (size_t i = 0; i < batch; i++) {
+		struct iovec *iov = &self->iovs[3 * i];
+		size_t n = 0;
+		if (self->hdr_len > 0)
+			iov[n++] = (struct iovec){ self->hdrs + i * MAX_HEADER, self->hdr_len };
+		iov[n++] = (struct iovec){ zero_copy ? (void *)(self->buf + i * self->slot) : (void *)(self->raw + i * payload), payload };
+		iov[n++] = (struct iovec){ self->tails + i * TAIL, TAIL };
+		self->msgs[i].msg_hdr.msg_iov = iov;
+		self->msgs[i].msg_hdr.msg_iovlen = n;
+		self->msgs[i].msg_hdr.msg_control = self->control + i * CONTROL_SIZE;
+	}
+	return 0;
+}
+
+
+static void swap16(uint16_t *p, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		p[i] = bswap_16(p[i]);
+}
+
+
+static void swap32(uint32_t *p, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		p[i] = bswap_32(p[i]);
+}
+
+
+/* Convert the samples of the current run in place in the batch buffer
+ * and pass them to the receiver */
+static void flush_run(struct udp_io *self)
+{
+	const size_t n = self->run_len;
+	if (n == 0)
+		return;
+	sample_t *s = self->buf + self->run_first * self->slot;
+	void *raw = self->raw + self->run_first * self->slot * self->sample_size;
+
+	switch (self->conf.format) {
+	case FORMAT_CF32:
+		if (self->conf.big_endian)
+			swap32((uint32_t *)s, 2 * n);
+		break;
+	case FORMAT_CS16:
+		if (self->conf.big_endian)
+			swap16(raw, 2 * n);
+		cs16_to_cf(raw, s, n);
+		break;
+	case FORMAT_CS8:
+		cs8_to_cf(raw, s, n);
+		break;
+	}
+	self->receiver->execute(self->receiver_arg, s, n, self->run_time);
+	self->run_len = 0;
+}
+
+
+// Check the kernel drop counter received with a datagram
+static uint32_t kernel_drops(struct udp_io *self, struct msghdr *msg)
+{
+	struct cmsghdr *c;
+	for (c = CMSG_FIRSTHDR(msg); c != NULL; c = CMSG_NXTHDR(msg, c)) {
+		if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SO_RXQ_OVFL)
+			continue;
+		uint32_t d, new;
+		memcpy(&d, CMSG_DATA(c), sizeof(d));
+		new = d - self->kernel_drops;
+		self->kernel_drops = d;
+		return new;
+	}
+	return 0;
+}
+
+
+static void process_datagram(struct udp_io *self, size_t i)
+{
+	struct mmsghdr *m = &self->msgs[i];
+	const size_t len = m->msg_len;
+	const size_t payload_max = self->slot * self->sample_size;
+	uint64_t lost = kernel_drops(self, &m->msg_hdr);
+	bool has_time = 0;
+	timestamp_t time = 0;
+	size_t payload;
+
+	self->dropped += lost;
+	if (m->msg_hdr.msg_flags & MSG_TRUNC)
+		goto ignore;
+
+	if (self->conf.vita49) {
+		const uint8_t *h = self->hdrs + i * MAX_HEADER;
+		if (len < self->hdr_len)
+			goto ignore;
+		const uint32_t w = get_be32(h);
+		if (4 * vita49_header_words(w) != self->hdr_len || 4 * (w & 0xFFFF) > len)
+			goto ignore;
+		const size_t trailer = 4 * ((w >> 26) & 1);
+		if (4 * (w & 0xFFFF) < self->hdr_len + trailer)
+			goto ignore;
+		payload = 4 * (w & 0xFFFF) - self->hdr_len - trailer;
+
+		/* The 4-bit packet count tells the number of lost packets
+		 * up to 15. It covers the drops by the kernel as well. */
+		const unsigned count = (w >> 16) & 0xF;
+		lost = self->have_count ? (count - self->count - 1) & 0xF : 0;
+		self->count = count;
+		self->have_count = 1;
+
+		const unsigned tsi = (w >> 22) & 3, tsf = (w >> 20) & 3;
+		size_t k = 4 * (1 + (w >> 28) + 2 * ((w >> 27) & 1));
+		uint64_t secs = 0, frac = 0;
+		if (tsi != 0) {
+			secs = get_be32(h + k);
+			k += 4;
+		}
+		if (tsf != 0)
+			frac = (uint64_t)get_be32(h + k) << 32 | get_be32(h + k + 4);
+		if (tsf == 2) {
+			// Real-time timestamp in picoseconds
+			time = 1000000000ULL * secs + frac / 1000;
+			has_time = 1;
+		} else if (tsf != 0) {
+			// Sample count or free-running count
+			time = 1000000000ULL * secs + (timestamp_t)(self->sample_ns * frac);
+			has_time = 1;
+		}
+		self->lost += lost;
+	} else {
+		payload = len;
+	}
+	if (payload > payload_max)
+		goto ignore;
+
+	if (lost > 0) {
+		flush_run(self);
+		self->pos += lost * self->slot;
+	}
+	const size_t n = payload / self->sample_size;
+	if (self->run_len == 0) {
+		self->run_first = i;
+		self->run_time = has_time ? time : (timestamp_t)(self->sample_ns * self->pos);
+	}
+	self->run_len += n;
+	self->pos += n;
+	// The next payload would not continue this one
+	if (n < self->slot)
+		flush_run(self);
+	return;
+
+ignore:
+	flush_run(self);
+	self->ignored++;
+}
+
+
+static void print_stats(struct udp_io *self)
+{
+	fprintf(stderr, "UDP: %llu packets in %llu calls, %llu lost, %llu dropped by kernel, %llu ignored\n",
+		(unsigned long long)self->packets, (unsigned long long)self->calls,
+		(unsigned long long)self->lost, (unsigned long long)self->dropped,
+		(unsigned long long)self->ignored);
+	self->packets = self->calls = self->lost = self->dropped = self->ignored = 0;
+}
+
+
+static int execute(void *arg)
+{
+	struct udp_io *self = arg;
+	const struct udp_io_conf *conf = &self->conf;
+	const timestamp_t report_ns = (timestamp_t)(1e9 * conf->report_interval);
+	timestamp_t next_report = 0;
+
+	switch (conf->format) {
+	case FORMAT_CS16: self->sample_size = sizeof(cs16_t); break;
+	case FORMAT_CF32: self->sample_size = sizeof(sample_t); break;
+	case FORMAT_CS8:  self->sample_size = sizeof(cs8_t); break;
+	default:
+		fprintf(stderr, "Unsupported UDP sample format %u\n", conf->format);
+		return -1;
+	}
+	if (self->receiver == NULL || conf->batch == 0)
+		return -1;
+	self->sample_ns = 1e9 / conf->samplerate;
+	self->slot = conf->packet_samples;
+
+	if (open_socket(self) < 0 || probe(self) < 0 || setup_buffers(self) < 0)
+		return -1;
+
+	for (;;) {
+		for (size_t i = 0; i < conf->batch; i++)
+			self->msgs[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+		// Wait for the first datagram, then take what is available
+		int n = recvmmsg(self->sock, self->msgs, conf->batch, MSG_WAITFORONE, NULL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("Failed to receive UDP packets");
+			return -1;
+		}
+		self->calls++;
+		self->packets += n;
+		for (int i = 0; i < n; i++)
+			process_datagram(self, i);
+		const timestamp_t time = self->run_time;
+		flush_run(self);
+
+		if (report_ns > 0 && time >= next_report) {
+			if (next_report != 0)
+				print_stats(self);
+			next_report = time + report_ns;
+		}
+	}
+	return 0;
+}
+
+
+const struct udp_io_conf udp_io_defaults = {
+	.host = "0.0.0.0",
+	.port = 4991,
+	.samplerate = 1e6,
+	.format = FORMAT_CS16,
+	.big_endian = 0,
+	.vita49 = 0,
+	.packet_samples = 0,
+	.batch = 64,
+	.socket_buffer = 0x2000000,
+	.report_interval = 10
+};
+
+CONFIG_BEGIN(udp_io)
+CONFIG_C(host)
+CONFIG_I(port)
+CONFIG_F(samplerate)
+CONFIG_I(format)
+CONFIG_I(big_endian)
+CONFIG_I(vita49)
+CONFIG_I(packet_samples)
+CONFIG_I(batch)
+CONFIG_I(socket_buffer)
+CONFIG_F(report_interval)
+CONFIG_END()
+
+
+const struct signal_io_code udp_io_code = { "udp_io", init, destroy, init_conf, set_conf, set_callbacks, execute, NULL };
+
+#endif
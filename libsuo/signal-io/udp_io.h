@@ -0,0 +1,55 @@
+#ifndef LIBSUO_UDP_IO_H
+#define LIBSUO_UDP_IO_H
+#include "suo.h"
+
+/* Receive an IQ stream sent as UDP datagrams, such as from
+ * a network-attached digitizer. Receive only. Linux only.
+ *
+ * Datagrams are received in batches with recvmmsg. The payloads
+ * are scattered directly into one contiguous sample buffer, so
+ * consecutive full-size packets are converted with one call and
+ * passed to the receiver with one call. CF32 payloads are passed
+ * to the receiver straight from the receive buffer without any
+ * conversion or copying.
+ *
+ * Packets can be raw samples without any header, or VITA-49
+ * IF data packets. With VITA-49, lost packets are detected from
+ * the packet count in the header, and integer and fractional
+ * timestamps are used for the receiver if present. Packets other
+ * than IF data, such as context packets, are ignored.
+ * Otherwise time is counted from the number of samples received.
+ *
+ * Packets dropped by the kernel because the socket buffer
+ * got full are also counted, so losses are detected
+ * with raw packets too. */
+
+struct udp_io_conf {
+	// Local address to bind to
+	const char *host;
+	// UDP port to receive from
+	unsigned port;
+	// Sample rate of the stream
+	double samplerate;
+	// Sample format of the payload: 1 = CS16, 2 = CF32, 4 = CS8
+	unsigned format;
+	// Payload samples are big-endian
+	unsigned char big_endian:1;
+	// Packets have a VITA-49 header
+	unsigned char vita49:1;
+	/* Number of samples in a full packet.
+	 * 0 detects it from the first packet received. */
+	unsigned packet_samples;
+	// Maximum number of datagrams received in one system call
+	unsigned batch;
+	// Size of the socket receive buffer (bytes)
+	unsigned socket_buffer;
+	/* Interval for printing statistics (seconds of signal).
+	 * 0 disables the reports. */
+	double report_interval;
+};
+
+extern const struct udp_io_conf udp_io_defaults;
+
+extern const struct signal_io_code udp_io_code;
+
+#endif
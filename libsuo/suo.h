@@ -15,7 +15,12 @@ typedef float complex sample_t;
 
 // Fixed-point I/Q samples
 typedef uint8_t cu8_t[2];
+typedef int8_t cs8_t[2];
 typedef int16_t cs16_t[2];
+// 12-bit I and Q packed into 3 bytes, see conversion.h
+typedef uint8_t sc12_t[3];
+// Half-precision floating point I/Q, stored as raw bits
+typedef uint16_t cf16_t[2];
 
 // Data type to represent single bits. Contains a value 0 or 1.
 typedef uint8_t bit_t;
@@ -170,6 +175,14 @@ struct receiver_code {
 
 	// Execute the receiver for a buffer of input signal
 	int   (*execute)       (void *, const sample_t *samp, size_t nsamp, timestamp_t timestamp);
+
+	/* Execute the receiver for a buffer of real-valued input signal,
+	 * such as audio from the discriminator output of an FM radio.
+	 * I/Os with real-valued input call this instead of execute.
+	 * Optional: NULL if the receiver only works on I/Q signal,
+	 * in which case real input is given to execute as I/Q
+	 * with a zero imaginary part. */
+	int   (*execute_real)  (void *, const float *samp, size_t nsamp, timestamp_t timestamp);
 };
 
 
@@ -274,6 +287,13 @@ struct signal_io_code {
 
 	// The I/O "main loop"
 	int   (*execute)    (void *);
+
+	/* Give the receiver configuration and the RX output, so that
+	 * the I/O can create more receiver instances with the same
+	 * configuration, e.g. one for each radio channel.
+	 * Called after set_callbacks.
+	 * Optional: NULL if not supported by the I/O. */
+	int   (*set_receiver_conf)(void *, const void *receiver_conf, const struct rx_output_code *, void *rx_output_arg);
 };
 
 
@@ -281,6 +301,7 @@ struct signal_io_code {
 struct suo {
 	const struct receiver_code *receiver;
 	void *receiver_arg;
+	const void *receiver_conf;
 
 	const struct transmitter_code *transmitter;
 	void *transmitter_arg;
@@ -5,8 +5,9 @@
 
 /* Read a section of a configuration file and initialize
  * a given suo module accordingly.
- * If f == NULL, initialize with the default configuration. */
-void *read_conf_and_init(const struct any_code *code, FILE *f)
+ * If f == NULL, initialize with the default configuration.
+ * If conf_out is not NULL, the configuration struct is returned there. */
+void *read_conf_and_init(const struct any_code *code, FILE *f, const void **conf_out)
 {
 	void *conf = NULL;
 	if (code != NULL) {
@@ -49,6 +50,8 @@ void *read_conf_and_init(const struct any_code *code, FILE *f)
 			fprintf(stderr, "Invalid configuration %s %s\n", param, value);
 		}
 	}
+	if (conf_out != NULL)
+		*conf_out = conf;
 	if (code != NULL) {
 		fprintf(stderr, "Initializing %s\n", code->name);
 		return code->init(conf);
@@ -95,21 +98,21 @@ const void *select_code(const struct any_code **list, FILE *f, const char *what)
 int read_configuration(struct suo *suo, FILE *f)
 {
 	suo->receiver        = select_code((const struct any_code**)suo_receivers, f, "Receiver");
-	suo->receiver_arg    = read_conf_and_init((const struct any_code*)suo->receiver, f);
+	suo->receiver_arg    = read_conf_and_init((const struct any_code*)suo->receiver, f, &suo->receiver_conf);
 	suo->decoder         = select_code((const struct any_code**)suo_decoders, f, "Decoder");
-	suo->decoder_arg     = read_conf_and_init((const struct any_code*)suo->decoder, f);
+	suo->decoder_arg     = read_conf_and_init((const struct any_code*)suo->decoder, f, NULL);
 	suo->rx_output       = select_code((const struct any_code**)suo_rx_outputs, f, "RX output");
-	suo->rx_output_arg   = read_conf_and_init((const struct any_code*)suo->rx_output, f);
+	suo->rx_output_arg   = read_conf_and_init((const struct any_code*)suo->rx_output, f, NULL);
 
 	suo->transmitter     = select_code((const struct any_code**)suo_transmitters, f, "Transmitter");
-	suo->transmitter_arg = read_conf_and_init((const struct any_code*)suo->transmitter, f);
+	suo->transmitter_arg = read_conf_and_init((const struct any_code*)suo->transmitter, f, NULL);
 	suo->encoder         = select_code((const struct any_code**)suo_encoders, f, "Encoder");
-	suo->encoder_arg     = read_conf_and_init((const struct any_code*)suo->encoder, f);
+	suo->encoder_arg     = read_conf_and_init((const struct any_code*)suo->encoder, f, NULL);
 	suo->tx_input        = select_code((const struct any_code**)suo_tx_inputs, f, "TX input");
-	suo->tx_input_arg    = read_conf_and_init((const struct any_code*)suo->tx_input, f);
+	suo->tx_input_arg    = read_conf_and_init((const struct any_code*)suo->tx_input, f, NULL);
 
 	suo->signal_io       = select_code((const struct any_code**)suo_signal_ios, f, "Signal I/O");
-	suo->signal_io_arg   = read_conf_and_init((const struct any_code*)suo->signal_io, f);
+	suo->signal_io_arg   = read_conf_and_init((const struct any_code*)suo->signal_io, f, NULL);
 	return 0;
 }
 
@@ -125,6 +128,11 @@ int configure(struct suo *suo, int argc, char *argv[])
 	if (f != NULL)
 		fclose(f);
 
+	if (suo->signal_io != NULL && suo->signal_io_arg == NULL) {
+		fprintf(stderr, "Failed to initialize %s\n", suo->signal_io->name);
+		suo->signal_io = NULL;
+	}
+
 	if (suo->receiver != NULL && suo->rx_output != NULL) {
 		suo->rx_output  ->set_callbacks(suo->rx_output_arg, suo->decoder, suo->decoder_arg);
 		suo->receiver   ->set_callbacks(suo->receiver_arg, suo->rx_output, suo->rx_output_arg);
@@ -137,6 +145,10 @@ int configure(struct suo *suo, int argc, char *argv[])
 
 	if (suo->signal_io != NULL)
 		suo->signal_io->set_callbacks(suo->signal_io_arg, suo->receiver, suo->receiver_arg, suo->transmitter, suo->transmitter_arg);
+
+	if (suo->signal_io != NULL && suo->signal_io->set_receiver_conf != NULL
+	&& suo->receiver != NULL && suo->rx_output != NULL)
+		suo->signal_io->set_receiver_conf(suo->signal_io_arg, suo->receiver_conf, suo->rx_output, suo->rx_output_arg);
 	return 0;
 }
 